@@ -32,6 +32,10 @@ Authors: Sanchit Misra <sanchit.misra@intel.com>; Vasimuddin Md <vasimuddin.md@i
 #include "FMI_search.h"
 #include "memcpy_bwamem.h"
 #include "profiling.h"
+#include "tune.h"
+#if NUMA_ENABLED
+#include <numa.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -53,10 +57,62 @@ FMI_search::FMI_search(const char *fname)
     sa_ms_byte = NULL;
     cp_occ = NULL;
     one_hot_mask_array = NULL;
+#if NUMA_ENABLED
+    numa_node = -1;
+#endif
+}
+
+#if NUMA_ENABLED
+static void *numa_copy_onnode(const void *src, size_t size, int node)
+{
+    void *dst = numa_alloc_onnode(size, node);
+    if (dst == NULL) {
+        fprintf(stderr, "ERROR! unable to allocate %0.2lf GB on NUMA node %d\n",
+                size * 1.0 / (1024*1024*1024), node);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(dst, src, size);
+    return dst;
+}
+
+// Copy of the seeding/SAL arrays of a loaded index, placed on one NUMA node.
+// bns/pac are only read outside the seeding kernels and stay shared.
+FMI_search::FMI_search(const FMI_search *src, int node)
+{
+    strcpy_s(file_name, PATH_MAX, src->file_name);
+    reference_seq_len = src->reference_seq_len;
+    sentinel_index = src->sentinel_index;
+    index_alloc = 0;
+    memcpy(count, src->count, sizeof(count));
+    free(idx);
+    idx = src->idx;
+    numa_node = node;
+
+    one_hot_mask_array = (uint64_t *) numa_copy_onnode(src->one_hot_mask_array,
+                                                       64 * sizeof(uint64_t), node);
+    cp_occ = (CP_OCC *) numa_copy_onnode(src->cp_occ, cp_occ_size() * sizeof(CP_OCC), node);
+    sa_ms_byte = (int8_t *) numa_copy_onnode(src->sa_ms_byte, sa_size() * sizeof(int8_t), node);
+    sa_ls_word = (uint32_t *) numa_copy_onnode(src->sa_ls_word, sa_size() * sizeof(uint32_t), node);
+}
+#endif
+
+int64_t FMI_search::index_bytes() const
+{
+    return cp_occ_size() * sizeof(CP_OCC) + sa_size() * (sizeof(int8_t) + sizeof(uint32_t));
 }
 
 FMI_search::~FMI_search()
 {
+#if NUMA_ENABLED
+    if (numa_node >= 0) {
+        numa_free(one_hot_mask_array, 64 * sizeof(uint64_t));
+        numa_free(cp_occ, cp_occ_size() * sizeof(CP_OCC));
+        numa_free(sa_ms_byte, sa_size() * sizeof(int8_t));
+        numa_free(sa_ls_word, sa_size() * sizeof(uint32_t));
+        idx = NULL;    // owned by the source index
+        return;
+    }
+#endif
     if(sa_ms_byte)
         _mm_free(sa_ms_byte);
     if(sa_ls_word)
@@ -1121,7 +1177,7 @@ int64_t FMI_search::get_sa_entry_compressed(int64_t pos, int tid)
         return sa_entry;        
     }
     else {
-        // tprof[MEM_CHAIN][tid] ++;
+        // TPROF(MEM_CHAIN, tid) ++;
         int64_t offset = 0; 
         int64_t sp = pos;
         while(true)
@@ -1151,7 +1207,7 @@ int64_t FMI_search::get_sa_entry_compressed(int64_t pos, int tid)
             sp = count[b] + occ_sp;
             
             offset ++;
-            // tprof[ALIGN1][tid] ++;
+            // TPROF(ALIGN1, tid) ++;
             if ((sp & SA_COMPX_MASK) == 0) break;
         }
         // assert((reference_seq_len >> SA_COMPX) - 1 >= (sp >> SA_COMPX));
@@ -1295,9 +1351,9 @@ void FMI_search::get_sa_entries_prefetch(SMEM *smemArray, int64_t *coordArray,
     
     id_ += id;
     
-    const int32_t sa_batch_size = 20;
-    int64_t working_set[sa_batch_size], map_pos[sa_batch_size];;
-    int64_t offset[sa_batch_size] = {-1};
+    const int32_t sa_batch_size = mem_tune.sal_batch;
+    int64_t working_set[TUNE_SAL_MAX], map_pos[TUNE_SAL_MAX];
+    int64_t offset[TUNE_SAL_MAX] = {-1};
     
     int i = 0, j = 0;    
     while(i<id && j<sa_batch_size)
@@ -88,11 +88,15 @@ class FMI_search: public indexEle
 {
     public:
     FMI_search(const char *fname);
+#if NUMA_ENABLED
+    FMI_search(const FMI_search *src, int node);
+#endif
     ~FMI_search();
     //int64_t beCalls;
     
     int build_index();
     void load_index();
+    int64_t index_bytes() const;   // occurrence table and SA samples
 
     void getSMEMs(uint8_t *enc_qdb,
                   int32_t numReads,
@@ -175,6 +179,9 @@ private:
         CP_OCC *cp_occ;
 
         uint64_t *one_hot_mask_array;
+#if NUMA_ENABLED
+        int numa_node;   // node holding this replica; -1 for the loaded index
+#endif
 
         int64_t pac_seq_len(const char *fn_pac);
         void pac2nt(const char *fn_pac,
@@ -185,6 +192,12 @@ private:
                                int64_t *sa_bwt,
                                int64_t *count);
         SMEM backwardExt(SMEM smem, uint8_t a);
+        int64_t cp_occ_size() const { return (reference_seq_len >> CP_SHIFT) + 1; }
+#if SA_COMPRESSION
+        int64_t sa_size() const { return (reference_seq_len >> SA_COMPX) + 1; }
+#else
+        int64_t sa_size() const { return reference_seq_len; }
+#endif
 };
 
 #endif
@@ -0,0 +1,216 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sched.h>
+#include "affinity.h"
+
+#define SYS_CPU "/sys/devices/system/cpu"
+
+static const char *policy_names[] = { "none", "compact", "scatter", "core", "smt" };
+
+int aff_policy(const char *name)
+{
+    for (int i = 0; i < (int) (sizeof(policy_names) / sizeof(policy_names[0])); i++)
+        if (strcmp(name, policy_names[i]) == 0) return i;
+    return -1;
+}
+
+const char *aff_policy_name(int policy)
+{
+    return policy_names[policy];
+}
+
+static int read_int(const char *path, int def)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) return def;
+    int v;
+    if (fscanf(fp, "%d", &v) != 1) v = def;
+    fclose(fp);
+    return v;
+}
+
+/* Last-level cache domain of a cpu, named by the lowest cpu sharing it */
+static int read_llc(int cpu)
+{
+    char path[256];
+    int best_level = 0, llc = -1;
+    for (int k = 0; k < 16; k++) {
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cache/index%d/level", cpu, k);
+        int level = read_int(path, -1);
+        if (level < 0) break;
+        if (level <= best_level) continue;
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cache/index%d/shared_cpu_list", cpu, k);
+        int first = read_int(path, -1);   // lowest cpu of a list like "0-3,64-67"
+        if (first < 0) continue;
+        best_level = level, llc = first;
+    }
+    return llc;
+}
+
+/* Dense id of (a, b) among the pairs seen so far, in order of first appearance */
+static int dense_id(int *keys, int *n, int a, int b)
+{
+    for (int i = 0; i < *n; i++)
+        if (keys[2*i] == a && keys[2*i+1] == b) return i;
+    keys[2 * *n] = a, keys[2 * *n + 1] = b;
+    return (*n)++;
+}
+
+int cpu_topo_detect(cpu_topo_t *t)
+{
+    cpu_set_t mask;
+    char path[256];
+
+    memset(t, 0, sizeof(cpu_topo_t));
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &mask) != 0) return -1;
+
+    t->cpus = (cpu_info_t *) calloc(CPU_COUNT(&mask), sizeof(cpu_info_t));
+    int *sockets = (int *) malloc(2 * CPU_SETSIZE * sizeof(int));
+    int *cores = (int *) malloc(2 * CPU_SETSIZE * sizeof(int));
+    int *llcs = (int *) malloc(2 * CPU_SETSIZE * sizeof(int));
+    assert(t->cpus != NULL && sockets != NULL && cores != NULL && llcs != NULL);
+
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (!CPU_ISSET(c, &mask)) continue;
+        cpu_info_t *p = &t->cpus[t->n_cpus++];
+        p->cpu = c;
+
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/physical_package_id", c);
+        int socket = read_int(path, 0);
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/core_id", c);
+        int core = read_int(path, c);
+        int llc = read_llc(c);
+
+        p->socket = dense_id(sockets, &t->n_sockets, socket, 0);
+        p->core = dense_id(cores, &t->n_cores, socket, core);
+        // without cache information the socket is the locality domain
+        p->llc = dense_id(llcs, &t->n_llc, socket, llc);
+
+        p->smt = 0;
+        for (int i = 0; i < t->n_cpus - 1; i++)
+            if (t->cpus[i].core == p->core) p->smt++;
+        if (p->smt + 1 > t->max_smt) t->max_smt = p->smt + 1;
+    }
+
+    free(sockets);
+    free(cores);
+    free(llcs);
+    return t->n_cpus > 0? 0 : -1;
+}
+
+void cpu_topo_destroy(cpu_topo_t *t)
+{
+    free(t->cpus);
+    t->cpus = NULL;
+    t->n_cpus = 0;
+}
+
+typedef struct {
+    int key[4];
+    int cpu;
+} place_key_t;
+
+static int place_key_cmp(const void *a, const void *b)
+{
+    const place_key_t *x = (const place_key_t *) a, *y = (const place_key_t *) b;
+    for (int i = 0; i < 4; i++)
+        if (x->key[i] != y->key[i]) return x->key[i] < y->key[i]? -1 : 1;
+    return x->cpu - y->cpu;
+}
+
+int *aff_place(const cpu_topo_t *t, int policy, int nthreads)
+{
+    if (policy == AFF_NONE || t->n_cpus == 0) return NULL;
+
+    int n = t->n_cpus;
+    place_key_t *order = (place_key_t *) malloc(n * sizeof(place_key_t));
+    int *core_llc = (int *) malloc(t->n_cores * sizeof(int));
+    int *llc_socket = (int *) malloc(t->n_llc * sizeof(int));
+    int *core_rank = (int *) calloc(t->n_cores, sizeof(int));   // rank of a core in its L3 domain
+    int *llc_rank = (int *) calloc(t->n_llc, sizeof(int));      // rank of an L3 domain in its socket
+    assert(order != NULL && core_llc != NULL && llc_socket != NULL);
+    assert(core_rank != NULL && llc_rank != NULL);
+
+    for (int i = 0; i < n; i++) {
+        core_llc[t->cpus[i].core] = t->cpus[i].llc;
+        llc_socket[t->cpus[i].llc] = t->cpus[i].socket;
+    }
+    for (int c = 0; c < t->n_cores; c++)
+        for (int d = 0; d < c; d++)
+            if (core_llc[d] == core_llc[c]) core_rank[c]++;
+    for (int l = 0; l < t->n_llc; l++)
+        for (int d = 0; d < l; d++)
+            if (llc_socket[d] == llc_socket[l]) llc_rank[l]++;
+
+    for (int i = 0; i < n; i++) {
+        const cpu_info_t *p = &t->cpus[i];
+        int *k = order[i].key;
+        order[i].cpu = p->cpu;
+        if (policy == AFF_COMPACT || policy == AFF_SMT)
+            k[0] = p->socket, k[1] = p->llc, k[2] = p->core, k[3] = p->smt;
+        else if (policy == AFF_SCATTER)
+            k[0] = p->smt, k[1] = core_rank[p->core], k[2] = llc_rank[p->llc], k[3] = p->socket;
+        else // AFF_CORE
+            k[0] = p->smt, k[1] = p->socket, k[2] = p->llc, k[3] = p->core;
+    }
+    qsort(order, n, sizeof(place_key_t), place_key_cmp);
+    if (policy == AFF_SMT) {
+        // two siblings of a core side by side, then the cpus left over in order
+        int *rest = (int *) malloc(n * sizeof(int));
+        int m = 0, n_rest = 0;
+        assert(rest != NULL);
+        for (int i = 0; i < n; ) {
+            if (i + 1 < n && order[i].key[2] == order[i + 1].key[2]) {
+                order[m++].cpu = order[i].cpu, order[m++].cpu = order[i + 1].cpu;
+                i += 2;
+            }
+            else rest[n_rest++] = order[i++].cpu;
+        }
+        for (int i = 0; i < n_rest; i++) order[m++].cpu = rest[i];
+        free(rest);
+    }
+
+    int *cpu = (int *) malloc(nthreads * sizeof(int));
+    assert(cpu != NULL);
+    for (int i = 0; i < nthreads; i++)
+        cpu[i] = order[i % n].cpu;
+
+    free(order);
+    free(core_llc);
+    free(llc_socket);
+    free(core_rank);
+    free(llc_rank);
+    return cpu;
+}
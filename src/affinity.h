@@ -0,0 +1,80 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+/*
+ * CPU topology discovery and thread placement for the compute threads.
+ *
+ * The topology is read from /sys/devices/system/cpu and restricted to the
+ * cpus in the process affinity mask, which already reflects taskset and the
+ * cgroup cpuset. A placement policy turns it into one cpu per thread:
+ *
+ *   compact  fill the SMT siblings of a core, then the cores of an L3
+ *            domain, then the next domain and socket
+ *   scatter  spread consecutive threads over sockets, then L3 domains,
+ *            then cores; SMT siblings are used last
+ *   core     one thread per physical core first (filled compactly), then
+ *            the second SMT thread of each core, and so on
+ *   smt      threads 2p and 2p+1 on two SMT siblings of a core, the cores
+ *            filled compactly (the thread pairs of mem --smt-cosched);
+ *            cpus without a free sibling are paired with each other
+ */
+
+#ifndef _AFFINITY_H
+#define _AFFINITY_H
+
+#define AFF_NONE    0
+#define AFF_COMPACT 1
+#define AFF_SCATTER 2
+#define AFF_CORE    3
+#define AFF_SMT     4
+
+typedef struct {
+    int cpu;        // logical cpu id
+    int socket;     // physical package id
+    int core;       // physical core, unique over sockets
+    int smt;        // rank of this cpu among the allowed siblings of its core
+    int llc;        // last-level cache domain, unique over sockets
+} cpu_info_t;
+
+typedef struct {
+    int n_cpus;
+    cpu_info_t *cpus;   // allowed cpus, ascending cpu id
+    int n_sockets, n_cores, n_llc, max_smt;
+} cpu_topo_t;
+
+int aff_policy(const char *name);   // -1 if unknown
+const char *aff_policy_name(int policy);
+
+int cpu_topo_detect(cpu_topo_t *t);
+void cpu_topo_destroy(cpu_topo_t *t);
+
+/* cpu for each of nthreads threads; threads beyond the cpu count wrap around */
+int *aff_place(const cpu_topo_t *t, int policy, int nthreads);
+
+#endif
@@ -35,6 +35,7 @@ Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@i
 #include <stdint.h>
 #include <assert.h>
 #include "macro.h"
+#include "score_traits.h"
 
 #if (__AVX512BW__ || __AVX2__)
 #include <immintrin.h>
@@ -136,68 +137,10 @@ public:
                                 int nthreads,
                                 int32_t w);
 
-#if ((!__AVX512BW__) & (!__AVX2__) & (__SSE2__))
-    // AVX256 is not updated for banding and separate ins/del in the inner loop.
-    // 8 bit vector code section    
-    void getScores8(SeqPair *pairArray,
-                    uint8_t *seqBufRef,
-                    uint8_t *seqBufQer,
-                    int32_t numPairs,
-                    uint16_t numThreads,
-                    int32_t w);
-
-    void smithWatermanBatchWrapper8(SeqPair *pairArray,
-                                   uint8_t *seqBufRef,
-                                   uint8_t *seqBufQer,
-                                   int32_t numPairs,
-                                   uint16_t numThreads,
-                                   int32_t w);
-
-    void smithWaterman128_8(uint8_t seq1SoA[],
-                            uint8_t seq2SoA[],
-                            uint8_t nrow,
-                            uint8_t ncol,
-                            SeqPair *p,
-                            uint8_t h0[],
-                            uint16_t tid,
-                            int32_t numPairs,
-                            int zdrop,
-                            int32_t w,
-                            uint8_t qlen[],
-                            uint8_t myband[]);
-    // 16 bit vector code section
-    void getScores16(SeqPair *pairArray,
-                     uint8_t *seqBufRef,
-                     uint8_t *seqBufQer,
-                     int32_t numPairs,
-                     uint16_t numThreads,
-                     int32_t w);
-
-    void smithWatermanBatchWrapper16(SeqPair *pairArray,
-                                     uint8_t *seqBufRef,
-                                     uint8_t *seqBufQer,
-                                     int32_t numPairs,
-                                     uint16_t numThreads,
-                                     int32_t w);
-    
-    void smithWaterman128_16(uint16_t seq1SoA[],
-                             uint16_t seq2SoA[],
-                             uint16_t nrow,
-                             uint16_t ncol,
-                             SeqPair *p,
-                             uint16_t h0[],
-                             uint16_t tid,
-                             int32_t numPairs,
-                             int zdrop,
-                             int32_t w,
-                             uint16_t qlen[],
-                             uint16_t myband[]);
-    
-#endif  //SSE2
-
-#if ((!__AVX512BW__) & (__AVX2__))
-    // AVX256 is not updated for banding and separate ins/del in the inner loop.
-    // 8 bit vector code section    
+#if __SSE2__
+    // Vector code section: one kernel template over the vector traits in
+    // simd_traits.h, instantiated for 8-bit and 16-bit lanes of the target ISA,
+    // and over the scoring presets of score_traits.h.
     void getScores8(SeqPair *pairArray,
                     uint8_t *seqBufRef,
                     uint8_t *seqBufQer,
@@ -205,26 +148,6 @@ public:
                     uint16_t numThreads,
                     int32_t w);
 
-    void smithWatermanBatchWrapper8(SeqPair *pairArray,
-                                   uint8_t *seqBufRef,
-                                   uint8_t *seqBufQer,
-                                   int32_t numPairs,
-                                   uint16_t numThreads,
-                                   int32_t w);
-
-    void smithWaterman256_8(uint8_t seq1SoA[],
-                            uint8_t seq2SoA[],
-                            uint8_t nrow,
-                            uint8_t ncol,
-                            SeqPair *p,
-                            uint8_t h0[],
-                            uint16_t tid,
-                            int32_t numPairs,
-                            int zdrop,
-                            int32_t w,
-                            uint8_t qlen[],
-                            uint8_t myband[]);
-    // 16 bit vector code section
     void getScores16(SeqPair *pairArray,
                      uint8_t *seqBufRef,
                      uint8_t *seqBufQer,
@@ -232,84 +155,41 @@ public:
                      uint16_t numThreads,
                      int32_t w);
 
-    void smithWatermanBatchWrapper16(SeqPair *pairArray,
-                                     uint8_t *seqBufRef,
-                                     uint8_t *seqBufQer,
-                                     int32_t numPairs,
-                                     uint16_t numThreads,
-                                     int32_t w);
-    
-    void smithWaterman256_16(uint16_t seq1SoA[],
-                             uint16_t seq2SoA[],
-                             uint16_t nrow,
-                             uint16_t ncol,
-                             SeqPair *p,
-                             uint16_t h0[],
-                             uint16_t tid,
-                             int32_t numPairs,
-                             int zdrop,
-                             int32_t w,
-                             uint16_t qlen[],
-                             uint16_t myband[]);
-    
-#endif  //axv2
-
-#if __AVX512BW__
-    // 8 bit vector code section    
-    void getScores8(SeqPair *pairArray,
-                    uint8_t *seqBufRef,
-                    uint8_t *seqBufQer,
-                    int32_t numPairs,
-                    uint16_t numThreads,
-                    int32_t w);
-
-    void smithWatermanBatchWrapper8(SeqPair *pairArray,
+    template <class V>
+    void smithWatermanDispatch(SeqPair *pairArray,
+                               uint8_t *seqBufRef,
+                               uint8_t *seqBufQer,
+                               int32_t numPairs,
+                               uint16_t numThreads,
+                               int32_t w,
+                               typename V::elem *F,
+                               typename V::elem *H_h,
+                               typename V::elem *H_v);
+
+    template <class V, class S>
+    void smithWatermanBatchWrapper(SeqPair *pairArray,
                                    uint8_t *seqBufRef,
                                    uint8_t *seqBufQer,
                                    int32_t numPairs,
                                    uint16_t numThreads,
-                                   int32_t w);
-
-    void smithWaterman512_8(uint8_t seq1SoA[],
-                            uint8_t seq2SoA[],
-                            uint8_t nrow,
-                            uint8_t ncol,
-                            SeqPair *p,
-                            uint8_t h0[],
-                            uint16_t tid,
-                            int32_t numPairs,
-                            int zdrop,
-                            int32_t w,
-                            uint8_t qlen[],
-                            uint8_t myband[]);
-
-    // 16 bit vector code section
-    void getScores16(SeqPair *pairArray,
-                     uint8_t *seqBufRef,
-                     uint8_t *seqBufQer,
-                     int32_t numPairs,
-                     uint16_t numThreads,
-                     int32_t w);
-
-    void smithWatermanBatchWrapper16(SeqPair *pairArray,
-                                     uint8_t *seqBufRef,
-                                     uint8_t *seqBufQer,
-                                     int32_t numPairs,
-                                     uint16_t numThreads,
-                                     int32_t w);
-    
-    void smithWaterman512_16(uint16_t seq1SoA[],
-                             uint16_t seq2SoA[],
+                                   int32_t w,
+                                   typename V::elem *F,
+                                   typename V::elem *H_h,
+                                   typename V::elem *H_v);
+
+    template <class V, class S>
+    void smithWatermanKernel(typename V::uelem seq1SoA[],
+                             typename V::uelem seq2SoA[],
                              uint16_t nrow,
                              uint16_t ncol,
                              SeqPair *p,
-                             uint16_t h0[],
-                             uint16_t tid,
-                             int32_t numPairs,
+                             typename V::elem *F,
+                             typename V::elem *H_h,
+                             typename V::elem *H_v,
                              int zdrop,
                              int32_t w,
-                             uint16_t qlen[],
-                             uint16_t myband[]);
+                             typename V::uelem qlen[],
+                             typename V::uelem myband[]);
 #endif
 
     int64_t getTicks();
@@ -0,0 +1,428 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+/*
+ * bwa-mem2 bench: maps simulated reads and reports the throughput of each
+ * kernel, so that builds and machines can be compared without external data.
+ *
+ * Reads are drawn from the indexed reference with substitutions and short
+ * indels at the given rates; pairs get a normally distributed insert size.
+ * The reads are mapped as one chunk, once as a warm-up (which also fits the
+ * kernel buffers) and then -r times. The per-thread kernel timers of each
+ * run give the CPU time of SMEM, SAL, chaining, BSW, mate rescue and SAM
+ * formatting; the best run is reported as tab-separated values on stdout.
+ * With -c the threads are pinned in pairs to SMT siblings and the runs are
+ * repeated with seeding and extension overlapped on the pairs (mem
+ * --smt-cosched), reported as a second table after that of the phase
+ * barriers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+#include <assert.h>
+#include "fastmap.h"
+#include "affinity.h"
+#include "tune.h"
+
+#define BENCH_SMEM   0
+#define BENCH_SAL    1
+#define BENCH_CHAIN  2
+#define BENCH_BSW    3
+#define BENCH_MATESW 4
+#define BENCH_SAM    5
+#define BENCH_TOTAL  6      /* end to end, wall clock */
+#define BENCH_N      7
+
+static const char *bench_names[BENCH_N] = { "smem", "sal", "chain", "bsw", "mate_rescue",
+                                            "sam", "end_to_end" };
+
+typedef struct {
+    int len, n_pairs, pe;
+    double sub_rate, indel_rate;
+    double isize, isize_sd;
+    uint64_t seed;
+} bench_sim_t;
+
+static uint64_t sim_rand(uint64_t *s)     // splitmix64
+{
+    uint64_t z = (*s += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static double sim_unif(uint64_t *s)
+{
+    return (sim_rand(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double sim_normal(uint64_t *s)
+{
+    double u = sim_unif(s), v = sim_unif(s);
+    return sqrt(-2.0 * log(u > 0? u : 1e-300)) * cos(2 * M_PI * v);
+}
+
+/* Copies len bases of the fragment starting at frag[0] into a read, adding
+   errors; rev takes the fragment from its end on the opposite strand */
+static void sim_read(const uint8_t *frag, int l_frag, int len, int rev, const bench_sim_t *p,
+                     uint64_t *rng, char *out)
+{
+    static const char acgt[] = "ACGT";
+    int i = 0, k = 0;
+    while (i < len && k < l_frag) {
+        int b = rev? 3 - frag[l_frag - 1 - k] : frag[k];
+        double r = sim_unif(rng);
+        if (r < p->indel_rate / 2) {            // deletion from the read
+            k += 1 + (int) (sim_rand(rng) % 3);
+            continue;
+        }
+        if (r < p->indel_rate) {                // insertion into the read
+            int n = 1 + (int) (sim_rand(rng) % 3);
+            for (int j = 0; j < n && i < len; j++) out[i++] = acgt[sim_rand(rng) & 3];
+            continue;
+        }
+        if (r < p->indel_rate + p->sub_rate)
+            b = (b + 1 + (int) (sim_rand(rng) % 3)) & 3;
+        out[i++] = acgt[b];
+        k++;
+    }
+    while (i < len) out[i++] = acgt[sim_rand(rng) & 3];   // ran off the fragment
+    out[len] = 0;
+}
+
+static void sim_set(bseq1_t *s, int id, const char *name, const char *seq, int len)
+{
+    memset(s, 0, sizeof(bseq1_t));
+    s->id = id;
+    s->name = strdup(name);
+    s->seq = strdup(seq);
+    s->qual = (char *) malloc(len + 1);
+    memset(s->qual, 'I', len);
+    s->qual[len] = 0;
+    s->l_seq = len;
+}
+
+/* Reads of a pair are adjacent, as mem_process_seqs expects. Gives up after
+   SIM_MAX_DRAWS draws per pair; NULL if not a single pair could be placed. */
+#define SIM_MAX_DRAWS 100
+
+static bseq1_t *sim_reads(const bench_sim_t *p, const bntseq_t *bns, const uint8_t *ref,
+                          int *n_seqs)
+{
+    int n = p->pe? 2 * p->n_pairs : p->n_pairs;
+    bseq1_t *seqs = (bseq1_t *) calloc(n, sizeof(bseq1_t));
+    char *r1 = (char *) malloc(p->len + 1), *r2 = (char *) malloc(p->len + 1);
+    char name[64];
+    uint64_t rng = p->seed;
+    int64_t draws = 0, max_draws = (int64_t) SIM_MAX_DRAWS * p->n_pairs;
+    int i = 0;
+    assert(seqs != NULL && r1 != NULL && r2 != NULL);
+
+    for (; i < p->n_pairs && draws < max_draws; draws++) {
+        int l_frag = p->len;
+        if (p->pe) {
+            l_frag = (int) (p->isize + p->isize_sd * sim_normal(&rng) + .499);
+            if (l_frag < p->len) l_frag = p->len;
+        }
+        if (l_frag >= bns->l_pac) continue;
+        int64_t pos = sim_rand(&rng) % (bns->l_pac - l_frag);
+        if (bns_intv2rid(bns, pos, pos + l_frag) < 0) continue;   // spans two contigs
+        int j;
+        for (j = 0; j < l_frag && ref[pos + j] < 4; j++);
+        if (j < l_frag) continue;                                   // has Ns
+
+        int strand = sim_rand(&rng) & 1;
+        snprintf(name, sizeof(name), "sim_%d_%ld_%c", i, (long) pos + 1, "+-"[strand]);
+        sim_read(ref + pos, l_frag, p->len, strand, p, &rng, r1);
+        if (p->pe) {
+            sim_read(ref + pos, l_frag, p->len, !strand, p, &rng, r2);
+            sim_set(&seqs[2 * i], 2 * i, name, r1, p->len);
+            sim_set(&seqs[2 * i + 1], 2 * i + 1, name, r2, p->len);
+        }
+        else sim_set(&seqs[i], i, name, r1, p->len);
+        i++;
+    }
+    free(r1); free(r2);
+    *n_seqs = p->pe? 2 * i : i;
+    if (i == 0) {
+        fprintf(stderr, "[E::%s] no %s fits the reference without Ns or contig ends in %ld draws; "
+                "check the insert size and read length\n", __func__, p->pe? "fragment" : "read",
+                (long) draws);
+        free(seqs);
+        return NULL;
+    }
+    if (i < p->n_pairs)
+        fprintf(stderr, "[W::%s] only %d of %d %s placed in %ld draws; the insert size or read "
+                "length barely fits the reference\n", __func__, i, p->n_pairs,
+                p->pe? "pairs" : "reads", (long) draws);
+    return seqs;
+}
+
+/* FASTQ of the simulated reads: prefix.fq, or prefix_1.fq and prefix_2.fq */
+static int sim_write(const char *prefix, const bseq1_t *seqs, int n, int pe)
+{
+    char fn[PATH_MAX];
+    FILE *fp[2] = { NULL, NULL };
+    for (int k = 0; k < (pe? 2 : 1); k++) {
+        if (pe) snprintf(fn, PATH_MAX, "%s_%d.fq", prefix, k + 1);
+        else snprintf(fn, PATH_MAX, "%s.fq", prefix);
+        if ((fp[k] = fopen(fn, "w")) == NULL) {
+            fprintf(stderr, "[E::%s] can't create %s\n", __func__, fn);
+            if (k) fclose(fp[0]);
+            return 1;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        FILE *f = fp[pe? i & 1 : 0];
+        fprintf(f, "@%s\n%s\n+\n%s\n", seqs[i].name, seqs[i].seq, seqs[i].qual);
+    }
+    int ret = 0;
+    for (int k = 0; k < 2; k++)
+        if (fp[k] && fclose(fp[k]) != 0) ret = 1;
+    return ret;
+}
+
+static void bench_reset(int nthreads)
+{
+    memset(thprof, 0, nthreads * sizeof(thread_prof_t));
+}
+
+/* CPU seconds of each kernel over all threads, and wall seconds of the run */
+static void bench_times(int nthreads, double wall, double *t)
+{
+    uint64_t c[BENCH_N];
+    memset(c, 0, sizeof(c));
+    for (int i = 0; i < nthreads; i++) {
+        c[BENCH_SMEM] += TPROF(MEM_COLLECT, i);
+        c[BENCH_SAL] += TPROF(MEM_SA_BLOCK, i);
+        c[BENCH_CHAIN] += TPROF(WORKER_BWT, i) - TPROF(MEM_COLLECT, i) - TPROF(MEM_SA_BLOCK, i);
+        c[BENCH_BSW] += TPROF(WORKER_ALN, i);
+        c[BENCH_MATESW] += TPROF(SAM_MATESW, i);
+        c[BENCH_SAM] += TPROF(WORKER_SAM, i) - TPROF(SAM_MATESW, i);
+    }
+    for (int k = 0; k < BENCH_TOTAL; k++) t[k] = (double) c[k] / proc_freq;
+    t[BENCH_TOTAL] = wall;
+}
+
+/* Best of runs timed mappings of the reads, after a warm-up */
+static void bench_run(mem_opt_t *opt, worker_t &w, bseq1_t *seqs, int n_seqs, int runs,
+                      double *best)
+{
+    double t[BENCH_N];
+    for (int r = 0; r <= runs; r++) {
+        bench_reset(w.nthreads);
+        uint64_t tim = __rdtsc();
+        mem_process_seqs(opt, 0, n_seqs, seqs, NULL, w);
+        double wall = (double) (__rdtsc() - tim) / proc_freq;
+        for (int i = 0; i < n_seqs; i++) {
+            free(seqs[i].sam);
+            seqs[i].sam = NULL;
+        }
+        if (r == 0) {       // warm-up
+            memoryRefit(w, w.nthreads);
+            continue;
+        }
+        bench_times(w.nthreads, wall, t);
+        if (r == 1 || t[BENCH_TOTAL] < best[BENCH_TOTAL])
+            memcpy(best, t, BENCH_N * sizeof(double));
+    }
+}
+
+static void bench_print(const double *best, int nthreads, int n_seqs)
+{
+    printf("stage\tclock\tsec\tns_per_read\treads_per_sec\n");
+    for (int k = 0; k < BENCH_N; k++) {
+        // a cpu stage running alone on all threads would take sec / nthreads
+        double sec = best[k], eff = k == BENCH_TOTAL? sec : sec / nthreads;
+        printf("%s\t%s\t%0.4lf\t%0.1lf\t%0.0lf\n", bench_names[k], k == BENCH_TOTAL? "wall" : "cpu",
+               sec, sec * 1e9 / n_seqs, eff > 0? n_seqs / eff : 0.0);
+    }
+}
+
+static void usage_bench(const bench_sim_t *p)
+{
+    fprintf(stderr, "Usage: bwa-mem2 bench [options] <idxbase>\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "   -t INT        number of threads [1]\n");
+    fprintf(stderr, "   -n INT        number of reads (pairs with -I) [%d]\n", p->n_pairs);
+    fprintf(stderr, "   -l INT        read length [%d]\n", p->len);
+    fprintf(stderr, "   -e FLOAT      substitution rate [%g]\n", p->sub_rate);
+    fprintf(stderr, "   -i FLOAT      indel rate (1-3 bp each) [%g]\n", p->indel_rate);
+    fprintf(stderr, "   -I FLOAT[,FLOAT]\n");
+    fprintf(stderr, "                 paired-end reads with this insert size mean and standard deviation [%g,%g]\n",
+            p->isize, p->isize_sd);
+    fprintf(stderr, "   -S            single-end reads\n");
+    fprintf(stderr, "   -r INT        timed runs; the fastest is reported [3]\n");
+    fprintf(stderr, "   -s INT        random seed [%lu]\n", (unsigned long) p->seed);
+    fprintf(stderr, "   -w STR        write the reads to STR_1.fq and STR_2.fq (STR.fq if single-end)\n");
+    fprintf(stderr, "                 instead of mapping them\n");
+    fprintf(stderr, "   -c            compare the phase barriers with --smt-cosched, both on threads\n");
+    fprintf(stderr, "                 pinned in pairs to SMT siblings\n");
+    fprintf(stderr, "Output: tab-separated stage, clock (cpu: summed over threads; wall), seconds,\n");
+    fprintf(stderr, "        ns per read and reads per second (cpu stages: on all threads).\n");
+}
+
+int main_bench(int argc, char *argv[])
+{
+    bench_sim_t sim;
+    int c, nthreads = 1, runs = 3, compare = 0;
+    char *p, *wprefix = NULL;
+
+    sim.len = 150, sim.n_pairs = 50000, sim.pe = 1;
+    sim.sub_rate = 0.005, sim.indel_rate = 0.0005;
+    sim.isize = 500, sim.isize_sd = 50;
+    sim.seed = 11;
+
+    while ((c = getopt(argc, argv, "t:n:l:e:i:I:Sr:s:w:c")) >= 0) {
+        if (c == 't') nthreads = atoi(optarg);
+        else if (c == 'n') sim.n_pairs = atoi(optarg);
+        else if (c == 'l') sim.len = atoi(optarg);
+        else if (c == 'e') sim.sub_rate = atof(optarg);
+        else if (c == 'i') sim.indel_rate = atof(optarg);
+        else if (c == 'I') {
+            sim.pe = 1;
+            sim.isize = strtod(optarg, &p);
+            if (*p != 0 && ispunct(*p) && isdigit(p[1])) sim.isize_sd = strtod(p + 1, &p);
+        }
+        else if (c == 'S') sim.pe = 0;
+        else if (c == 'r') runs = atoi(optarg);
+        else if (c == 's') sim.seed = strtoul(optarg, 0, 10);
+        else if (c == 'w') wprefix = optarg;
+        else if (c == 'c') compare = 1;
+        else {
+            usage_bench(&sim);
+            return 1;
+        }
+    }
+    if (optind + 1 != argc || nthreads < 1 || runs < 1 || sim.n_pairs < 1 || sim.len < 32) {
+        usage_bench(&sim);
+        return 1;
+    }
+
+    /* Index and the 2-bit reference, as in mem */
+    FMI_search *fmi = new FMI_search(argv[optind]);
+    fmi->load_index();
+
+    char fn[PATH_MAX];
+    snprintf(fn, PATH_MAX, "%s.0123", argv[optind]);
+    FILE *fr = fopen(fn, "r");
+    if (fr == NULL) {
+        fprintf(stderr, "Error: can't open %s input file\n", fn);
+        delete fmi;
+        return 1;
+    }
+    fseek(fr, 0, SEEK_END);
+    int64_t rlen = ftell(fr);
+    rewind(fr);
+    uint8_t *ref_string = (uint8_t *) _mm_malloc(rlen, 64);
+    assert(ref_string != NULL);
+    err_fread_noeof(ref_string, 1, rlen, fr);
+    fclose(fr);
+
+    int n_seqs;
+    bseq1_t *seqs = sim_reads(&sim, fmi->idx->bns, ref_string, &n_seqs);
+    if (seqs == NULL) {
+        _mm_free(ref_string);
+        delete fmi;
+        return 1;
+    }
+    fprintf(stderr, "* Simulated %d %s reads of %d bp\n", n_seqs, sim.pe? "paired" : "single",
+            sim.len);
+    if (wprefix) {
+        int ret = sim_write(wprefix, seqs, n_seqs, sim.pe);
+        for (int i = 0; i < n_seqs; i++) {
+            free(seqs[i].name); free(seqs[i].seq); free(seqs[i].qual);
+        }
+        free(seqs);
+        _mm_free(ref_string);
+        delete fmi;
+        return ret;
+    }
+
+    mem_opt_t *opt = mem_opt_init();
+    opt->n_threads = nthreads;
+    if (sim.pe) opt->flag |= MEM_F_PE;
+    bwa_fill_scmat(opt->a, opt->b, opt->mat);
+
+    worker_t w;
+    memset(&w, 0, sizeof(worker_t));
+    w.nthreads = nthreads;
+    w.fmi = fmi;
+    w.ref_string = ref_string;
+
+    mem_plan_t plan;
+    msz_plan(&plan, n_seqs, (int64_t) n_seqs * sim.len, opt->w);
+    memoryAlloc(NULL, w, &plan, nthreads);
+    thprof_alloc(nthreads);
+    if (compare) {
+        cpu_topo_t topo;
+        if (cpu_topo_detect(&topo) == 0) {
+            if (topo.max_smt < 2)
+                fprintf(stderr, "[W::%s] no SMT siblings among the cpus; the pairs share an L3 "
+                        "domain instead\n", __func__);
+            w.thread_cpu = aff_place(&topo, AFF_SMT, nthreads);
+            cpu_topo_destroy(&topo);
+        }
+        else fprintf(stderr, "[W::%s] can't read the CPU topology; threads are not pinned\n", __func__);
+    }
+
+    double best[2][BENCH_N];
+    for (int k = 0; k <= compare; k++) {
+        w.cosched = k;
+        bench_run(opt, w, seqs, n_seqs, runs, best[k]);
+    }
+
+    printf("# bwa-mem2 bench: %s, %d threads, %d %s reads of %d bp, best of %d runs\n",
+           tune_isa(), nthreads, n_seqs, sim.pe? "paired" : "single", sim.len, runs);
+    for (int k = 0; k <= compare; k++) {
+        if (compare) printf("# %s\n", k? "seeding and extension overlapped on SMT pairs (--smt-cosched)"
+                            : "phase barriers");
+        bench_print(best[k], nthreads, n_seqs);
+    }
+    if (compare)
+        printf("# --smt-cosched: %0.4lf s against %0.4lf s wall, %0.2lfx\n", best[1][BENCH_TOTAL],
+               best[0][BENCH_TOTAL], best[0][BENCH_TOTAL] / best[1][BENCH_TOTAL]);
+
+    thprof_free();
+    free(w.thread_cpu);
+    memoryFree(w, nthreads);
+    for (int i = 0; i < n_seqs; i++) {
+        free(seqs[i].name); free(seqs[i].seq); free(seqs[i].qual);
+    }
+    free(seqs);
+    free(opt);
+    _mm_free(ref_string);
+    delete fmi;
+    return 0;
+}
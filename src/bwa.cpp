@@ -285,8 +285,8 @@ uint32_t *bwa_gen_cigar2(const int8_t mat[25], int o_del, int e_del, int o_ins,
             cigar[0] = l_query<<4 | 0;
             *n_cigar = 1;
         }
-        for (i = 0, *score = 0; i < l_query; ++i)
-            *score += mat[rseq[i]*5 + query[i]];
+        for (i = 0, *score = l_query * mat[0]; (i += ksw_first_diff(l_query - i, query + i, rseq + i)) < l_query; ++i)
+            *score += mat[rseq[i]*5 + query[i]] - mat[0]; // only mismatches differ from the match score
     } else {
         int w, max_gap, max_ins, max_del, min_w;
         // set the band-width
@@ -316,11 +316,12 @@ uint32_t *bwa_gen_cigar2(const int8_t mat[25], int o_del, int e_del, int o_ins,
             op  = cigar[k]&0xf, len = cigar[k]>>4;
             if (op == 0) { // match
                 for (i = 0; i < len; ++i) {
-                    if (query[x + i] != rseq[y + i]) {
-                        kputw(u, &str);
-                        kputc(int2base[rseq[y+i]], &str);
-                        ++n_mm; u = 0;
-                    } else ++u;
+                    int d = ksw_first_diff(len - i, &query[x + i], &rseq[y + i]); // skip the matching run
+                    u += d, i += d;
+                    if (i == len) break;
+                    kputw(u, &str);
+                    kputc(int2base[rseq[y+i]], &str);
+                    ++n_mm; u = 0;
                 }
                 x += len; y += len;
             } else if (op == 2) { // deletion
@@ -31,6 +31,11 @@ Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@i
 #include "bwamem.h"
 #include "FMI_search.h"
 #include "memcpy_bwamem.h"
+#include "memsize.h"
+#include "perfctr.h"
+#include "trace.h"
+#include "dedup.h"
+#include "tune.h"
 
 //----------------
 extern uint64_t tprof[LIM_R][LIM_C];
@@ -384,7 +389,7 @@ static int test_and_merge(const mem_opt_t *opt, int64_t l_pac, mem_chain_t *c,
                 if ((auxSeedBuf = (mem_seed_t *) calloc(c->m, sizeof(mem_seed_t))) == NULL) { fprintf(stderr, "ERROR: out of memory auxSeedBuf\n"); exit(1); }
                 memcpy_bwamem((char*) (auxSeedBuf), c->m * sizeof(mem_seed_t), c->seeds, c->n * sizeof(mem_seed_t), __FILE__, __LINE__);
                 c->seeds = auxSeedBuf;
-                tprof[PE13][tid]++;
+                TPROF(PE13, tid)++;
             } else {  // new memory
                 // fprintf(stderr, "[%0.4d] re-allocing old seed, m: %d\n", tid, c->m);
                 if ((auxSeedBuf = (mem_seed_t *) realloc(c->seeds, c->m * sizeof(mem_seed_t))) == NULL) { fprintf(stderr, "ERROR: out of memory auxSeedBuf\n"); exit(1); }
@@ -516,7 +521,7 @@ int mem_chain_flt(const mem_opt_t *opt, int n_chn_, mem_chain_t *a_, int tid)
         if (c->w < opt->min_chain_weight)
         {
             if (c->m > SEEDS_PER_CHAIN) {
-                tprof[PE11][tid] ++;
+                TPROF(PE11, tid) ++;
                 free(c->seeds);
             }
             //free(c->seeds);
@@ -608,7 +613,7 @@ int mem_chain_flt(const mem_opt_t *opt, int n_chn_, mem_chain_t *a_, int tid)
             if (c->kept == 0)
             {
                 if (c->m > SEEDS_PER_CHAIN) {
-                    tprof[PE11][tid] ++;
+                    TPROF(PE11, tid) ++;
                     free(c->seeds);
                 }
                 //free(c->seeds);
@@ -729,7 +734,8 @@ SMEM *mem_collect_smem(FMI_search *fmi, const mem_opt_t *opt,
 }
 
 /** NEW ONE **/
-void mem_chain_seeds(FMI_search *fmi, const mem_opt_t *opt,
+/* Returns the seed buffer slots the batch asked for, including overflow */
+int64_t mem_chain_seeds(FMI_search *fmi, const mem_opt_t *opt,
                      const bntseq_t *bns,
                      const bseq1_t *seq_,
                      int nseq,
@@ -749,7 +755,7 @@ void mem_chain_seeds(FMI_search *fmi, const mem_opt_t *opt,
     memset(num, 0, nseq*sizeof(int));
     int smem_buf_size = 6000;
     int64_t *sa_coord = (int64_t *) _mm_malloc(sizeof(int64_t) * opt->max_occ * smem_buf_size, 64);
-    int64_t seedBufCount = 0;
+    int64_t seedBufCount = 0, seedOverflow = 0;
     
     for (int l=0; l<nseq; l++)
         kv_init(chain_ar[l]);
@@ -795,13 +801,14 @@ void mem_chain_seeds(FMI_search *fmi, const mem_opt_t *opt,
             sa_coord = (int64_t *) _mm_realloc(sa_coord, csize, opt->max_occ * smem_buf_size,
                                                sizeof(int64_t));
             assert(sa_coord != NULL);
+            TPROF(N_REALLOC, tid)++;
         }
         int64_t id = 0, cnt_ = 0, mypos = 0;
         #if SA_COMPRESSION
         uint64_t tim = __rdtsc();
         fmi->get_sa_entries_prefetch(&matchArray[smem_ptr], sa_coord, &cnt_,
                                      pos - smem_ptr + 1, opt->max_occ, tid, id);  // sa compressed prefetch
-        tprof[MEM_SA][tid] += __rdtsc() - tim;
+        TPROF(MEM_SA, tid) += __rdtsc() - tim;
         #endif
         
         for (i = smem_ptr; i <= pos; i++)
@@ -816,7 +823,7 @@ void mem_chain_seeds(FMI_search *fmi, const mem_opt_t *opt,
             #if !SA_COMPRESSION
             uint64_t tim = __rdtsc();
             fmi->get_sa_entries(p, sa_coord, &cnt, 1, opt->max_occ);
-            tprof[MEM_SA][tid] += __rdtsc() - tim;
+            TPROF(MEM_SA, tid) += __rdtsc() - tim;
             #endif
             
             cnt = 0;            
@@ -861,7 +868,8 @@ void mem_chain_seeds(FMI_search *fmi, const mem_opt_t *opt,
                         tmp.m += 1;
                         tmp.seeds = (mem_seed_t *)calloc (tmp.m, sizeof(mem_seed_t));
                         assert(tmp.seeds != NULL);
-                        tprof[PE13][tid]++;
+                        seedOverflow += SEEDS_PER_CHAIN;
+                        TPROF(PE13, tid)++;
                     }
                     else {
                         tmp.seeds = seedBuf + seedBufCount;
@@ -894,9 +902,10 @@ void mem_chain_seeds(FMI_search *fmi, const mem_opt_t *opt,
         kb_destroy(chn, tree);      
         
     } // iterations over input reads
-    tprof[MEM_SA_BLOCK][tid] += __rdtsc() - tim;
+    TPROF(MEM_SA_BLOCK, tid) += __rdtsc() - tim;
 
     _mm_free(sa_coord);
+    return seedBufCount + seedOverflow;
 }
 
 int mem_kernel1_core(FMI_search *fmi,
@@ -925,32 +934,21 @@ int mem_kernel1_core(FMI_search *fmi,
             seq[i] = seq[i] < 4? seq[i] : nst_nt4_table[(int)seq[i]]; //nst_nt4??       
     }
     tot_len *= N_SMEM_KERNEL;
+    if (tot_len > mmc->thr[tid].hw_mem) mmc->thr[tid].hw_mem = tot_len;
     // This covers enc_qdb/SMEM reallocs
-    if (tot_len >= mmc->wsize_mem[tid])
+    if (tot_len >= mmc->thr[tid].wsize_mem)
     {
         fprintf(stderr, "[%0.4d] Re-allocating SMEM data structures due to enc_qdb\n", tid);
-        int64_t tmp = mmc->wsize_mem[tid];
-        mmc->wsize_mem[tid] = tot_len;
-        mmc->matchArray[tid]   = (SMEM *) _mm_realloc(mmc->matchArray[tid],
-                                                      tmp, mmc->wsize_mem[tid], sizeof(SMEM));
-            //realloc(mmc->matchArray[tid], mmc->wsize_mem[tid] *   sizeof(SMEM));
-        mmc->min_intv_ar[tid]  = (int32_t *) realloc(mmc->min_intv_ar[tid],
-                                                     mmc->wsize_mem[tid] *  sizeof(int32_t));
-        mmc->query_pos_ar[tid] = (int16_t *) realloc(mmc->query_pos_ar[tid],
-                                                     mmc->wsize_mem[tid] *  sizeof(int16_t));
-        mmc->enc_qdb[tid]      = (uint8_t *) realloc(mmc->enc_qdb[tid],
-                                                      mmc->wsize_mem[tid] * sizeof(uint8_t));
-        mmc->rid[tid]          = (int32_t *) realloc(mmc->rid[tid],
-                                                      mmc->wsize_mem[tid] * sizeof(int32_t));
-        // w.mmc.lim[l]        = (int32_t *) _mm_malloc((BATCH_SIZE + 32) * sizeof(int32_t), 64);
-    }
-
-    SMEM    *matchArray   = mmc->matchArray[tid];
-    int32_t *min_intv_ar  = mmc->min_intv_ar[tid];
-    int16_t *query_pos_ar = mmc->query_pos_ar[tid];
-    uint8_t *enc_qdb      = mmc->enc_qdb[tid];
-    int32_t *rid          = mmc->rid[tid];
-    int64_t  *wsize_mem   = &mmc->wsize_mem[tid];
+        int64_t n = mmc->thr[tid].wsize_mem * 2;
+        mem_resize_smem(mmc, tid, n > tot_len? n : tot_len + 1);
+    }
+
+    SMEM    *matchArray   = mmc->thr[tid].matchArray;
+    int32_t *min_intv_ar  = mmc->thr[tid].min_intv_ar;
+    int16_t *query_pos_ar = mmc->thr[tid].query_pos_ar;
+    uint8_t *enc_qdb      = mmc->thr[tid].enc_qdb;
+    int32_t *rid          = mmc->thr[tid].rid;
+    int64_t  *wsize_mem   = &mmc->thr[tid].wsize_mem;
     
     tim = __rdtsc();    
     /********************** Kernel 1: FM+SMEMs *************************/
@@ -970,21 +968,24 @@ int mem_kernel1_core(FMI_search *fmi,
         exit(EXIT_FAILURE);
     }
     printf_(VER, "6. Done! mem_collect_smem, num_smem: %ld\n", num_smem);
-    tprof[MEM_COLLECT][tid] += __rdtsc() - tim; 
+    TPROF(MEM_COLLECT, tid) += __rdtsc() - tim; 
 
 
     /********************* Kernel 1.1: SA2REF **********************/
     printf_(VER, "6.1. Calling mem_chain..\n");
-    mem_chain_seeds(fmi, opt, fmi->idx->bns,
-                    seq_, nseq, tid,
-                    chain_ar,
-                    seedBuf,
-                    seedBufSize,
-                    matchArray,
-                    num_smem);
+    int64_t n_seeds = mem_chain_seeds(fmi, opt, fmi->idx->bns,
+                                      seq_, nseq, tid,
+                                      chain_ar,
+                                      seedBuf,
+                                      seedBufSize,
+                                      matchArray,
+                                      num_smem);
+    TPROF(N_SEEDS, tid) += n_seeds;
+    n_seeds = (n_seeds + nseq - 1) / nseq;
+    if (n_seeds > mmc->thr[tid].hw_seeds) mmc->thr[tid].hw_seeds = n_seeds;
     
     printf_(VER, "5. Done mem_chain..\n");
-    // tprof[MEM_CHAIN][tid] += __rdtsc() - tim;
+    // TPROF(MEM_CHAIN, tid) += __rdtsc() - tim;
 
     /************** Post-processing of collected smems/chains ************/
     // tim = __rdtsc();
@@ -995,7 +996,7 @@ int mem_kernel1_core(FMI_search *fmi,
         chn->n = mem_chain_flt(opt, chn->n, chn->a, tid);
     }
     printf_(VER, "7. Done mem_chain_flt..\n");
-    // tprof[MEM_ALN_M1][tid] += __rdtsc() - tim;
+    // TPROF(MEM_ALN_M1, tid) += __rdtsc() - tim;
 
     
     printf_(VER, "8. Calling mem_flt_chained_seeds..\n");
@@ -1004,7 +1005,7 @@ int mem_kernel1_core(FMI_search *fmi,
         mem_flt_chained_seeds(opt, fmi->idx->bns, fmi->idx->pac, seq_, chn->n, chn->a);
     }
     printf_(VER, "8. Done mem_flt_chained_seeds..\n");
-    // tprof[MEM_ALN_M2][tid] += __rdtsc() - tim;
+    // TPROF(MEM_ALN_M2, tid) += __rdtsc() - tim;
 
 
     return 1;
@@ -1040,7 +1041,7 @@ int mem_kernel2_core(FMI_search *fmi,
                                   tid);
 
     printf_(VER, "9. Done mem_chain2aln...\n\n");
-    tprof[MEM_ALN2][tid] += __rdtsc() - tim;
+    TPROF(MEM_ALN2, tid) += __rdtsc() - tim;
 
     // tim = __rdtsc();
     for (int l=0; l<nseq; l++) {
@@ -1050,10 +1051,10 @@ int mem_kernel2_core(FMI_search *fmi,
             mem_chain_t chn = chain->a[i];
             if (chn.m > SEEDS_PER_CHAIN)
             {
-                tprof[PE11][tid] ++;
+                TPROF(PE11, tid) ++;
                 free(chn.seeds);
             }
-            tprof[PE12][tid]++;
+            TPROF(PE12, tid)++;
         }
         free(chain_ar[l].a);
     }
@@ -1087,7 +1088,7 @@ int mem_kernel2_core(FMI_search *fmi,
                 p->is_alt = 1;
         }
     }
-    // tprof[POST_SWA][tid] += __rdtsc() - tim;
+    // TPROF(POST_SWA, tid) += __rdtsc() - tim;
     
     return 1;
 }
@@ -1095,18 +1096,38 @@ int mem_kernel2_core(FMI_search *fmi,
 static void worker_aln(void *data, int seq_id, int batch_size, int tid)
 {
     worker_t *w = (worker_t*) data;
+    FMI_search *fmi = w->fmi;
+    uint8_t *ref_string = w->ref_string;
+    pc_sample_t pcs;
+    pc_begin(&pcs);
+    uint64_t tim = __rdtsc(), tr = tr_now();
+#if NUMA_ENABLED
+    int node = 0;
+    if (w->n_nodes > 0) {
+        node = w->tid_node[tid];
+        fmi = w->node_fmi[node];
+        ref_string = w->node_ref[node];
+    }
+#endif
     
     printf_(VER, "11. Calling mem_kernel2_core..\n");   
-    mem_kernel2_core(w->fmi, w->opt, 
+    mem_kernel2_core(fmi, w->opt, 
                      w->seqs + seq_id,
                      w->regs + seq_id,
                      batch_size,
                      w->chain_ar + seq_id,
                      &w->mmc,
-                     w->ref_string,
+                     ref_string,
                      tid);
     printf_(VER, "11. Done mem_kernel2_core....\n");
-
+    tim = __rdtsc() - tim;
+    TPROF(WORKER_ALN, tid) += tim;
+    pc_end(&pcs, PC_ALN, tid);
+    tr_span(tid, TR_ALN, tr, seq_id, batch_size);
+#if NUMA_ENABLED
+    if (w->n_nodes > 0)
+        __sync_fetch_and_add(&tprof[NUMA_TIME][node], tim);
+#endif
 }
 
 /* Kernel, called by threads */
@@ -1114,31 +1135,54 @@ static void worker_bwt(void *data, int seq_id, int batch_size, int tid)
 {
     worker_t *w = (worker_t*) data;
     printf_(VER, "4. Calling mem_kernel1_core..%d %d\n", seq_id, tid);
-    int seedBufSz = w->seedBufSize;
+    int64_t seedBufSz = (int64_t) batch_size * w->seeds_per_read;
 
     int memSize = w->nreads; 
-    if (batch_size < BATCH_SIZE) {
-        seedBufSz = (memSize - seq_id) * AVG_SEEDS_PER_READ;
+    if (batch_size < w->grain) {    // the last unit may use the rest of the buffer
+        seedBufSz = (memSize - seq_id) * w->seeds_per_read;
         // fprintf(stderr, "[%0.4d] Info: adjusted seedBufSz %d\n", tid, seedBufSz);
     }
 
-    mem_kernel1_core(w->fmi, w->opt,
+    FMI_search *fmi = w->fmi;
+    pc_sample_t pcs;
+    pc_begin(&pcs);
+    uint64_t tim = __rdtsc(), tr = tr_now();
+#if NUMA_ENABLED
+    int node = 0;
+    if (w->n_nodes > 0) {
+        node = w->tid_node[tid];
+        fmi = w->node_fmi[node];
+    }
+#endif
+
+    mem_kernel1_core(fmi, w->opt,
                      w->seqs + seq_id,
                      batch_size,
                      w->chain_ar + seq_id,
-                     w->seedBuf + seq_id * AVG_SEEDS_PER_READ,
+                     w->seedBuf + (int64_t) seq_id * w->seeds_per_read,
                      seedBufSz,
                      &(w->mmc),
                      tid);
     printf_(VER, "4. Done mem_kernel1_core....\n");
+    tim = __rdtsc() - tim;
+    TPROF(WORKER_BWT, tid) += tim;
+    TPROF(N_READS, tid) += batch_size;
+    pc_end(&pcs, PC_BWT, tid);
+    tr_span(tid, TR_BWT, tr, seq_id, batch_size);
+#if NUMA_ENABLED
+    if (w->n_nodes > 0) {
+        __sync_fetch_and_add(&tprof[NUMA_READS][node], (uint64_t) batch_size);
+        __sync_fetch_and_add(&tprof[NUMA_TIME][node], tim);
+    }
+#endif
 }
 
 int64_t sort_classify(mem_cache *mmc, int64_t pcnt, int tid)
 {
 
-    SeqPair *seqPairArray = mmc->seqPairArrayLeft128[tid];
-    // SeqPair *seqPairArrayAux = mmc->seqPairArrayAux[tid];
-    SeqPair *seqPairArrayAux = mmc->seqPairArrayRight128[tid];
+    SeqPair *seqPairArray = mmc->thr[tid].seqPairArrayLeft128;
+    // SeqPair *seqPairArrayAux = mmc->thr[tid].seqPairArrayAux;
+    SeqPair *seqPairArrayAux = mmc->thr[tid].seqPairArrayRight128;
 
     int64_t pos8 = 0, pos16 = 0;
     for (int i=0; i<pcnt; i++)
@@ -1162,9 +1206,16 @@ int64_t sort_classify(mem_cache *mmc, int64_t pcnt, int tid)
     return pos8;
 }
 
+/* Worker whose reads this thread is formatting, if it collects the records */
+static __thread const worker_t *aln_sink;
+
 static void worker_sam(void *data, int seqid, int batch_size, int tid)
 {
     worker_t *w = (worker_t*) data;
+    pc_sample_t pcs;
+    pc_begin(&pcs);
+    aln_sink = w->alnv? w : NULL;
+    uint64_t tim_sam = __rdtsc(), tr = tr_now();
     
     if (w->opt->flag & MEM_F_PE)
     {
@@ -1181,14 +1232,14 @@ static void worker_sam(void *data, int seqid, int batch_size, int tid)
                        w->fmi->idx->pac, w->pes,
                        (w->n_processed >> 1) + pos++,   // check!
                        &w->seqs[i],
-                       &w->regs[i]);
+                       &w->regs[i], tid);
             
             free(w->regs[i].a);
             free(w->regs[i+1].a);
         }
 #else   // re-structured
         // pre-processing
-        // uint64_t tim = __rdtsc();
+        uint64_t tim = __rdtsc();
         int32_t maxRefLen = 0, maxQerLen = 0;
         int32_t gcnt = 0;
         for (int i=start; i< end; i+=2)
@@ -1205,7 +1256,7 @@ static void worker_sam(void *data, int seqid, int batch_size, int tid)
                                  tid);
         }
         
-        // tprof[SAM1][tid] += __rdtsc() - tim;
+        // TPROF(SAM1, tid) += __rdtsc() - tim;
         int64_t pcnt8 = sort_classify(&w->mmc, pcnt, tid);
 
         kswr_t *aln = (kswr_t *) _mm_malloc ((pcnt + SIMD_WIDTH8) * sizeof(kswr_t), 64);
@@ -1213,6 +1264,7 @@ static void worker_sam(void *data, int seqid, int batch_size, int tid)
 
         // processing
         mem_sam_pe_batch(w->opt, &w->mmc, pcnt, pcnt8, aln, maxRefLen, maxQerLen, tid);     
+        TPROF(SAM_MATESW, tid) += __rdtsc() - tim;
 
         // post-processing
         // tim = __rdtsc();
@@ -1234,7 +1286,7 @@ static void worker_sam(void *data, int seqid, int batch_size, int tid)
             free(w->regs[i].a);
             free(w->regs[i+1].a);
         }
-        //tprof[SAM3][tid] += __rdtsc() - tim;      
+        //TPROF(SAM3, tid) += __rdtsc() - tim;      
         _mm_free(aln);  // kswr_t
 #endif
     }
@@ -1253,6 +1305,10 @@ static void worker_sam(void *data, int seqid, int batch_size, int tid)
             free(w->regs[i].a);
         }
     }
+    aln_sink = NULL;
+    TPROF(WORKER_SAM, tid) += __rdtsc() - tim_sam;
+    pc_end(&pcs, PC_SAM, tid);
+    tr_span(tid, TR_SAM, tr, seqid, batch_size);
 }
 
 void mem_process_seqs(mem_opt_t *opt,
@@ -1272,17 +1328,44 @@ void mem_process_seqs(mem_opt_t *opt,
 
     //int n_ = (opt->flag & MEM_F_PE) ? n : n;   // this requires n%2==0
     int n_ = n;
+    int pe = !!(opt->flag & MEM_F_PE);
+    int dedup = w.dedup != NULL && (!pe || n % 2 == 0);
+    if (dedup) // only the first of identical reads (pairs) is seeded and extended
+        n_ = mem_dedup_collapse(w.dedup, n, seqs, pe, &w.seqs);
     
     uint64_t tim = __rdtsc();   
     fprintf(stderr, "[0000] 1. Calling kt_for - worker_bwt\n");
     
-    kt_for(worker_bwt, &w, n_); // SMEMs (+SAL)
+    uint64_t tr = tr_now();
+    if (w.cosched) {
+        kt_for_pair(worker_bwt, worker_aln, &w, n_); // SMEMs (+SAL) and BSW, overlapped
+        tr_span(TR_SELF, TR_KT_PAIR, tr, n_, 0);
+    }
+    else {
+        kt_for(worker_bwt, &w, n_); // SMEMs (+SAL)
+        tr_span(TR_SELF, TR_KT_BWT, tr, n_, 0);
 
-    fprintf(stderr, "[0000] 2. Calling kt_for - worker_aln\n");
-    
-    kt_for(worker_aln, &w, n_); // BSW
+        fprintf(stderr, "[0000] 2. Calling kt_for - worker_aln\n");
+
+        tr = tr_now();
+        kt_for(worker_aln, &w, n_); // BSW
+        tr_span(TR_SELF, TR_KT_ALN, tr, n_, 0);
+    }
     tprof[WORKER10][0] += __rdtsc() - tim;      
 
+    if (dedup) {
+        int64_t n_look, n_hit, n_xhit;
+        mem_dedup_expand(w.dedup, w.regs);
+        w.seqs = seqs;
+        n_ = n;
+        mem_dedup_counts(w.dedup, &n_look, &n_hit, &n_xhit);
+        tprof[DEDUP_READS][0] += n_look;
+        tprof[DEDUP_HITS][0] += n_hit;
+        tprof[DEDUP_XHITS][0] += n_xhit;
+        fprintf(stderr, "\t[0000][ M::%s] Duplicate cache: %ld of %ld reads reused "
+                "(%ld from earlier batches)\n", __func__, (long)n_hit, (long)n_look, (long)n_xhit);
+    }
+
 
     // PAIRED_END
     if (opt->flag & MEM_F_PE) { // infer insert sizes if not provided
@@ -1297,12 +1380,24 @@ void mem_process_seqs(mem_opt_t *opt,
         }
     }
     
+    int64_t n_win = 0, n_flt = 0; // mate-rescue SW windows of this chunk
+    for (int i = 0; i < opt->n_threads; i++)
+        n_win -= TPROF(MATESW_WIN, i), n_flt -= TPROF(MATESW_FLT, i);
+    
     tim = __rdtsc();
     fprintf(stderr, "[0000] 3. Calling kt_for - worker_sam\n");
     
+    tr = tr_now();
     kt_for(worker_sam, &w,  n_);   // SAM   
+    tr_span(TR_SELF, TR_KT_SAM, tr, n_, 0);
     tprof[WORKER20][0] += __rdtsc() - tim;
 
+    for (int i = 0; i < opt->n_threads; i++)
+        n_win += TPROF(MATESW_WIN, i), n_flt += TPROF(MATESW_FLT, i);
+    if (n_win > 0)
+        fprintf(stderr, "\t[0000][ M::%s] Mate rescue: %ld of %ld SW windows skipped "
+                "by the prefilter\n", __func__, (long)n_flt, (long)n_win);
+
     fprintf(stderr, "\t[0000][ M::%s] Processed %d reads in %.3f "
             "CPU sec, %.3f real sec\n",
             __func__, n, cputime() - ctime, realtime() - rtime);
@@ -1438,6 +1533,54 @@ void mem_reorder_primary5(int T, mem_alnreg_v *a)
 }
 
 // TODO (future plan): group hits into a uint64_t[] array. This will be cleaner and more flexible
+/************************
+ * Kernel input dumps   *
+ ************************/
+
+FILE *mem_kdump = NULL;
+static pthread_mutex_t kdump_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void mem_kdump_pairs(const mem_opt_t *opt, int kind, int arg, int end_bonus,
+                     const SeqPair *p, int n, const uint8_t *ref, const uint8_t *qer)
+{
+    if (n == 0) return;
+    int32_t hdr[KD_PAIR_HDR] = { kind, arg, end_bonus, n, 0, 0, opt->o_del, opt->e_del,
+                                 opt->o_ins, opt->e_ins, opt->a, opt->b, opt->zdrop };
+    SeqPair *q = (SeqPair *) malloc((n + 1) * sizeof(SeqPair));
+    assert(q != NULL);
+    for (int i = 0; i < n; i++) {   // sequences are packed in pair order
+        q[i] = p[i];
+        q[i].idr = hdr[4], hdr[4] += p[i].len1;
+        q[i].idq = hdr[5], hdr[5] += p[i].len2;
+    }
+    pthread_mutex_lock(&kdump_lock);
+    fwrite(hdr, sizeof(int32_t), KD_PAIR_HDR, mem_kdump);
+    fwrite(q, sizeof(SeqPair), n, mem_kdump);
+    for (int i = 0; i < n; i++) fwrite(ref + p[i].idr, 1, p[i].len1, mem_kdump);
+    for (int i = 0; i < n; i++) fwrite(qer + p[i].idq, 1, p[i].len2, mem_kdump);
+    pthread_mutex_unlock(&kdump_lock);
+    free(q);
+}
+
+void mem_kdump_aln(const bseq1_t *s, int n, const mem_aln_t *list)
+{
+    int32_t l_name = strlen(s->name);
+    int32_t hdr[5] = { KD_SAM, n, s->l_seq, l_name, s->qual != NULL };
+    pthread_mutex_lock(&kdump_lock);
+    fwrite(hdr, sizeof(int32_t), 5, mem_kdump);
+    fwrite(s->name, 1, l_name, mem_kdump);
+    fwrite(s->seq, 1, s->l_seq, mem_kdump);
+    if (s->qual) fwrite(s->qual, 1, s->l_seq, mem_kdump);
+    for (int k = 0; k < n; k++) {
+        int32_t l_XA = list[k].XA? strlen(list[k].XA) : -1;
+        fwrite(&list[k], sizeof(mem_aln_t), 1, mem_kdump);
+        fwrite(list[k].cigar, sizeof(uint32_t), list[k].n_cigar, mem_kdump);
+        fwrite(&l_XA, sizeof(int32_t), 1, mem_kdump);
+        if (l_XA > 0) fwrite(list[k].XA, 1, l_XA, mem_kdump);
+    }
+    pthread_mutex_unlock(&kdump_lock);
+}
+
 void mem_reg2sam(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac,
                  bseq1_t *s, mem_alnreg_v *a, int extra_flag, const mem_aln_t *m)
 {
@@ -1482,8 +1625,10 @@ void mem_reg2sam(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac,
         mem_aln_t t;
         t = mem_reg2aln(opt, bns, pac, s->l_seq, s->seq, 0);
         t.flag |= extra_flag;
+        if (mem_kdump) mem_kdump_aln(s, 1, &t);
         mem_aln2sam(opt, bns, &str, s, 1, &t, 0, m);        
     } else {
+        if (mem_kdump) mem_kdump_aln(s, aa.n, aa.a);
         for (k = 0; k < aa.n; ++k)
             mem_aln2sam(opt, bns, &str, s, aa.n, aa.a, k, m);
         for (k = 0; k < aa.n; ++k) free(aa.a[k].cigar);
@@ -1509,6 +1654,18 @@ static inline void add_cigar(const mem_opt_t *opt, mem_aln_t *p, kstring_t *str,
     } else kputc('*', str); // having a coordinate but unaligned (e.g. when copy_mate is true)
 }
 
+/* Copy of a record as written, with its own CIGAR and XA */
+static void mem_aln_keep(mem_aln_v *v, const mem_aln_t *p)
+{
+    mem_aln_t *q = kv_pushp(mem_aln_t, *v);
+    *q = *p;
+    q->flag = (p->flag & 0xffff) | (p->flag & 0x10000? 0x100 : 0);
+    q->cigar = (uint32_t *) malloc((p->n_cigar + 1) * sizeof(uint32_t));
+    assert(q->cigar != NULL);
+    if (p->n_cigar) memcpy(q->cigar, p->cigar, p->n_cigar * sizeof(uint32_t));
+    q->XA = p->XA? strdup(p->XA) : NULL;
+}
+
 void mem_aln2sam(const mem_opt_t *opt, const bntseq_t *bns, kstring_t *str,
                  bseq1_t *s, int n, const mem_aln_t *list, int which, const mem_aln_t *m_)
 {   
@@ -1526,6 +1683,7 @@ void mem_aln2sam(const mem_opt_t *opt, const bntseq_t *bns, kstring_t *str,
         m->rid = p->rid, m->pos = p->pos, m->is_rev = p->is_rev, m->n_cigar = 0;
     p->flag |= p->is_rev? 0x10 : 0; // is on the reverse strand
     p->flag |= m && m->is_rev? 0x20 : 0; // is mate on the reverse strand
+    if (aln_sink) mem_aln_keep(&aln_sink->alnv[s - aln_sink->seqs], p);
 
     // print up to CIGAR
     l_name = strlen(s->name);
@@ -1610,7 +1768,7 @@ void mem_aln2sam(const mem_opt_t *opt, const bntseq_t *bns, kstring_t *str,
 #endif  
     if (p->score >= 0) { kputsn("\tAS:i:", 6, str); kputw(p->score, str); }
     if (p->sub >= 0) { kputsn("\tXS:i:", 6, str); kputw(p->sub, str); }
-    if (bwa_rg_id[0]) { kputsn("\tRG:Z:", 6, str); kputs(bwa_rg_id, str); }
+    if (opt->rg_id && opt->rg_id[0]) { kputsn("\tRG:Z:", 6, str); kputs(opt->rg_id, str); }
     if (!(p->flag & 0x100)) { // not multi-hit
         for (i = 0; i < n; ++i)
             if (i != which && !(list[i].flag&0x100)) break;
@@ -1765,6 +1923,70 @@ void* _mm_realloc(void *ptr, int64_t csize, int64_t nsize, int16_t dsize) {
     return nptr;
 }
 
+static uint8_t *seqbuf_resize(uint8_t *ptr, int64_t csize, int64_t nsize)
+{
+    uint8_t *nptr = (uint8_t *) _mm_malloc(nsize + MAX_LINE_LEN, 64);
+    assert(nptr != NULL);
+    memcpy(nptr, ptr, csize < nsize? csize : nsize);
+    _mm_free(ptr);
+    return nptr;
+}
+
+void mem_resize_pairs(mem_cache *mmc, int tid, int64_t n)
+{
+    mem_thread_cache *c = &mmc->thr[tid];
+    int64_t bytes = (n + MAX_LINE_LEN) * sizeof(SeqPair);
+    c->seqPairArrayAux      = (SeqPair *) realloc(c->seqPairArrayAux, bytes);
+    c->seqPairArrayLeft128  = (SeqPair *) realloc(c->seqPairArrayLeft128, bytes);
+    c->seqPairArrayRight128 = (SeqPair *) realloc(c->seqPairArrayRight128, bytes);
+    assert(c->seqPairArrayAux != NULL);
+    assert(c->seqPairArrayLeft128 != NULL);
+    assert(c->seqPairArrayRight128 != NULL);
+    msz_add(MSZ_BSW, (n - c->wsize) * sizeof(SeqPair) * 3);
+    c->wsize = n;
+    TPROF(N_REALLOC, tid)++;
+    tr_instant(tid, TR_REALLOC_PAIRS, n, 0);
+}
+
+void mem_resize_seqbuf(mem_cache *mmc, int tid, int64_t n_ref, int64_t n_qer)
+{
+    mem_thread_cache *c = &mmc->thr[tid];
+    if (n_ref != c->wsize_buf_ref) {
+        c->seqBufLeftRef  = seqbuf_resize(c->seqBufLeftRef, c->wsize_buf_ref, n_ref);
+        c->seqBufRightRef = seqbuf_resize(c->seqBufRightRef, c->wsize_buf_ref, n_ref);
+        msz_add(MSZ_BSW, (n_ref - c->wsize_buf_ref) * 2);
+        c->wsize_buf_ref = n_ref;
+    }
+    if (n_qer != c->wsize_buf_qer) {
+        c->seqBufLeftQer  = seqbuf_resize(c->seqBufLeftQer, c->wsize_buf_qer, n_qer);
+        c->seqBufRightQer = seqbuf_resize(c->seqBufRightQer, c->wsize_buf_qer, n_qer);
+        msz_add(MSZ_BSW, (n_qer - c->wsize_buf_qer) * 2);
+        c->wsize_buf_qer = n_qer;
+    }
+    TPROF(N_REALLOC, tid)++;
+    tr_instant(tid, TR_REALLOC_SEQBUF, n_ref, n_qer);
+}
+
+/* Only called before the SMEM kernel fills the buffers; contents are dropped */
+void mem_resize_smem(mem_cache *mmc, int tid, int64_t n)
+{
+    mem_thread_cache *c = &mmc->thr[tid];
+    _mm_free(c->matchArray);
+    free(c->min_intv_ar); free(c->query_pos_ar); free(c->enc_qdb); free(c->rid);
+    c->matchArray   = (SMEM *) _mm_malloc(n * sizeof(SMEM), 64);
+    c->min_intv_ar  = (int32_t *) malloc(n * sizeof(int32_t));
+    c->query_pos_ar = (int16_t *) malloc(n * sizeof(int16_t));
+    c->enc_qdb      = (uint8_t *) malloc(n * sizeof(uint8_t));
+    c->rid          = (int32_t *) malloc(n * sizeof(int32_t));
+    assert(c->matchArray != NULL && c->min_intv_ar != NULL && c->query_pos_ar != NULL);
+    assert(c->enc_qdb != NULL && c->rid != NULL);
+    msz_add(MSZ_SMEM, (n - c->wsize_mem) *
+            (sizeof(SMEM) + 2 * sizeof(int32_t) + sizeof(int16_t) + sizeof(uint8_t)));
+    c->wsize_mem = n;
+    TPROF(N_REALLOC, tid)++;
+    tr_instant(tid, TR_REALLOC_SMEM, n, 0);
+}
+
 // NOTE: shift these new version of functions from bntseq.cpp to bntseq.cpp,
 // once they are incorporated in the code.
 
@@ -1847,7 +2069,7 @@ inline void sortPairsLenExt(SeqPair *pairArray, int32_t count, SeqPair *tempArra
                             int32_t *hist, int &numPairs128, int &numPairs16,
                             int &numPairs1, int score_a)
 {
-    int32_t i;
+    int32_t i, len8 = mem_tune.len8;
     numPairs128 = numPairs16 = numPairs1 = 0;
 
     int32_t *hist2 = hist + MAX_SEQ_LEN8;
@@ -1865,7 +2087,7 @@ inline void sortPairsLenExt(SeqPair *pairArray, int32_t count, SeqPair *tempArra
         SeqPair sp = pairArray[i];
         // int minval = sp.h0 + max_(sp.len1, sp.len2);
         int minval = sp.h0 + min_(sp.len1, sp.len2) * score_a;
-        if (sp.len1 < MAX_SEQ_LEN8 && sp.len2 < MAX_SEQ_LEN8 && minval < MAX_SEQ_LEN8) 
+        if (sp.len1 < len8 && sp.len2 < len8 && minval < len8) 
             hist[minval]++;
         else if(sp.len1 < MAX_SEQ_LEN16 && sp.len2 < MAX_SEQ_LEN16 && minval < MAX_SEQ_LEN16)
             hist2[minval] ++;
@@ -1896,7 +2118,7 @@ inline void sortPairsLenExt(SeqPair *pairArray, int32_t count, SeqPair *tempArra
         // int minval = sp.h0 + max_(sp.len1, sp.len2);
         int minval = sp.h0 + min_(sp.len1, sp.len2) * score_a;
         
-        if (sp.len1 < MAX_SEQ_LEN8 && sp.len2 < MAX_SEQ_LEN8 && minval < MAX_SEQ_LEN8) 
+        if (sp.len1 < len8 && sp.len2 < len8 && minval < len8) 
         {
             int32_t pos = hist[minval];
             tempArray[pos] = sp;
@@ -1983,6 +2205,67 @@ inline void sortPairsLen(SeqPair *pairArray, int32_t count, SeqPair *tempArray,
     }
 }
 
+/*** Gapless extension fast path ***/
+/* An extension lying on the seed diagonal with few mismatches cannot be beaten
+   by a gapped path: a gap costs at least min(o_del+e_del, o_ins+e_ins) while
+   every mismatch it could avoid is worth only a+b. For such extensions the
+   banded DP result follows directly from the mismatch positions. The scores
+   follow ksw_extend2(), which the vector BSW only matches for a unit match
+   score and the same ins/del penalties; the fast path is off otherwise. */
+#define MAX_GAPLESS_MM 4
+
+static inline int mem_gapless_max_mm(const mem_opt_t *opt)
+{
+    int k, oe = min_(opt->o_del + opt->e_del, opt->o_ins + opt->e_ins);
+    if (opt->a != 1 || opt->o_del != opt->o_ins || opt->e_del != opt->e_ins) return 0;
+    for (k = 0; k < MAX_GAPLESS_MM; k++) {
+        if ((k + 1) * (opt->a + opt->b) >= oe) break;
+        if (opt->zdrop > 0 && (k + 1) * opt->b >= opt->zdrop) break; // must not trigger Z-drop
+    }
+    return k;
+}
+
+/* Mismatch positions, in extension order, of query[0,qlen) against the target on the
+   seed diagonal; -1 if there are more than max_mm of them, an ambiguous base or a
+   target shorter than the query. Left extensions run backwards from the seed. */
+static int mem_gapless_scan(int max_mm, int qlen, const uint8_t *query, int64_t tlen,
+                            const uint8_t *target, int is_left, int *mm)
+{
+    int i, n = 0;
+    if (tlen < qlen) return -1;
+    if (is_left) target += tlen - qlen;
+    for (i = 0; (i += ksw_first_diff(qlen - i, query + i, target + i)) < qlen; ++i) {
+        if (n == max_mm || query[i] > 3) return -1;
+        mm[n++] = i;
+    }
+    if (is_left) {
+        for (i = 0; i < n>>1; i++) {
+            int t = mm[i]; mm[i] = mm[n-1-i]; mm[n-1-i] = t;
+        }
+        for (i = 0; i < n; i++) mm[i] = qlen - 1 - mm[i];
+    }
+    return n;
+}
+
+/* Same outputs as BandedPairWiseSW/ksw_extend2() for a diagonal extension:
+   the first position of the best score, and the end-to-end score. */
+static void mem_gapless_score(const mem_opt_t *opt, int h0, int qlen, int n_mm,
+                              const int *mm, SeqPair *sp)
+{
+    int k, sc = h0, max = h0, max_e = 0;
+    for (k = 0; k <= n_mm; k++) {
+        int e = k < n_mm? mm[k] : qlen; // end of the k-th exact run
+        sc += (e - (k? mm[k-1] + 1 : 0)) * opt->a;
+        if (sc > max) max = sc, max_e = e;
+        sc -= opt->b;
+    }
+    sp->score = max;
+    sp->qle = sp->tle = max_e;
+    sp->gscore = h0 + (qlen - n_mm) * opt->a - n_mm * opt->b;
+    sp->gtle = qlen;
+    sp->max_off = 0;
+}
+
 /* Restructured BSW parent function */
 #define FAC 8
 #define PFD 2
@@ -1991,20 +2274,20 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
                                    mem_chain_v* chain_ar, mem_alnreg_v *av_v,
                                    mem_cache *mmc, uint8_t *ref_string, int tid)
 {
-    SeqPair *seqPairArrayAux      = mmc->seqPairArrayAux[tid];
-    SeqPair *seqPairArrayLeft128  = mmc->seqPairArrayLeft128[tid];
-    SeqPair *seqPairArrayRight128 = mmc->seqPairArrayRight128[tid];
-    int64_t *wsize_pair = &(mmc->wsize[tid]);
-
-    uint8_t *seqBufLeftRef  = mmc->seqBufLeftRef[tid*CACHE_LINE]; 
-    uint8_t *seqBufRightRef = mmc->seqBufRightRef[tid*CACHE_LINE];
-    uint8_t *seqBufLeftQer  = mmc->seqBufLeftQer[tid*CACHE_LINE]; 
-    uint8_t *seqBufRightQer = mmc->seqBufRightQer[tid*CACHE_LINE];
-    int64_t *wsize_buf_ref = &(mmc->wsize_buf_ref[tid*CACHE_LINE]);
-    int64_t *wsize_buf_qer = &(mmc->wsize_buf_qer[tid*CACHE_LINE]);
+    SeqPair *seqPairArrayAux      = mmc->thr[tid].seqPairArrayAux;
+    SeqPair *seqPairArrayLeft128  = mmc->thr[tid].seqPairArrayLeft128;
+    SeqPair *seqPairArrayRight128 = mmc->thr[tid].seqPairArrayRight128;
+    int64_t *wsize_pair = &(mmc->thr[tid].wsize);
+
+    uint8_t *seqBufLeftRef  = mmc->thr[tid].seqBufLeftRef; 
+    uint8_t *seqBufRightRef = mmc->thr[tid].seqBufRightRef;
+    uint8_t *seqBufLeftQer  = mmc->thr[tid].seqBufLeftQer; 
+    uint8_t *seqBufRightQer = mmc->thr[tid].seqBufRightQer;
+    int64_t *wsize_buf_ref = &(mmc->thr[tid].wsize_buf_ref);
+    int64_t *wsize_buf_qer = &(mmc->thr[tid].wsize_buf_qer);
     
     // int32_t *lim_g = mmc->lim + (BATCH_SIZE + 32) * tid;
-    int32_t *lim_g = mmc->lim[tid];
+    int32_t *lim_g = mmc->thr[tid].lim;
     
     mem_seed_t *s;
     int64_t l_pac = bns->l_pac, rmax[8] __attribute__((aligned(64)));
@@ -2019,15 +2302,17 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
     int64_t leftQerOffset = 0, rightQerOffset = 0;
 
     int srt_size = MAX_SEEDS_PER_READ, fac = FAC;
+    int seeds_per_read = mem_tune.seeds_per_read, len8 = mem_tune.len8;
     uint64_t *srt = (uint64_t *) malloc(srt_size * 8);
-    uint32_t *srtgg = (uint32_t*) malloc(nseq * SEEDS_PER_READ * fac * sizeof(uint32_t));
+    uint32_t *srtgg = (uint32_t*) malloc(nseq * seeds_per_read * fac * sizeof(uint32_t));
 
     int spos = 0;
+    int max_mm = mem_gapless_max_mm(opt), mm[MAX_GAPLESS_MM];
     
     // uint64_t timUP = __rdtsc();
     for (int l=0; l<nseq; l++)
     {
-        int max = 0;
+        int max = 0, n_bsw = 0;
         uint8_t *rseq = 0;
         
         uint32_t *srtg = srtgg;
@@ -2112,9 +2397,9 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
                 ks_introsort_64(c->n, srt);
             
             // assert((spos + c->n) < SEEDS_PER_READ * FAC * nseq);
-            if ((spos + c->n) > SEEDS_PER_READ * fac * nseq) {
+            if ((spos + c->n) > seeds_per_read * fac * nseq) {
                 fac <<= 1;
-                srtgg = (uint32_t *) realloc(srtgg, nseq * SEEDS_PER_READ * fac * sizeof(uint32_t));
+                srtgg = (uint32_t *) realloc(srtgg, nseq * seeds_per_read * fac * sizeof(uint32_t));
             }
             
             for (int i = 0; i < c->n; ++i)
@@ -2142,11 +2427,29 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
                 a->c = c; //ptr
                 a->rb = a->qb = a->re = a->qe = H0_;
                 
-                tprof[PE19][tid] ++;
+                TPROF(PE19, tid) ++;
                 
-                int flag = 0;
+                int flag = 0, n_mm = -1;
                 std::pair<int, int> pr;
-                if (s->qbeg)  // left extension
+                if (s->qbeg)
+                    n_mm = mem_gapless_scan(max_mm, s->qbeg, query, s->rbeg - rmax[0], rseq, 1, mm);
+                if (n_mm >= 0 && s->len * opt->a > n_mm * opt->b)  // left extension, gapless
+                {
+                    SeqPair sp;
+                    mem_gapless_score(opt, s->len * opt->a, s->qbeg, n_mm, mm, &sp);
+                    a->qb = s->qbeg; a->rb = s->rbeg;
+                    a->score = sp.score;
+                    if (sp.gscore <= 0 || sp.gscore <= a->score - opt->pen_clip5) {
+                        a->qb -= sp.qle; a->rb -= sp.tle;
+                        a->truesc = a->score;
+                    } else {
+                        a->qb = 0; a->rb -= sp.gtle;
+                        a->truesc = sp.gscore;
+                    }
+                    flag = 1;
+                    TPROF(GAPLESS_EXT, tid) ++;
+                }
+                else if (s->qbeg)  // left extension
                 {
                     SeqPair sp;
                     sp.h0 = s->len * opt->a;
@@ -2155,19 +2458,10 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
                         
                     if (numPairsLeft >= *wsize_pair) {
                         fprintf(stderr, "[0000][%0.4d] Re-allocating seqPairArrays, in Left\n", tid);
-                        *wsize_pair += 1024;
-                        seqPairArrayAux = (SeqPair *) realloc(seqPairArrayAux,
-                                                              (*wsize_pair + MAX_LINE_LEN)
-                                                              * sizeof(SeqPair));
-                        mmc->seqPairArrayAux[tid] = seqPairArrayAux;
-                        seqPairArrayLeft128 = (SeqPair *) realloc(seqPairArrayLeft128,
-                                                                  (*wsize_pair + MAX_LINE_LEN)
-                                                                  * sizeof(SeqPair));
-                        mmc->seqPairArrayLeft128[tid] = seqPairArrayLeft128;
-                        seqPairArrayRight128 = (SeqPair *) realloc(seqPairArrayRight128,
-                                                                   (*wsize_pair + MAX_LINE_LEN)
-                                                                   * sizeof(SeqPair));
-                        mmc->seqPairArrayRight128[tid] = seqPairArrayRight128;
+                        mem_resize_pairs(mmc, tid, *wsize_pair * 2);
+                        seqPairArrayAux = mmc->thr[tid].seqPairArrayAux;
+                        seqPairArrayLeft128 = mmc->thr[tid].seqPairArrayLeft128;
+                        seqPairArrayRight128 = mmc->thr[tid].seqPairArrayRight128;
                     }
 
                     
@@ -2179,15 +2473,11 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
                     {
                         fprintf(stderr, "[%0.4d] Re-allocating (doubling) seqBufQers in %s (left)\n",
                                 tid, __func__);
-                        int64_t tmp = *wsize_buf_qer;
-                        *wsize_buf_qer *= 2;
-                        uint8_t *seqBufQer_ = (uint8_t*)
-                            _mm_realloc(seqBufLeftQer, tmp, *wsize_buf_qer, sizeof(uint8_t)); 
-                        mmc->seqBufLeftQer[tid*CACHE_LINE] = seqBufLeftQer = seqBufQer_;
-                        
-                        seqBufQer_ = (uint8_t*)
-                            _mm_realloc(seqBufRightQer, tmp, *wsize_buf_qer, sizeof(uint8_t)); 
-                        mmc->seqBufRightQer[tid*CACHE_LINE] = seqBufRightQer = seqBufQer_;      
+                        int64_t n = *wsize_buf_qer * 2;
+                        mem_resize_seqbuf(mmc, tid, *wsize_buf_ref,
+                                          n > leftQerOffset? n : leftQerOffset + 1);
+                        seqBufLeftQer = mmc->thr[tid].seqBufLeftQer;
+                        seqBufRightQer = mmc->thr[tid].seqBufRightQer;
                     }
                     
                     uint8_t *qs = seqBufLeftQer + sp.idq;
@@ -2199,15 +2489,11 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
                     {
                         fprintf(stderr, "[%0.4d] Re-allocating (doubling) seqBufRefs in %s (left)\n",
                                 tid, __func__);
-                        int64_t tmp = *wsize_buf_ref;
-                        *wsize_buf_ref *= 2;
-                        uint8_t *seqBufRef_ = (uint8_t*)
-                            _mm_realloc(seqBufLeftRef, tmp, *wsize_buf_ref, sizeof(uint8_t)); 
-                        mmc->seqBufLeftRef[tid*CACHE_LINE] = seqBufLeftRef = seqBufRef_;
-                        
-                        seqBufRef_ = (uint8_t*)
-                            _mm_realloc(seqBufRightRef, tmp, *wsize_buf_ref, sizeof(uint8_t)); 
-                        mmc->seqBufRightRef[tid*CACHE_LINE] = seqBufRightRef = seqBufRef_;              
+                        int64_t n = *wsize_buf_ref * 2;
+                        mem_resize_seqbuf(mmc, tid, n > leftRefOffset? n : leftRefOffset + 1,
+                                          *wsize_buf_qer);
+                        seqBufLeftRef = mmc->thr[tid].seqBufLeftRef;
+                        seqBufRightRef = mmc->thr[tid].seqBufRightRef;
                     }
                     
                     uint8_t *rs = seqBufLeftRef + sp.idr;                    
@@ -2215,9 +2501,10 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
                     
                     sp.len2 = s->qbeg;
                     sp.len1 = tmp;
+                    TPROF(N_SW_CELLS, tid) += (int64_t) sp.len1 * sp.len2;
                     int minval = sp.h0 + min_(sp.len1, sp.len2) * opt->a;
                     
-                    if (sp.len1 < MAX_SEQ_LEN8 && sp.len2 < MAX_SEQ_LEN8 && minval < MAX_SEQ_LEN8) {
+                    if (sp.len1 < len8 && sp.len2 < len8 && minval < len8) {
                         numPairsLeft128++;
                     }
                     else if (sp.len1 < MAX_SEQ_LEN16 && sp.len2 < MAX_SEQ_LEN16 && minval < MAX_SEQ_LEN16){
@@ -2229,6 +2516,7 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
                     
                     seqPairArrayLeft128[numPairsLeft] = sp;
                     numPairsLeft ++;
+                    n_bsw ++;
                     a->qb = s->qbeg; a->rb = s->rbeg;
                 }
                 else
@@ -2237,7 +2525,36 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
                     a->score = a->truesc = s->len * opt->a, a->qb = 0, a->rb = s->rbeg;
                 }
 
-                if (s->qbeg + s->len != l_query)  // right extension
+                n_mm = -1;
+                if (flag && s->qbeg + s->len != l_query) // right h0 is known only if left is done
+                    n_mm = mem_gapless_scan(max_mm, l_query - s->qbeg - s->len, query + s->qbeg + s->len,
+                                            rmax[1] - s->rbeg - s->len, rseq + s->rbeg + s->len - rmax[0],
+                                            0, mm);
+                if (n_mm >= 0 && a->score > n_mm * opt->b)  // right extension, gapless
+                {
+                    SeqPair sp;
+                    int h0 = a->score;
+                    mem_gapless_score(opt, h0, l_query - s->qbeg - s->len, n_mm, mm, &sp);
+                    a->qe = s->qbeg + s->len; a->re = s->rbeg + s->len;
+                    a->score = sp.score;
+                    if (sp.gscore <= 0 || sp.gscore <= a->score - opt->pen_clip3) {
+                        a->qe += sp.qle, a->re += sp.tle;
+                        a->truesc += a->score - h0;
+                    } else {
+                        a->qe = l_query, a->re += sp.gtle;
+                        a->truesc += sp.gscore - h0;
+                    }
+                    int i;
+                    for (i = 0, a->seedcov = 0; i < c->n; ++i)
+                    {
+                        const mem_seed_t *t = &c->seeds[i];
+                        if (t->qbeg >= a->qb && t->qbeg + t->len <= a->qe &&
+                            t->rbeg >= a->rb && t->rbeg + t->len <= a->re) // seed fully contained
+                            a->seedcov += t->len;
+                    }
+                    TPROF(GAPLESS_EXT, tid) ++;
+                }
+                else if (s->qbeg + s->len != l_query)  // right extension
                 {
                     int64_t qe = s->qbeg + s->len;
                     int64_t re = s->rbeg + s->len - rmax[0];
@@ -2251,19 +2568,10 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
                     if (numPairsRight >= *wsize_pair)
                     {
                         fprintf(stderr, "[0000] [%0.4d] Re-allocating seqPairArrays Right\n", tid);
-                        *wsize_pair += 1024;
-                        seqPairArrayAux = (SeqPair *) realloc(seqPairArrayAux,
-                                                              (*wsize_pair + MAX_LINE_LEN)
-                                                              * sizeof(SeqPair));
-                        mmc->seqPairArrayAux[tid] = seqPairArrayAux;
-                        seqPairArrayLeft128 = (SeqPair *) realloc(seqPairArrayLeft128,
-                                                                  (*wsize_pair + MAX_LINE_LEN)
-                                                                  * sizeof(SeqPair));
-                        mmc->seqPairArrayLeft128[tid] = seqPairArrayLeft128;
-                        seqPairArrayRight128 = (SeqPair *) realloc(seqPairArrayRight128,
-                                                                   (*wsize_pair + MAX_LINE_LEN)
-                                                                   * sizeof(SeqPair));
-                        mmc->seqPairArrayRight128[tid] = seqPairArrayRight128;
+                        mem_resize_pairs(mmc, tid, *wsize_pair * 2);
+                        seqPairArrayAux = mmc->thr[tid].seqPairArrayAux;
+                        seqPairArrayLeft128 = mmc->thr[tid].seqPairArrayLeft128;
+                        seqPairArrayRight128 = mmc->thr[tid].seqPairArrayRight128;
                     }
                     
                     sp.len2 = l_query - qe;
@@ -2277,15 +2585,11 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
                     {
                         fprintf(stderr, "[%0.4d] Re-allocating (doubling) seqBufQers in %s (right)\n",
                                 tid, __func__);
-                        int64_t tmp = *wsize_buf_qer;
-                        *wsize_buf_qer *= 2;
-                        uint8_t *seqBufQer_ = (uint8_t*)
-                            _mm_realloc(seqBufLeftQer, tmp, *wsize_buf_qer, sizeof(uint8_t)); 
-                        mmc->seqBufLeftQer[tid*CACHE_LINE] = seqBufLeftQer = seqBufQer_;
-                        
-                        seqBufQer_ = (uint8_t*)
-                            _mm_realloc(seqBufRightQer, tmp, *wsize_buf_qer, sizeof(uint8_t)); 
-                        mmc->seqBufRightQer[tid*CACHE_LINE] = seqBufRightQer = seqBufQer_;      
+                        int64_t n = *wsize_buf_qer * 2;
+                        mem_resize_seqbuf(mmc, tid, *wsize_buf_ref,
+                                          n > rightQerOffset? n : rightQerOffset + 1);
+                        seqBufLeftQer = mmc->thr[tid].seqBufLeftQer;
+                        seqBufRightQer = mmc->thr[tid].seqBufRightQer;
                     }
 
                     rightRefOffset += sp.len1;
@@ -2293,18 +2597,15 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
                     {
                         fprintf(stderr, "[%0.4d] Re-allocating (doubling) seqBufRefs in %s (right)\n",
                                 tid, __func__);
-                        int64_t tmp = *wsize_buf_ref;
-                        *wsize_buf_ref *= 2;
-                        uint8_t *seqBufRef_ = (uint8_t*)
-                            _mm_realloc(seqBufLeftRef, tmp, *wsize_buf_ref, sizeof(uint8_t)); 
-                        mmc->seqBufLeftRef[tid*CACHE_LINE] = seqBufLeftRef = seqBufRef_;
-                        
-                        seqBufRef_ = (uint8_t*)
-                            _mm_realloc(seqBufRightRef, tmp, *wsize_buf_ref, sizeof(uint8_t)); 
-                        mmc->seqBufRightRef[tid*CACHE_LINE] = seqBufRightRef = seqBufRef_;              
+                        int64_t n = *wsize_buf_ref * 2;
+                        mem_resize_seqbuf(mmc, tid, n > rightRefOffset? n : rightRefOffset + 1,
+                                          *wsize_buf_qer);
+                        seqBufLeftRef = mmc->thr[tid].seqBufLeftRef;
+                        seqBufRightRef = mmc->thr[tid].seqBufRightRef;
                     }
                     
-                    tprof[PE23][tid] += sp.len1 + sp.len2;
+                    TPROF(PE23, tid) += sp.len1 + sp.len2;
+                    TPROF(N_SW_CELLS, tid) += (int64_t) sp.len1 * sp.len2;
 
                     uint8_t *qs = seqBufRightQer + sp.idq;
                     uint8_t *rs = seqBufRightRef + sp.idr;
@@ -2315,7 +2616,7 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
 
                     int minval = sp.h0 + min_(sp.len1, sp.len2) * opt->a;
                     
-                    if (sp.len1 < MAX_SEQ_LEN8 && sp.len2 < MAX_SEQ_LEN8 && minval < MAX_SEQ_LEN8) {
+                    if (sp.len1 < len8 && sp.len2 < len8 && minval < len8) {
                         numPairsRight128++;
                     }
                     else if(sp.len1 < MAX_SEQ_LEN16 && sp.len2 < MAX_SEQ_LEN16 && minval < MAX_SEQ_LEN16) {
@@ -2326,6 +2627,7 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
                     }
                     seqPairArrayRight128[numPairsRight] = sp;
                     numPairsRight ++;
+                    n_bsw ++;
                     a->qe = qe; a->re = rmax[0] + re;
                 }
                 else
@@ -2345,10 +2647,20 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
                     }
                 }
             }
-            // tprof[MEM_ALN2_DOWN1][tid] += __rdtsc() - tim;
+            // TPROF(MEM_ALN2_DOWN1, tid) += __rdtsc() - tim;
         }
+        if (chn->n > 0) {
+            TPROF(ALN_READ, tid) ++;
+            if (n_bsw == 0) TPROF(GAPLESS_READ, tid) ++;
+        }
+        TPROF(ALN_EXT, tid) += n_bsw;
     }
-    // tprof[MEM_ALN2_UP][tid] += __rdtsc() - timUP;
+    // TPROF(MEM_ALN2_UP, tid) += __rdtsc() - timUP;
+
+    mem_thread_cache *hw = &mmc->thr[tid];
+    hw->hw_pairs   = max_(hw->hw_pairs, max_(numPairsLeft, numPairsRight));
+    hw->hw_buf_ref = max_(hw->hw_buf_ref, max_(leftRefOffset, rightRefOffset));
+    hw->hw_buf_qer = max_(hw->hw_buf_qer, max_(leftQerOffset, rightQerOffset));
     
 
     int32_t *hist = (int32_t *)_mm_malloc((MAX_SEQ_LEN8 + MAX_SEQ_LEN16 + 32) *
@@ -2393,7 +2705,7 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
                                        w);
         // tprof[PE5][0] += nump;
         // tprof[PE6][0] ++;
-        // tprof[MEM_ALN2_B][tid] += __rdtsc() - tim;
+        // TPROF(MEM_ALN2_B, tid) += __rdtsc() - tim;
             
         int num = 0;
         for (int l=0; l<nump; l++)
@@ -2453,6 +2765,9 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
         bswLeft.scalarBandedSWAWrapper(pair_ar, seqBufLeftRef, seqBufLeftQer, nump, nthreads, w);
 #else
         sortPairsLen(pair_ar, nump, seqPairArrayAux, hist);
+        if (mem_kdump)
+            mem_kdump_pairs(opt, KD_BSW16, w, opt->pen_clip5, pair_ar, nump,
+                            seqBufLeftRef, seqBufLeftQer);
         bswLeft.getScores16(pair_ar,
                             seqBufLeftRef,
                             seqBufLeftQer,
@@ -2463,7 +2778,7 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
         
         tprof[PE5][0] += nump;
         tprof[PE6][0] ++;               
-        // tprof[MEM_ALN2_B][tid] += __rdtsc() - tim;
+        // TPROF(MEM_ALN2_B, tid) += __rdtsc() - tim;
 
         int num = 0;
         for (int l=0; l<nump; l++)
@@ -2522,6 +2837,9 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
         bswLeft.scalarBandedSWAWrapper(pair_ar, seqBufLeftRef, seqBufLeftQer, nump, nthreads, w);
 #else
         sortPairsLen(pair_ar, nump, seqPairArrayAux, hist);
+        if (mem_kdump)
+            mem_kdump_pairs(opt, KD_BSW8, w, opt->pen_clip5, pair_ar, nump,
+                            seqBufLeftRef, seqBufLeftQer);
         bswLeft.getScores8(pair_ar,
                            seqBufLeftRef,
                            seqBufLeftQer,
@@ -2532,7 +2850,7 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
         
         tprof[PE1][0] += nump;
         tprof[PE2][0] ++;
-        // tprof[MEM_ALN2_D][tid] += __rdtsc() - tim;
+        // TPROF(MEM_ALN2_D, tid) += __rdtsc() - tim;
 
         int num = 0;
         for (int l=0; l<nump; l++)
@@ -2576,7 +2894,7 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
         pair_ar_aux = tmp;
     }
 
-    // tprof[CLEFT][tid] += __rdtsc() - timL;
+    // TPROF(CLEFT, tid) += __rdtsc() - timL;
     
     // uint64_t timR = __rdtsc();
     // **********************************************************
@@ -2609,7 +2927,7 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
                         w);
         // tprof[PE7][0] += nump;
         // tprof[PE8][0] ++;
-        // tprof[MEM_ALN2_C][tid] += __rdtsc() - tim;
+        // TPROF(MEM_ALN2_C, tid) += __rdtsc() - tim;
         int num = 0;
 
         for (int l=0; l<nump; l++)
@@ -2666,6 +2984,9 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
         bswRight.scalarBandedSWAWrapper(pair_ar, seqBufRightRef, seqBufRightQer, nump, nthreads, w);
 #else
         sortPairsLen(pair_ar, nump, seqPairArrayAux, hist);
+        if (mem_kdump)
+            mem_kdump_pairs(opt, KD_BSW16, w, opt->pen_clip3, pair_ar, nump,
+                            seqBufRightRef, seqBufRightQer);
         bswRight.getScores16(pair_ar,
                              seqBufRightRef,
                              seqBufRightQer,
@@ -2676,7 +2997,7 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
 
         tprof[PE7][0] += nump;
         tprof[PE8][0] ++;
-        // tprof[MEM_ALN2_C][tid] += __rdtsc() - tim;
+        // TPROF(MEM_ALN2_C, tid) += __rdtsc() - tim;
         
         int num = 0;
 
@@ -2737,6 +3058,9 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
         bswRight.scalarBandedSWAWrapper(pair_ar, seqBufRightRef, seqBufRightQer, nump, nthreads, w); 
 #else
         sortPairsLen(pair_ar, nump, seqPairArrayAux, hist);
+        if (mem_kdump)
+            mem_kdump_pairs(opt, KD_BSW8, w, opt->pen_clip3, pair_ar, nump,
+                            seqBufRightRef, seqBufRightQer);
         bswRight.getScores8(pair_ar,
                             seqBufRightRef,
                             seqBufRightQer,
@@ -2747,7 +3071,7 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
             
         tprof[PE3][0] += nump;
         tprof[PE4][0] ++;
-        // tprof[MEM_ALN2_E][tid] += __rdtsc() - tim;
+        // TPROF(MEM_ALN2_E, tid) += __rdtsc() - tim;
         int num = 0;
 
         for (int l=0; l<nump; l++)
@@ -2792,7 +3116,7 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
     }
 
     _mm_free(hist);
-    // tprof[CRIGHT][tid] += __rdtsc() - timR;
+    // TPROF(CRIGHT, tid) += __rdtsc() - timR;
     
     if (numPairsLeft >= *wsize_pair || numPairsRight >= *wsize_pair)
     {   // refine it!
@@ -2809,7 +3133,7 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
         lim_g[l] += lim_g[l-1];
             
     // uint64_t tim = __rdtsc();            
-    int *lim = (int *) calloc(BATCH_SIZE, sizeof(int));
+    int *lim = (int *) calloc(mem_tune.batch, sizeof(int));
     assert(lim != NULL);
 
     for (int l=0; l<nseq; l++)
@@ -2891,7 +3215,7 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
                         mem_alnreg_t *ar = &(av_v[l].a[s->aln]);
                         ar->qb = ar->qe = -1;         // purge the alingment
                         srt2[k] = UINT_MAX;
-                        tprof[PE18][tid]++;
+                        TPROF(PE18, tid)++;
                         continue;
                     }
                 }                
@@ -2902,5 +3226,5 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
     free(srtgg);
     free(srt);
     free(lim);
-    // tprof[MEM_ALN2_DOWN][tid] += __rdtsc() - tim;    
+    // TPROF(MEM_ALN2_DOWN, tid) += __rdtsc() - tim;    
 }
@@ -105,6 +105,7 @@ typedef struct mem_opt_t {
     int max_matesw;         // perform maximally max_matesw rounds of mate-SW for each end
     int max_XA_hits, max_XA_hits_alt; // if there are max_hits or fewer, output them all
     int8_t mat[25];         // scoring matrix; mat[0] == 0 if unset
+    const char *rg_id;      // read group of the RG tag; NULL if none
 } mem_opt_t;
 
 
@@ -177,35 +178,49 @@ typedef struct { // This struct is only used for the convenience of API.
     int score, sub, alt_sc;
 } mem_aln_t;
 
+typedef struct { size_t n, m; mem_aln_t *a; } mem_aln_v;
+
 // struct
 typedef struct {
     bwtintv_v mem, mem1, *tmpv[2];
 } smem_aux_t;
 
+/* Working buffers of one compute thread; the blocks of different threads
+   never share a cache line. */
 typedef struct
 {
-    SeqPair *seqPairArrayAux[MAX_THREADS];
-    SeqPair *seqPairArrayLeft128[MAX_THREADS];
-    SeqPair *seqPairArrayRight128[MAX_THREADS];
+    SeqPair *seqPairArrayAux;
+    SeqPair *seqPairArrayLeft128;
+    SeqPair *seqPairArrayRight128;
     
-    int64_t wsize[MAX_THREADS];
-
-    int64_t wsize_buf_ref[MAX_THREADS*CACHE_LINE]; 
-    int64_t wsize_buf_qer[MAX_THREADS*CACHE_LINE];
-
-    uint8_t *seqBufLeftRef[MAX_THREADS*CACHE_LINE];
-    uint8_t *seqBufRightRef[MAX_THREADS*CACHE_LINE];
-    uint8_t *seqBufLeftQer[MAX_THREADS*CACHE_LINE];
-    uint8_t *seqBufRightQer[MAX_THREADS*CACHE_LINE];    
-
-    SMEM *matchArray[MAX_THREADS];
-    int32_t *min_intv_ar[MAX_THREADS];
-    int32_t *rid[MAX_THREADS];
-    int32_t *lim[MAX_THREADS];
-    int16_t *query_pos_ar[MAX_THREADS];
-    uint8_t *enc_qdb[MAX_THREADS];
+    int64_t wsize;
+
+    int64_t wsize_buf_ref; 
+    int64_t wsize_buf_qer;
+
+    uint8_t *seqBufLeftRef;
+    uint8_t *seqBufRightRef;
+    uint8_t *seqBufLeftQer;
+    uint8_t *seqBufRightQer;    
+
+    SMEM *matchArray;
+    int32_t *min_intv_ar;
+    int32_t *rid;
+    int32_t *lim;
+    int16_t *query_pos_ar;
+    uint8_t *enc_qdb;
     
-    int64_t wsize_mem[MAX_THREADS];
+    int64_t wsize_mem;
+
+    /* Largest demand of a single batch, read when the buffers are refitted */
+    int64_t hw_pairs, hw_buf_ref, hw_buf_qer;
+    int64_t hw_mem;
+    int64_t hw_seeds;         // seeds per read
+} __attribute__((aligned(64))) mem_thread_cache;
+
+typedef struct
+{
+    mem_thread_cache *thr;    // one per compute thread (-t)
 } mem_cache;
 
 // chain moved to .h
@@ -222,12 +237,26 @@ typedef struct worker_t {
     mem_cache         mmc;
     mem_seed_t       *seedBuf;
     int64_t           seedBufSize;
+    int32_t           seeds_per_read;  // seedBuf slots of one read
     mem_seed_t       *auxSeedBuf;
     int64_t           auxSeedBufSize;
     uint8_t          *ref_string;
     int16_t           nthreads;
     int32_t           nreads;
     FMI_search       *fmi;  
+    int              *thread_cpu;  // cpu each compute thread is pinned to; NULL if unpinned
+    mem_aln_v        *alnv;        // if set, a copy of each record written by mem_aln2sam, per read
+    struct kt_pool_t *pool;        // warm compute threads for kt_for; NULL: a thread start per phase
+    int32_t           grain;       // reads per kt_for work unit of the running phase
+    struct mem_dedup_t *dedup;     // exact-duplicate read cache; NULL: every read is aligned
+    int               cosched;     // worker_bwt and worker_aln overlapped on thread pairs (kt_for_pair)
+#if NUMA_ENABLED
+    int               n_nodes;     // > 0 when the index is replicated per NUMA node
+    int              *tid_node;    // NUMA node of each compute thread
+    FMI_search      **node_fmi;    // per-node replicas, indexed by node id
+    uint8_t         **node_ref;
+    cpu_set_t        *node_cpus;   // kt_for workers are pinned to their node's cpus
+#endif
 } worker_t;
 
 
@@ -256,9 +285,40 @@ char **mem_gen_alt(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac
 void mem_aln2sam(const mem_opt_t *opt, const bntseq_t *bns, kstring_t *str, bseq1_t *s,
                  int n, const mem_aln_t *list, int which, const mem_aln_t *m_);
 
+/* Kernel input dumps for the microbenchmarks in test/kbench.cpp. While
+   mem_kdump is open, the pairs handed to the BSW and kswv kernels and the
+   alignments handed to mem_aln2sam are appended to it, one record each:
+     pairs: int32 {kind, w or phase, end_bonus, n, l_ref, l_qer, o_del, e_del,
+            o_ins, e_ins, a, b, zdrop}, SeqPair[n] (idr/idq into the record),
+            l_ref reference bytes, l_qer query bytes
+     sam:   int32 {KD_SAM, n, l_seq, l_name, has_qual}, name, seq, qual, then
+            per alignment the mem_aln_t, its CIGAR and int32 l_XA (-1: none), XA */
+#define KD_BSW8   0
+#define KD_BSW16  1
+#define KD_KSWV8  2
+#define KD_KSWV16 3
+#define KD_SAM    4
+#define KD_PAIR_HDR 13
+
+extern FILE *mem_kdump;
+void mem_kdump_pairs(const mem_opt_t *opt, int kind, int arg, int end_bonus,
+                     const SeqPair *p, int n, const uint8_t *ref, const uint8_t *qer);
+void mem_kdump_aln(const bseq1_t *s, int n, const mem_aln_t *list);
+
 static inline int get_rlen(int n_cigar, const uint32_t *cigar);
 static inline int infer_bw(int l1, int l2, int score, int a, int q, int r);
 
+/* SMEMs, reseeded SMEMs and LAST-like seeds of nseq 2-bit reads, sorted by read */
+SMEM *mem_collect_smem(FMI_search *fmi, const mem_opt_t *opt,
+                       const bseq1_t *seq_,
+                       int nseq,
+                       SMEM *matchArray,
+                       int32_t *min_intv_ar,
+                       int16_t *query_pos_ar,
+                       uint8_t *enc_qdb,
+                       int32_t *rid,
+                       int64_t &tot_smem);
+
 int mem_kernel1_core(FMI_search *fmi, const mem_opt_t *opt,
                      bseq1_t *seq_,
                      int nseq,
@@ -268,6 +328,13 @@ int mem_kernel1_core(FMI_search *fmi, const mem_opt_t *opt,
 
 void* _mm_realloc(void *ptr, int64_t csize, int64_t nsize, int16_t dsize);
 
+/* Resize the kernel buffers of thread tid to hold n entries (bytes for the
+   sequence buffers). Growing keeps the contents; shrinking is only done
+   between chunks. */
+void mem_resize_pairs(mem_cache *mmc, int tid, int64_t n);
+void mem_resize_seqbuf(mem_cache *mmc, int tid, int64_t n_ref, int64_t n_qer);
+void mem_resize_smem(mem_cache *mmc, int tid, int64_t n);
+
 void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
                                    const uint8_t *pac, bseq1_t *seq_, int nseq,
                                    mem_chain_v* chain_ar, mem_alnreg_v *av_v,
@@ -303,7 +370,7 @@ int mem_matesw_batch_post(const mem_opt_t *opt, const bntseq_t *bns,
 
 int mem_sam_pe(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac,
                const mem_pestat_t pes[4], uint64_t id, bseq1_t s[2],
-               mem_alnreg_v a[2]);
+               mem_alnreg_v a[2], int tid);
 /**
  * Align a batch of sequences and generate the alignments in the SAM format
  *
@@ -147,10 +147,119 @@ void mem_pestat(const mem_opt_t *opt, int64_t l_pac, int n,
         }
 }
 
+/*********************************
+ * Mate-rescue window prefilter  *
+ *********************************/
+/* A rescued hit is kept if it scores at least S = min_seed_len * a (the minsc
+   of ksw_align2), so it spans l >= S/a bases of the mate and loses at most
+   l*a - S against all matches. With the mate cut into segments of length s,
+   the hit fully covers (l+1)/s - 1 of them. A covered segment that is more
+   than t edits away from the reference holds t+1 mismatched, deleted or
+   inserted bases, or lies inside an insertion; mem_matesw_flt_cost2() bounds
+   what this costs, counting the gap open of a deletion in the segment that
+   holds it and half the gap open of an insertion in each of the at most two
+   segments it ends in. If no hit can pay for all covered segments, one of
+   them is within t edits, and a window in which no segment occurs within
+   edit distance t is dropped without running SW. */
+#define MATESW_FLT_MAX_ERR 3
+
+/* Twice the least score lost in a segment of length s that is more than t edits
+   away from the reference */
+static int mem_matesw_flt_cost2(const mem_opt_t *opt, int s, int t)
+{
+    int gi, gd, c, min = 2 * s * (opt->e_ins + opt->a); // a segment inside an insertion
+    for (gi = 0; gi <= t + 1; ++gi)
+        for (gd = 0; gi + gd <= t + 1; ++gd) {
+            c = 2 * (gi * (opt->e_ins + opt->a) + gd * opt->e_del + (t + 1 - gi - gd) * (opt->a + opt->b));
+            if (gi) c += opt->o_ins;
+            if (gd) c += 2 * opt->o_del;
+            min = c < min? c : min;
+        }
+    return min;
+}
+
+static int mem_matesw_flt_init(const mem_opt_t *opt, int l_ms, int *_s)
+{
+    int s, t, l, c2, S = opt->min_seed_len * opt->a, l_min;
+    if (S <= 0 || opt->a <= 0) return -1;
+    l_min = (S + opt->a - 1) / opt->a;
+    s = (l_min + 1) >> 1;
+    s = s < 63? s : 63;
+    if (s < 8 || l_ms < l_min) return -1; // segments too short to filter anything
+    for (t = 0; t <= MATESW_FLT_MAX_ERR; ++t) {
+        c2 = mem_matesw_flt_cost2(opt, s, t);
+        for (l = l_min; l <= l_ms; ++l)
+            if ((int64_t)((l + 1) / s - 1) * c2 <= 2 * ((int64_t)l * opt->a - S)) break;
+        if (l > l_ms) break;
+    }
+    if (t > MATESW_FLT_MAX_ERR || s < 4 * (t + 1)) return -1; // too loose to reject a window
+    *_s = s;
+    return t;
+}
+
+/* Myers' bit-parallel approximate search, with 64/(s+1) segments of length s
+   packed into one word; each segment keeps a guard bit to stop the carries. */
+static int mem_matesw_flt_lanes(int s, int t, int n_lane, const uint64_t peq[5],
+                                int64_t l_ref, const uint8_t *ref)
+{
+    int l, w = s + 1;
+    int64_t j;
+    uint64_t pm = 0, hb = 0, hi = 0, sc = 0, add = 0, Pv, Mv = 0;
+    for (l = 0; l < n_lane; ++l) {
+        pm  |= ((1ULL << s) - 1) << l*w;
+        hb  |= 1ULL << (l*w + s - 1);
+        hi  |= 1ULL << (l*w + s);
+        sc  |= (uint64_t)s << l*w;              // per-segment edit distance
+        add |= ((1ULL << s) - t - 1) << l*w;    // sets bit s iff distance > t
+    }
+    for (j = 0, Pv = pm; j < l_ref; ++j) {
+        uint64_t Eq = peq[ref[j]], Xv = Eq | Mv, Xh = (((Eq & Pv) + Pv) ^ Pv) | Eq;
+        uint64_t Ph = (Mv | ~(Xh | Pv)) & pm, Mh = Pv & Xh & pm;
+        sc += (Ph & hb) >> (s - 1);
+        sc -= (Mh & hb) >> (s - 1);
+        Ph <<= 1; Mh <<= 1;
+        Pv = (Mh | ~(Xv | Ph)) & pm; Mv = Ph & Xv;
+        if (((sc + add) & hi) != hi) return 1;
+    }
+    return 0;
+}
+
+static int mem_matesw_flt(int s, int t, int l_ms, const uint8_t *seq,
+                          int64_t l_ref, const uint8_t *ref)
+{
+    int i, k, l, w = s + 1, n_lane = 64 / w;
+    for (k = 0; k + s <= l_ms; k += n_lane * s) {
+        uint64_t peq[5];
+        memset(peq, 0, sizeof(peq));
+        for (l = 0; l < n_lane && k + (l + 1) * s <= l_ms; ++l)
+            for (i = 0; i < s; ++i) {
+                int c = seq[k + l*s + i];
+                uint64_t b = 1ULL << (l*w + i);
+                if (c < 4) peq[c] |= b;
+                else peq[0] |= b, peq[1] |= b, peq[2] |= b, peq[3] |= b; // N matches anything
+                peq[4] |= b;
+            }
+        if (mem_matesw_flt_lanes(s, t, l, peq, l_ref, ref)) return 1;
+    }
+    return 0;
+}
+
+/* Tells whether SW can be skipped; counts the windows the filter checked for
+   thread $tid (none when it is off, so the stats stay quiet) */
+static int mem_matesw_flt_skip(int s, int t, int l_ms, const uint8_t *seq,
+                               int64_t l_ref, const uint8_t *ref, int tid)
+{
+    if (t < 0) return 0;
+    TPROF(MATESW_WIN, tid) ++;
+    if (mem_matesw_flt(s, t, l_ms, seq, l_ref, ref)) return 0;
+    TPROF(MATESW_FLT, tid) ++;
+    return 1;
+}
+
 int mem_matesw(const mem_opt_t *opt, const bntseq_t *bns,
                const uint8_t *pac, const mem_pestat_t pes[4],
                const mem_alnreg_t *a, int l_ms, const uint8_t *ms,
-               mem_alnreg_v *ma)
+               mem_alnreg_v *ma, int tid)
 {
     extern int mem_sort_dedup_patch(const mem_opt_t *opt, const bntseq_t *bns,
                                     const uint8_t *pac, uint8_t *query, int n, mem_alnreg_t *a);
@@ -163,7 +272,7 @@ int mem_matesw(const mem_opt_t *opt, const bntseq_t *bns,
     
     //int tid = omp_get_thread_num();
     int64_t l_pac = bns->l_pac;
-    int i, r, skip[4], n = 0, rid = -1;
+    int i, r, skip[4], n = 0, rid = -1, flt_s = 0, flt_t;
     for (r = 0; r < 4; ++r)
         skip[r] = pes[r].failed? 1 : 0;
 
@@ -178,6 +287,7 @@ int mem_matesw(const mem_opt_t *opt, const bntseq_t *bns,
     }
 
     if (skip[0] + skip[1] + skip[2] + skip[3] == 4) return 0; // consistent pair exist; no need to perform SW
+    flt_t = mem_matesw_flt_init(opt, l_ms, &flt_s);
 
     for (r = 0; r < 4; ++r) {
         int is_rev, is_larger;
@@ -202,7 +312,8 @@ int mem_matesw(const mem_opt_t *opt, const bntseq_t *bns,
         if (rb < 0) rb = 0;
         if (re > l_pac<<1) re = l_pac<<1;
         if (rb < re) ref = bns_fetch_seq(bns, pac, &rb, (rb+re)>>1, &re, &rid);
-        if (a->rid == rid && re - rb >= opt->min_seed_len) { // no funny things happening
+        if (a->rid == rid && re - rb >= opt->min_seed_len && // no funny things happening
+            !mem_matesw_flt_skip(flt_s, flt_t, l_ms, seq, re - rb, ref, tid)) {
             kswr_t aln;
             mem_alnreg_t b;
             int tmp, xtra = KSW_XSUBO | KSW_XSTART | (l_ms * opt->a < 250? KSW_XBYTE : 0) | (opt->min_seed_len * opt->a);
@@ -352,7 +463,7 @@ void mem_aln2sam(const mem_opt_t *opt, const bntseq_t *bns, kstring_t *str, bseq
 
 int mem_sam_pe(const mem_opt_t *opt, const bntseq_t *bns,
                const uint8_t *pac, const mem_pestat_t pes[4],
-               uint64_t id, bseq1_t s[2], mem_alnreg_v a[2])
+               uint64_t id, bseq1_t s[2], mem_alnreg_v a[2], int tid)
 {
     extern int mem_mark_primary_se(const mem_opt_t *opt, int n, mem_alnreg_t *a, int64_t id);
     extern int mem_approx_mapq_se(const mem_opt_t *opt, const mem_alnreg_t *a);
@@ -377,6 +488,7 @@ int mem_sam_pe(const mem_opt_t *opt, const bntseq_t *bns,
     n_aa[0] = n_aa[1] = 0;
     if (!(opt->flag & MEM_F_NO_RESCUE)) { // then perform SW for the best alignment
 
+        uint64_t tim = __rdtsc();
         mem_alnreg_v b[2];
         kv_init(b[0]); kv_init(b[1]);
         for (i = 0; i < 2; ++i)
@@ -389,7 +501,7 @@ int mem_sam_pe(const mem_opt_t *opt, const bntseq_t *bns,
             sort_alnreg_re(a[!i].n, a[!i].a);
             int val = 0, swcount = 0;
             for (j = 0; j < b[i].n && j < opt->max_matesw; ++j) {
-                int val = mem_matesw(opt, bns, pac, pes, &b[i].a[j], s[!i].l_seq, (uint8_t*)s[!i].seq, &a[!i]);
+                int val = mem_matesw(opt, bns, pac, pes, &b[i].a[j], s[!i].l_seq, (uint8_t*)s[!i].seq, &a[!i], tid);
                 n += val;
                 swcount += val;
             }
@@ -406,11 +518,12 @@ int mem_sam_pe(const mem_opt_t *opt, const bntseq_t *bns,
         
         for (i = 0; i < 2; ++i)
             for (j = 0; j < b[i].n && j < opt->max_matesw; ++j) {
-                int val = mem_matesw(opt, bns, pac, pes, &b[i].a[j], s[!i].l_seq, (uint8_t*)s[!i].seq, &a[!i]);
+                int val = mem_matesw(opt, bns, pac, pes, &b[i].a[j], s[!i].l_seq, (uint8_t*)s[!i].seq, &a[!i], tid);
                 n += val;
             }
         #endif
         free(b[0].a); free(b[1].a);     
+        TPROF(SAM_MATESW, tid) += __rdtsc() - tim;
     }
 
     n_pri[0] = mem_mark_primary_se(opt, a[0].n, a[0].a, id<<1|0);
@@ -557,13 +670,13 @@ int mem_sam_pe_batch_pre(const mem_opt_t *opt, const bntseq_t *bns,
                          int32_t &maxRefLen, int32_t &maxQerLen,
                          int tid)
 {
-    //uint8_t *seqBufRef = mmc->seqBufLeftRef[tid*CACHE_LINE];
-    //uint8_t *seqBufQer = mmc->seqBufLeftQer[tid*CACHE_LINE];
-    // int64_t *wsize_buf = &(mmc->wsize_buf[tid]);
+    //uint8_t *seqBufRef = mmc->thr[tid].seqBufLeftRef;
+    //uint8_t *seqBufQer = mmc->thr[tid].seqBufLeftQer;
+    // int64_t *wsize_buf = &(mmc->thr[tid].wsize_buf);
 
-    //SeqPair *seqPairArray = mmc->seqPairArrayLeft128[tid];
-    //int32_t *gar = (int32_t*) (mmc->seqPairArrayAux[tid]);
-    // int64_t *wsize = &(mmc->wsize[tid]);
+    //SeqPair *seqPairArray = mmc->thr[tid].seqPairArrayLeft128;
+    //int32_t *gar = (int32_t*) (mmc->thr[tid].seqPairArrayAux);
+    // int64_t *wsize = &(mmc->thr[tid].wsize);
     
     int i, j, n_aa[2];
     kstring_t str;
@@ -613,10 +726,10 @@ int mem_sam_pe_batch(const mem_opt_t *opt, mem_cache *mmc,
                      int64_t &pcnt, int64_t &pcnt8, kswr_t *aln,
                      int32_t maxRefLen, int32_t maxQerLen, int tid)
 {
-    uint8_t *seqBufRef = mmc->seqBufLeftRef[tid*CACHE_LINE];
-    uint8_t *seqBufQer = mmc->seqBufLeftQer[tid*CACHE_LINE];    
+    uint8_t *seqBufRef = mmc->thr[tid].seqBufLeftRef;
+    uint8_t *seqBufQer = mmc->thr[tid].seqBufLeftQer;    
 
-    SeqPair *seqPairArray = mmc->seqPairArrayLeft128[tid];
+    SeqPair *seqPairArray = mmc->thr[tid].seqPairArrayLeft128;
 
 #if DEBUG    // orig function from bwa-mem -- for debugging purpose. Disabled by default.
     // uint64_t tim = __rdtsc();   
@@ -648,6 +761,11 @@ int mem_sam_pe_batch(const mem_opt_t *opt, mem_cache *mmc,
         seqPairArray[pcnt + MAX_LINE_LEN - 1 - i] = seqPairArray[pcnt-i-1];
     
 #if __AVX512BW__    
+    if (mem_kdump) {
+        mem_kdump_pairs(opt, KD_KSWV8, 0, 0, seqPairArray, pcnt8, seqBufRef, seqBufQer);
+        mem_kdump_pairs(opt, KD_KSWV16, 0, 0, seqPairArray + pcnt8 + MAX_LINE_LEN, pcnt-pcnt8,
+                        seqBufRef, seqBufQer);
+    }
     pwsw->getScores8(seqPairArray, seqBufRef, seqBufQer, aln, pcnt8, nthreads, 0);
     pwsw->getScores16(seqPairArray + pcnt8 + MAX_LINE_LEN, seqBufRef, seqBufQer,
                       aln, pcnt-pcnt8, nthreads, 0);
@@ -697,6 +815,10 @@ int mem_sam_pe_batch(const mem_opt_t *opt, mem_cache *mmc,
     assert(pos8 + pos16 == pcnt2);
 
 #if __AVX512BW__
+    if (mem_kdump) {
+        mem_kdump_pairs(opt, KD_KSWV16, 1, 0, seqPairArray + pos8, pos16, seqBufRef, seqBufQer);
+        mem_kdump_pairs(opt, KD_KSWV8, 1, 0, seqPairArray, pos8, seqBufRef, seqBufQer);
+    }
     pwsw->getScores16(seqPairArray + pos8, seqBufRef, seqBufQer, aln, pos16, nthreads, 1);
     pwsw->getScores8(seqPairArray, seqBufRef, seqBufQer, aln, pos8, nthreads, 1);
 #else
@@ -729,7 +851,7 @@ int mem_sam_pe_batch_post(const mem_opt_t *opt, const bntseq_t *bns,
                                     const uint8_t *pac, uint8_t *query, int n, mem_alnreg_t *a);
     #endif
     
-    int32_t *gar = (int32_t*) mmc->seqPairArrayAux[tid];
+    int32_t *gar = (int32_t*) mmc->thr[tid].seqPairArrayAux;
     
     int n = 0, i, j, z[2], o, subo, n_sub, extra_flag = 1, n_pri[2], n_aa[2];
     kstring_t str;
@@ -937,17 +1059,17 @@ int mem_matesw_batch_pre(const mem_opt_t *opt, const bntseq_t *bns,
                                     const uint8_t *pac, uint8_t *query, int n,
                                     mem_alnreg_t *a);
 
-    uint8_t *seqBufRef = mmc->seqBufLeftRef[tid*CACHE_LINE];
-    uint8_t *seqBufQer = mmc->seqBufLeftQer[tid*CACHE_LINE];
-    SeqPair *seqPairArray = mmc->seqPairArrayLeft128[tid];
-    int32_t *gar = (int32_t*) (mmc->seqPairArrayAux[tid]);
+    uint8_t *seqBufRef = mmc->thr[tid].seqBufLeftRef;
+    uint8_t *seqBufQer = mmc->thr[tid].seqBufLeftQer;
+    SeqPair *seqPairArray = mmc->thr[tid].seqPairArrayLeft128;
+    int32_t *gar = (int32_t*) (mmc->thr[tid].seqPairArrayAux);
 
-    int64_t *wsize_pair = &(mmc->wsize[tid]);
-    int64_t *wsize_buf_ref = &(mmc->wsize_buf_ref[tid*CACHE_LINE]);
-    int64_t *wsize_buf_qer = &(mmc->wsize_buf_qer[tid*CACHE_LINE]);
+    int64_t *wsize_pair = &(mmc->thr[tid].wsize);
+    int64_t *wsize_buf_ref = &(mmc->thr[tid].wsize_buf_ref);
+    int64_t *wsize_buf_qer = &(mmc->thr[tid].wsize_buf_qer);
     
     int64_t l_pac = bns->l_pac;
-    int i, r, skip[4], rid = -1;
+    int i, r, skip[4], rid = -1, flt_s = 0, flt_t;
     for (r = 0; r < 4; ++r)
         skip[r] = pes[r].failed? 1 : 0;
 
@@ -965,6 +1087,7 @@ int mem_matesw_batch_pre(const mem_opt_t *opt, const bntseq_t *bns,
         gar[gcnt + 3] = gar[gcnt + 2] = gar[gcnt + 1] = gar[gcnt + 0] = -1;
         return pcnt;
     }
+    flt_t = mem_matesw_flt_init(opt, l_ms, &flt_s);
         
     for (r = 0; r < 4; ++r)
     {
@@ -998,7 +1121,10 @@ int mem_matesw_batch_pre(const mem_opt_t *opt, const bntseq_t *bns,
         if (re > l_pac<<1) re = l_pac<<1;
         if (rb < re) ref = bns_fetch_seq(bns, pac, &rb, (rb+re)>>1, &re, &rid);
 
-        if (a->rid == rid && re - rb >= opt->min_seed_len) { // no funny things happening
+        if (a->rid == rid && re - rb >= opt->min_seed_len &&
+            mem_matesw_flt_skip(flt_s, flt_t, l_ms, seq, re - rb, ref, tid))
+            gar[gcnt + r] = -2; // dropped by the prefilter
+        else if (a->rid == rid && re - rb >= opt->min_seed_len) { // no funny things happening
             //kswr_t aln;
             //mem_alnreg_t b;
             int xtra = KSW_XSUBO | KSW_XSTART | (l_ms * opt->a < 250? KSW_XBYTE : 0) | (opt->min_seed_len * opt->a);
@@ -1013,8 +1139,6 @@ int mem_matesw_batch_pre(const mem_opt_t *opt, const bntseq_t *bns,
 
             SeqPair sp;
             sp.h0 = xtra;
-            // assert(pcnt < BATCH_SIZE * SEEDS_PER_READ);
-            assert(pcnt < *wsize_pair);
             
             sp.idq = qerOffset;
             sp.idr = refOffset;
@@ -1023,56 +1147,35 @@ int mem_matesw_batch_pre(const mem_opt_t *opt, const bntseq_t *bns,
             sp.id = sp.score = sp.seqid = sp.gtle = sp.tle = sp.qle = sp.max_off = sp.gscore = -1; // not needed, remove while code cleaning
             
             assert(sp.len1 >= 0 && sp.len2 >= 0);
+            TPROF(N_SW_CELLS, tid) += (int64_t) sp.len1 * sp.len2;
             if (refOffset + sp.len1 >= *wsize_buf_ref)
             {
                 fprintf(stderr, "[0000][%0.4d] Re-allocating (doubling) seqBufRefs in %s\n",
                         tid, __func__);
-                int64_t tmp = *wsize_buf_ref;
-                *wsize_buf_ref *= 2;
-
-                uint8_t *seqBufRef_ = (uint8_t*)
-                    _mm_realloc(seqBufRef, tmp, *wsize_buf_ref, sizeof(uint8_t)); 
-                mmc->seqBufLeftRef[tid*CACHE_LINE] = seqBufRef = seqBufRef_;
-
-                seqBufRef_ = (uint8_t*)
-                    _mm_realloc(mmc->seqBufRightRef[tid*CACHE_LINE], tmp,
-                                *wsize_buf_ref, sizeof(uint8_t)); 
-                mmc->seqBufRightRef[tid*CACHE_LINE] = seqBufRef_;               
+                int64_t n = *wsize_buf_ref * 2;
+                mem_resize_seqbuf(mmc, tid, max_(n, refOffset + sp.len1 + 1), *wsize_buf_qer);
+                seqBufRef = mmc->thr[tid].seqBufLeftRef;
             }
             
             if (qerOffset + sp.len2 >= *wsize_buf_qer)
             {
                 fprintf(stderr, "[0000][%0.4d] Re-allocating (doubling) seqBufQers in %s\n",
                         tid, __func__);
-                int64_t tmp = *wsize_buf_qer;
-                *wsize_buf_qer *= 2;
-
-                uint8_t *seqBufQer_ = (uint8_t*)
-                    _mm_realloc(seqBufQer, tmp, *wsize_buf_qer, sizeof(uint8_t)); 
-                mmc->seqBufLeftQer[tid*CACHE_LINE] = seqBufQer = seqBufQer_;
-
-                seqBufQer_ = (uint8_t*)
-                    _mm_realloc(mmc->seqBufRightQer[tid*CACHE_LINE], tmp,
-                                *wsize_buf_qer, sizeof(uint8_t)); 
-                mmc->seqBufRightQer[tid*CACHE_LINE] = seqBufQer_;               
+                int64_t n = *wsize_buf_qer * 2;
+                mem_resize_seqbuf(mmc, tid, *wsize_buf_ref, max_(n, qerOffset + sp.len2 + 1));
+                seqBufQer = mmc->thr[tid].seqBufLeftQer;
             }
             
             if (pcnt >= *wsize_pair)
             {
                 fprintf(stderr, "[0000][%0.4d] Re-allocating seqPairs in %s\n", tid, __func__);
-                *wsize_pair += 1024;
-                mmc->seqPairArrayAux[tid] = (SeqPair *) realloc(mmc->seqPairArrayAux[tid],
-                                                    (*wsize_pair + MAX_LINE_LEN)
-                                                    * sizeof(SeqPair));
-                mmc->seqPairArrayLeft128[tid] = (SeqPair *) realloc(mmc->seqPairArrayLeft128[tid],
-                                                    (*wsize_pair + MAX_LINE_LEN)
-                                                    * sizeof(SeqPair));
-                mmc->seqPairArrayRight128[tid] = (SeqPair *) realloc(mmc->seqPairArrayRight128[tid],
-                                                    (*wsize_pair + MAX_LINE_LEN)
-                                                    * sizeof(SeqPair));
-                seqPairArray = mmc->seqPairArrayLeft128[tid];
-                gar = (int32_t*) (mmc->seqPairArrayAux[tid]);               
+                mem_resize_pairs(mmc, tid, *wsize_pair * 2);
+                seqPairArray = mmc->thr[tid].seqPairArrayLeft128;
+                gar = (int32_t*) (mmc->thr[tid].seqPairArrayAux);               
             }
+            mmc->thr[tid].hw_pairs = max_(mmc->thr[tid].hw_pairs, pcnt + 1);
+            mmc->thr[tid].hw_buf_ref = max_(mmc->thr[tid].hw_buf_ref, refOffset + sp.len1);
+            mmc->thr[tid].hw_buf_qer = max_(mmc->thr[tid].hw_buf_qer, qerOffset + sp.len2);
 
             if (maxRefLen < sp.len1) maxRefLen = sp.len1;
             if (maxQerLen < sp.len2) maxQerLen = sp.len2;
@@ -1172,6 +1275,8 @@ int mem_matesw_batch_post(const mem_opt_t *opt, const bntseq_t *bns,
                                  opt->o_ins, opt->e_ins, xtra, 0);
 
             }
+            else if (index == -2)
+                aln = g_defr; // no hit that would be kept in this window
             else
                 aln = *(*myaln + index);
 
@@ -0,0 +1,112 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "checkpoint.h"
+
+#define CKPT_MAGIC "bwa-mem2 checkpoint 1"
+
+int ckpt_write(const char *fn, const ckpt_t *c)
+{
+    size_t l = strlen(fn);
+    char *tmp = (char *) malloc(l + 5);
+    if (tmp == NULL) return -1;
+    memcpy(tmp, fn, l);
+    strcpy(tmp + l, ".tmp");
+
+    FILE *fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "[E::%s] can't write %s\n", __func__, tmp);
+        free(tmp);
+        return -1;
+    }
+    fprintf(fp, "%s\nin1\t%s\nin2\t%s\nout\t%s\nchunk\t%ld\nreads\t%ld\nout_bytes\t%ld\n",
+            CKPT_MAGIC, c->in1, c->in2, c->out, (long) c->chunk, (long) c->reads,
+            (long) c->out_bytes);
+    int ret = ckpt_sync(fp) < 0? -1 : 0;
+    if (fclose(fp) != 0) ret = -1;
+    if (ret == 0 && rename(tmp, fn) != 0) ret = -1;
+    if (ret < 0) fprintf(stderr, "[E::%s] can't write %s\n", __func__, fn);
+    free(tmp);
+    return ret;
+}
+
+int ckpt_read(const char *fn, ckpt_t *c)
+{
+    FILE *fp = fopen(fn, "r");
+    memset(c, 0, sizeof(ckpt_t));
+    if (fp == NULL) {
+        fprintf(stderr, "[E::%s] can't open the checkpoint %s\n", __func__, fn);
+        return -1;
+    }
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    int n = 0, ok = 0;
+    while ((len = getline(&line, &cap, fp)) >= 0) {
+        if (len > 0 && line[len-1] == '\n') line[--len] = 0;
+        if (n++ == 0) {
+            ok = strcmp(line, CKPT_MAGIC) == 0;
+            if (!ok) break;
+            continue;
+        }
+        char *v = strchr(line, '\t');
+        if (v == NULL) continue;
+        *v++ = 0;
+        if (strcmp(line, "in1") == 0) c->in1 = strdup(v);
+        else if (strcmp(line, "in2") == 0) c->in2 = strdup(v);
+        else if (strcmp(line, "out") == 0) c->out = strdup(v);
+        else if (strcmp(line, "chunk") == 0) c->chunk = atol(v);
+        else if (strcmp(line, "reads") == 0) c->reads = atol(v);
+        else if (strcmp(line, "out_bytes") == 0) c->out_bytes = atol(v), ok |= 2;
+    }
+    free(line);
+    fclose(fp);
+    if (ok != 3 || c->in1 == NULL || c->in2 == NULL || c->out == NULL) {
+        fprintf(stderr, "[E::%s] %s is not a complete checkpoint\n", __func__, fn);
+        ckpt_free(c);
+        return -1;
+    }
+    return 0;
+}
+
+void ckpt_free(ckpt_t *c)
+{
+    free(c->in1); free(c->in2); free(c->out);
+    c->in1 = c->in2 = c->out = NULL;
+}
+
+int64_t ckpt_sync(FILE *fp)
+{
+    if (fflush(fp) != 0 || fsync(fileno(fp)) != 0) return -1;
+    return ftello(fp);
+}
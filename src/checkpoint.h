@@ -0,0 +1,66 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+/*
+ * Checkpoints of a mapping run (mem --checkpoint, --resume).
+ *
+ * After each chunk is written, the output is synced and a small text file
+ * records how many reads have been consumed and the output size at that
+ * point. A resumed run truncates the output to that size, skips the reads
+ * already mapped and continues with the same chunk boundaries and read
+ * numbering, so the output is the same as that of an uninterrupted run.
+ * Insert sizes are inferred per chunk, so no pairing state is carried.
+ */
+
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+typedef struct {
+    char *in1, *in2;     // read files; in2 is "-" for single-end or -p input
+    char *out;           // output SAM
+    int64_t chunk;       // bases per chunk; resuming needs the same value
+    int64_t reads;       // reads consumed (both ends for pairs), = n_processed
+    int64_t out_bytes;   // output size after the last chunk
+} ckpt_t;
+
+/* Writes c to fn through a temporary file and a rename; returns 0 on success */
+int ckpt_write(const char *fn, const ckpt_t *c);
+
+/* Reads fn into c (strings allocated); returns 0 on success */
+int ckpt_read(const char *fn, ckpt_t *c);
+void ckpt_free(ckpt_t *c);
+
+/* Flushes fp to disk; returns its size, or -1 on an error */
+int64_t ckpt_sync(FILE *fp);
+
+#endif
@@ -0,0 +1,172 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "chunksize.h"
+#include "macro.h"
+#include "profiling.h"
+
+#define CS_MAGIC "#bwa-mem2-chunks"
+
+struct chunk_ctl_t {
+    int64_t size;              // of the next chunk; written by cs_update, read by cs_next
+    int64_t min, max;
+    int adapt;
+    // adaptive: the rate at the last size measured and the direction of the last move
+    int64_t last_size;
+    double last_rate;
+    int dir, back, peaked, n_held, n_probe;
+    // of the chunks read
+    int64_t n_change, lo, hi, prev;
+    // replay and log
+    int64_t *sizes, n_sizes, i;
+    FILE *log;
+};
+
+chunk_ctl_t *cs_init(int64_t size, int64_t min, int64_t max, int adapt)
+{
+    chunk_ctl_t *c = (chunk_ctl_t *) calloc(1, sizeof(chunk_ctl_t));
+    assert(c != NULL);
+    if (min > max) min = max;
+    c->size = size < min? min : size > max? max : size;
+    c->min = min, c->max = max, c->adapt = adapt;
+    return c;
+}
+
+void cs_destroy(chunk_ctl_t *c)
+{
+    if (c == NULL) return;
+    if (c->log) fclose(c->log);
+    free(c->sizes);
+    free(c);
+}
+
+int cs_log(chunk_ctl_t *c, const char *fn)
+{
+    if ((c->log = fopen(fn, "w")) == NULL) return -1;
+    fprintf(c->log, CS_MAGIC "\n");
+    return 0;
+}
+
+int cs_replay(chunk_ctl_t *c, const char *fn)
+{
+    FILE *fp = fopen(fn, "r");
+    if (fp == NULL) return -1;
+    char line[64];
+    int64_t m = 0;
+    int ok = fgets(line, sizeof(line), fp) != NULL && strncmp(line, CS_MAGIC, strlen(CS_MAGIC)) == 0;
+    while (ok && fgets(line, sizeof(line), fp)) {
+        char *p;
+        long x = strtol(line, &p, 10);
+        if (p == line || x <= 0 || (*p != '\n' && *p != '\0')) { ok = 0; break; }
+        if (c->n_sizes == m) {
+            m = m? m << 1 : 64;
+            c->sizes = (int64_t *) realloc(c->sizes, m * sizeof(int64_t));
+            assert(c->sizes != NULL);
+        }
+        c->sizes[c->n_sizes++] = x;
+    }
+    fclose(fp);
+    if (!ok || c->n_sizes == 0) return -1;
+    c->adapt = 0;
+    return 0;
+}
+
+int64_t cs_next(chunk_ctl_t *c)
+{
+    if (c->n_sizes > 0)
+        return c->sizes[c->i < c->n_sizes? c->i : c->n_sizes - 1];
+    return __atomic_load_n(&c->size, __ATOMIC_RELAXED);
+}
+
+void cs_record(chunk_ctl_t *c, int64_t size)
+{
+    if (c->i++ == 0) c->lo = c->hi = size;
+    else if (size != c->prev) c->n_change++;
+    if (size < c->lo) c->lo = size;
+    if (size > c->hi) c->hi = size;
+    c->prev = size;
+    if (c->log) {
+        fprintf(c->log, "%ld\n", (long) size);
+        fflush(c->log);
+    }
+}
+
+void cs_update(chunk_ctl_t *c, int64_t size, int64_t bp, uint64_t cycles, double idle)
+{
+    // the last, short chunk says little; a chunk read before the last change
+    // took effect is measured at the previous size
+    if (!c->adapt || bp < size / 2 || cycles == 0 || size != c->size) return;
+    double rate = (double) bp / cycles;
+
+    if (c->last_size == 0) c->dir = 1;
+    else if (c->back) c->dir = c->back = 0;   // back at the better size: stay
+    else if (c->last_size != size) {
+        int move = size > c->last_size? 1 : -1;
+        if (rate > c->last_rate * (1 + CS_NOISE)) c->dir = move;
+        else if (rate < c->last_rate * (1 - CS_NOISE)) {
+            c->dir = -move, c->back = 1;
+            if (move > 0) c->peaked = 1;
+        }
+        else c->dir = 0;
+    }
+    else if (c->dir == 0 && ++c->n_held >= CS_REPROBE) {
+        // settled; the reads or the machine may have changed since
+        c->dir = c->n_probe++ & 1? -1 : 1;
+    }
+    // threads waiting at the barriers: each needs more batches per phase, until
+    // a larger chunk has been measured to be slower
+    if (idle > CS_IDLE_HI && !c->peaked) c->dir = 1;
+
+    // at a held size the rate is smoothed, so that a probe is not judged against one outlier
+    c->last_rate = c->last_size == size? (c->last_rate + rate) / 2 : rate;
+    c->last_size = size;
+    int64_t next = c->dir > 0? (int64_t) (size * CS_GROW) : c->dir < 0? (int64_t) (size / CS_GROW) : size;
+    if (next < c->min) next = c->min;
+    if (next > c->max) next = c->max;
+    fprintf(stderr, "[M::%s] %ld bp in %.3f sec (%.2f Mbp/s), compute threads %.0f%% idle; "
+            "next chunks of %ld bp\n", __func__, (long) bp, (double) cycles / proc_freq,
+            rate * proc_freq / 1e6, idle * 100, (long) next);
+    if (next == size) {
+        c->dir = 0;
+        return;
+    }
+    c->n_held = 0;
+    __atomic_store_n(&c->size, next, __ATOMIC_RELAXED);
+}
+
+void cs_stats(const chunk_ctl_t *c, int64_t *n_change, int64_t *lo, int64_t *hi)
+{
+    *n_change = c->n_change, *lo = c->lo, *hi = c->hi;
+}
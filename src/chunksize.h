@@ -0,0 +1,83 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+/*
+ * Chunk sizing of the mapping pipeline (mem --adaptive-chunk, --chunk-log,
+ * --chunk-replay).
+ *
+ * A fixed chunk size (-K) is a trade-off: small chunks spend their time
+ * starting the kt_for threads and waiting at the barriers between the
+ * phases, large ones hold more memory and delay the first output. With
+ * --adaptive-chunk the size is steered between chunks by hill climbing on
+ * the measured mapping rate (bases per second of step 1), moved towards
+ * larger chunks while the compute threads are idle for a large share of the
+ * phases, and kept within the --max-mem budget.
+ *
+ * Insert sizes are inferred per chunk, so the output of paired-end reads
+ * depends on the chunk boundaries. The sizes used are written by
+ * --chunk-log and read back by --chunk-replay, which reproduces the chunking,
+ * and so the output, of an earlier run without measuring anything.
+ */
+
+#ifndef _CHUNKSIZE_H
+#define _CHUNKSIZE_H
+
+#include <stdint.h>
+
+#define CS_GROW      1.5    /* factor of a step of the adaptive size */
+#define CS_NOISE     0.03   /* rate changes below this fraction are noise */
+#define CS_IDLE_HI   0.15   /* barrier idle fraction above which chunks grow */
+#define CS_REPROBE   8      /* chunks at a settled size before probing again */
+#define CS_MAX_MUL   4      /* largest adaptive chunk, in default chunks */
+
+typedef struct chunk_ctl_t chunk_ctl_t;
+
+/* size: first chunk (bp); the adaptive size stays within [min, max]. adapt 0
+   keeps size, which a replay then overrides */
+chunk_ctl_t *cs_init(int64_t size, int64_t min, int64_t max, int adapt);
+void cs_destroy(chunk_ctl_t *c);
+
+/* Chunk sizes are appended to fn (--chunk-log) or taken from it in order
+   (--chunk-replay; then the last one); return 0 on success */
+int cs_log(chunk_ctl_t *c, const char *fn);
+int cs_replay(chunk_ctl_t *c, const char *fn);
+
+/* Size of the next chunk to read; record its size once read, if not the end */
+int64_t cs_next(chunk_ctl_t *c);
+void cs_record(chunk_ctl_t *c, int64_t size);
+
+/* Chunk read with the size asked for: bp bases mapped in cycles, with the
+   compute threads idle for an idle fraction of them */
+void cs_update(chunk_ctl_t *c, int64_t size, int64_t bp, uint64_t cycles, double idle);
+
+/* Size changes between the chunks read so far, and the smallest and largest */
+void cs_stats(const chunk_ctl_t *c, int64_t *n_change, int64_t *lo, int64_t *hi);
+
+#endif
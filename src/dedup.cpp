@@ -0,0 +1,269 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "dedup.h"
+#include "memsize.h"
+#include "khash.h"
+
+KHASH_MAP_INIT_INT64(dd, int64_t)
+
+extern unsigned char nst_nt4_table[256];
+
+typedef struct {
+    uint64_t h;
+    int k, l[2];          // reads and their lengths
+    uint8_t *key;         // the 2-bit reads, concatenated
+    mem_alnreg_v r[2];
+} dd_entry_t;
+
+struct mem_dedup_t {
+    // last collapse, per unit (a read, or a pair)
+    int n, k, m;
+    int *from;            // >= 0: aligned unit; < 0: -1 - cache entry
+    uint8_t *first;       // first of its sequence in the chunk
+    uint64_t *h;
+    bseq1_t *useqs;
+    int m_useqs;
+    int64_t hits, xhits;
+    khash_t(dd) *chunk;   // hash -> first unit
+
+    // across chunks
+    int64_t max_cached, n_ent, next;
+    dd_entry_t *ent;
+    khash_t(dd) *cache;   // hash -> entry
+};
+
+#define DD_M 0x100000001b3ULL
+
+static uint64_t dd_hash(const bseq1_t *s, int k)
+{
+    uint64_t h = 0xcbf29ce484222325ULL ^ k;
+    for (int j = 0; j < k; j++) {
+        const uint8_t *p = (const uint8_t *) s[j].seq;
+        int l = s[j].l_seq, i;
+        h = (h ^ (uint64_t) l) * DD_M;
+        for (i = 0; i + 8 <= l; i += 8) {
+            uint64_t x;
+            memcpy(&x, p + i, 8);
+            h = (h ^ x) * DD_M;
+            h ^= h >> 29;
+        }
+        for (; i < l; i++)
+            h = (h ^ p[i]) * DD_M;
+    }
+    return h;
+}
+
+static int dd_same(const bseq1_t *a, const bseq1_t *b, int k)
+{
+    for (int j = 0; j < k; j++)
+        if (a[j].l_seq != b[j].l_seq || memcmp(a[j].seq, b[j].seq, a[j].l_seq) != 0)
+            return 0;
+    return 1;
+}
+
+static int dd_entry_same(const dd_entry_t *e, const bseq1_t *s, int k)
+{
+    if (e->k != k) return 0;
+    const uint8_t *key = e->key;
+    for (int j = 0; j < k; j++) {
+        if (e->l[j] != s[j].l_seq || memcmp(key, s[j].seq, s[j].l_seq) != 0) return 0;
+        key += s[j].l_seq;
+    }
+    return 1;
+}
+
+static int64_t dd_copy(mem_alnreg_v *dst, const mem_alnreg_v *src)
+{
+    dst->n = dst->m = src->n;
+    dst->a = NULL;
+    if (src->n > 0) {
+        dst->a = (mem_alnreg_t *) malloc(src->n * sizeof(mem_alnreg_t));
+        assert(dst->a != NULL);
+        memcpy(dst->a, src->a, src->n * sizeof(mem_alnreg_t));
+    }
+    return src->n * sizeof(mem_alnreg_t);
+}
+
+static void dd_entry_free(dd_entry_t *e)
+{
+    int64_t bytes = e->l[0] + e->l[1];
+    for (int j = 0; j < e->k; j++) {
+        bytes += e->r[j].n * sizeof(mem_alnreg_t);
+        free(e->r[j].a);
+    }
+    free(e->key);
+    msz_add(MSZ_CHAIN, -bytes);
+}
+
+mem_dedup_t *mem_dedup_init(int64_t max_cached)
+{
+    mem_dedup_t *d = (mem_dedup_t *) calloc(1, sizeof(mem_dedup_t));
+    assert(d != NULL);
+    d->chunk = kh_init(dd);
+    d->max_cached = max_cached;
+    if (max_cached > 0) {
+        d->cache = kh_init(dd);
+        d->ent = (dd_entry_t *) calloc(max_cached, sizeof(dd_entry_t));
+        assert(d->ent != NULL);
+    }
+    return d;
+}
+
+void mem_dedup_destroy(mem_dedup_t *d)
+{
+    if (d == NULL) return;
+    for (int64_t e = 0; e < d->n_ent; e++)
+        dd_entry_free(&d->ent[e]);
+    free(d->ent);
+    if (d->cache) kh_destroy(dd, d->cache);
+    kh_destroy(dd, d->chunk);
+    free(d->from);
+    free(d->first);
+    free(d->h);
+    free(d->useqs);
+    free(d);
+}
+
+int mem_dedup_collapse(mem_dedup_t *d, int n, bseq1_t *seqs, int pe, bseq1_t **useqs)
+{
+    int k = pe? 2 : 1, nu = n / k, nc = 0;
+    d->n = n, d->k = k, d->hits = d->xhits = 0;
+    if (nu > d->m) {
+        d->m = nu;
+        d->from = (int *) realloc(d->from, nu * sizeof(int));
+        d->first = (uint8_t *) realloc(d->first, nu);
+        d->h = (uint64_t *) realloc(d->h, nu * sizeof(uint64_t));
+        assert(d->from != NULL && d->first != NULL && d->h != NULL);
+    }
+    if (n > d->m_useqs) {
+        d->m_useqs = n;
+        d->useqs = (bseq1_t *) realloc(d->useqs, n * sizeof(bseq1_t));
+        assert(d->useqs != NULL);
+    }
+
+    // the same conversion as mem_kernel1_core(), which then leaves the reads as they are
+    for (int i = 0; i < n; i++) {
+        char *seq = seqs[i].seq;
+        for (int j = 0; j < seqs[i].l_seq; j++)
+            seq[j] = seq[j] < 4? seq[j] : nst_nt4_table[(int) seq[j]];
+    }
+
+    kh_clear(dd, d->chunk);
+    for (int u = 0; u < nu; u++) {
+        bseq1_t *s = seqs + u * k;
+        int absent;
+        d->h[u] = dd_hash(s, k);
+        khint_t it = kh_put(dd, d->chunk, d->h[u], &absent);
+        if (!absent) {
+            int u0 = (int) kh_val(d->chunk, it);
+            if (dd_same(seqs + u0 * k, s, k)) {
+                d->from[u] = d->from[u0], d->first[u] = 0;
+                d->hits += k;
+                if (d->from[u] < 0) d->xhits += k;
+                continue;
+            }
+            // a hash collision: the read stays unique and the table keeps the first
+        } else kh_val(d->chunk, it) = u;
+
+        d->first[u] = 1;
+        if (d->cache) {
+            it = kh_get(dd, d->cache, d->h[u]);
+            if (it != kh_end(d->cache) && dd_entry_same(&d->ent[kh_val(d->cache, it)], s, k)) {
+                d->from[u] = -1 - (int) kh_val(d->cache, it);
+                d->hits += k, d->xhits += k;
+                continue;
+            }
+        }
+        d->from[u] = nc;
+        memcpy(d->useqs + nc * k, s, k * sizeof(bseq1_t));
+        nc++;
+    }
+    *useqs = d->useqs;
+    return nc * k;
+}
+
+void mem_dedup_expand(mem_dedup_t *d, mem_alnreg_v *regs)
+{
+    int k = d->k, nu = d->n / k;
+    // from the end: the aligned unit f of u is at most u, and slot u is free once the
+    // unit aligned there has moved to its own place (it is never after its duplicates)
+    for (int u = nu - 1; u >= 0; u--) {
+        int f = d->from[u];
+        for (int j = 0; j < k; j++) {
+            mem_alnreg_v *dst = &regs[u * k + j];
+            if (f < 0) dd_copy(dst, &d->ent[-1 - f].r[j]);
+            else if (f == u) continue;
+            else if (d->first[u]) *dst = regs[f * k + j];
+            else dd_copy(dst, &regs[f * k + j]);
+        }
+    }
+    if (d->cache == NULL) return;
+
+    for (int u = 0; u < nu; u++) {
+        if (!d->first[u] || d->from[u] < 0) continue;
+        if (kh_get(dd, d->cache, d->h[u]) != kh_end(d->cache)) continue;   // a collision
+        int64_t e;
+        if (d->n_ent < d->max_cached) e = d->n_ent++;
+        else {  // evict the oldest
+            e = d->next;
+            d->next = (d->next + 1) % d->max_cached;
+            khint_t it = kh_get(dd, d->cache, d->ent[e].h);
+            if (it != kh_end(d->cache) && kh_val(d->cache, it) == e) kh_del(dd, d->cache, it);
+            dd_entry_free(&d->ent[e]);
+        }
+        dd_entry_t *p = &d->ent[e];
+        const bseq1_t *s = d->useqs + d->from[u] * k;
+        int64_t bytes = 0;
+        p->h = d->h[u], p->k = k, p->l[0] = p->l[1] = 0;
+        for (int j = 0; j < k; j++) p->l[j] = s[j].l_seq, bytes += s[j].l_seq;
+        p->key = (uint8_t *) malloc(bytes);
+        assert(p->key != NULL);
+        for (int j = 0, off = 0; j < k; off += s[j].l_seq, j++)
+            memcpy(p->key + off, s[j].seq, s[j].l_seq);
+        for (int j = 0; j < k; j++)
+            bytes += dd_copy(&p->r[j], &regs[u * k + j]);
+        msz_add(MSZ_CHAIN, bytes);
+        int absent;
+        khint_t it = kh_put(dd, d->cache, p->h, &absent);
+        kh_val(d->cache, it) = e;
+    }
+}
+
+void mem_dedup_counts(const mem_dedup_t *d, int64_t *n, int64_t *hits, int64_t *xhits)
+{
+    *n = d->n / d->k * d->k;
+    *hits = d->hits;
+    *xhits = d->xhits;
+}
@@ -0,0 +1,67 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+/*
+ * Exact-duplicate read cache (mem --dedup).
+ *
+ * Before seeding, the reads of a chunk are hashed on their 2-bit sequence
+ * (both ends for pairs) and only the first of each set of identical reads
+ * or pairs is seeded and extended; the others receive a copy of its
+ * alignment regions. Pairing, mapping quality and SAM formatting still run
+ * per read, so the output is the same as without the cache. With a
+ * capacity (--dedup-cache) the regions of representatives are also kept
+ * across chunks, evicting the oldest entry first.
+ */
+
+#ifndef _DEDUP_H
+#define _DEDUP_H
+
+#include <stdint.h>
+#include "bwa.h"
+#include "bwamem.h"
+
+typedef struct mem_dedup_t mem_dedup_t;
+
+/* max_cached: reads or pairs kept across chunks; 0 collapses within a chunk only */
+mem_dedup_t *mem_dedup_init(int64_t max_cached);
+void mem_dedup_destroy(mem_dedup_t *d);
+
+/* Converts the n reads to 2-bit and collapses them; pe: units are pairs.
+   Returns the number of reads left to align, placed in *useqs. */
+int mem_dedup_collapse(mem_dedup_t *d, int n, bseq1_t *seqs, int pe, bseq1_t **useqs);
+
+/* Spreads the regions of the aligned reads, regs[0..returned n), to all n
+   reads of the last collapse; keeps new representatives across chunks */
+void mem_dedup_expand(mem_dedup_t *d, mem_alnreg_v *regs);
+
+/* Reads of the last collapse: looked up, reused, reused from earlier chunks */
+void mem_dedup_counts(const mem_dedup_t *d, int64_t *n, int64_t *hits, int64_t *xhits);
+
+#endif
@@ -32,17 +32,17 @@ Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@i
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <getopt.h>
 #if NUMA_ENABLED
 #include <numa.h>
 #endif
-#include <sstream>
 #include "fastmap.h"
 #include "FMI_search.h"
+#include "affinity.h"
+#include "dedup.h"
+#include "chunksize.h"
+#include "tune.h"
 
-#if AFF && (__linux__)
-#include <sys/sysinfo.h>
-int affy[256];
-#endif
 
 // --------------
 extern uint64_t tprof[LIM_R][LIM_C];
@@ -96,93 +96,183 @@ int HTStatus()
 }
 
 
-/*** Memory pre-allocations ***/
-void memoryAlloc(ktp_aux_t *aux, worker_t &w, int32_t nreads, int32_t nthreads)
+/*** Memory pre-allocations, sized by msz_plan() from the first chunk ***/
+void memoryAlloc(ktp_aux_t *aux, worker_t &w, const mem_plan_t *plan, int32_t nthreads)
 {
-    mem_opt_t *opt = aux->opt;  
-    int32_t memSize = nreads;
-    int32_t readLen = READ_LEN;
+    int32_t memSize = plan->nreads;
+    int32_t readLen = plan->read_len;
 
     /* Mem allocation section for core kernels */
+    w.nreads = memSize;
+    w.seeds_per_read = plan->seeds_per_read;
     w.regs = NULL; w.chain_ar = NULL; w.seedBuf = NULL;
 
     w.regs = (mem_alnreg_v *) calloc(memSize, sizeof(mem_alnreg_v));
     w.chain_ar = (mem_chain_v*) malloc (memSize * sizeof(mem_chain_v));
-    w.seedBuf = (mem_seed_t *) calloc(sizeof(mem_seed_t),  memSize * AVG_SEEDS_PER_READ);
+    w.seedBuf = (mem_seed_t *) calloc(sizeof(mem_seed_t),  (int64_t) memSize * w.seeds_per_read);
 
     assert(w.seedBuf  != NULL);
     assert(w.regs     != NULL);
     assert(w.chain_ar != NULL);
 
-    w.seedBufSize = BATCH_SIZE * AVG_SEEDS_PER_READ;
+    w.seedBufSize = mem_tune.batch * w.seeds_per_read;
 
     /*** printing ***/
-    int64_t allocMem = memSize * sizeof(mem_alnreg_v) +
-        memSize * sizeof(mem_chain_v) +
-        sizeof(mem_seed_t) * memSize * AVG_SEEDS_PER_READ;
+    int64_t allocMem = msz_chain_bytes(memSize, w.seeds_per_read);
+    msz_add(MSZ_CHAIN, allocMem);
     fprintf(stderr, "------------------------------------------\n");
+    fprintf(stderr, "* Sized for %d bp reads, %d reads per chunk\n", readLen, memSize);
     fprintf(stderr, "1. Memory pre-allocation for Chaining: %0.4lf MB\n", allocMem/1e6);
 
     
+    w.mmc.thr = (mem_thread_cache *) _mm_malloc(nthreads * sizeof(mem_thread_cache), 64);
+    assert(w.mmc.thr != NULL);
+    memset(w.mmc.thr, 0, nthreads * sizeof(mem_thread_cache));
+
     /* SWA mem allocation */
-    int64_t wsize = BATCH_SIZE * SEEDS_PER_READ;
+    int64_t wsize = plan->wsize;
     for(int l=0; l<nthreads; l++)
     {
-        w.mmc.seqBufLeftRef[l*CACHE_LINE]  = (uint8_t *)
-            _mm_malloc(wsize * MAX_SEQ_LEN_REF * sizeof(int8_t) + MAX_LINE_LEN, 64);
-        w.mmc.seqBufLeftQer[l*CACHE_LINE]  = (uint8_t *)
-            _mm_malloc(wsize * MAX_SEQ_LEN_QER * sizeof(int8_t) + MAX_LINE_LEN, 64);
-        w.mmc.seqBufRightRef[l*CACHE_LINE] = (uint8_t *)
-            _mm_malloc(wsize * MAX_SEQ_LEN_REF * sizeof(int8_t) + MAX_LINE_LEN, 64);
-        w.mmc.seqBufRightQer[l*CACHE_LINE] = (uint8_t *)
-            _mm_malloc(wsize * MAX_SEQ_LEN_QER * sizeof(int8_t) + MAX_LINE_LEN, 64);
+        w.mmc.thr[l].seqBufLeftRef  = (uint8_t *)
+            _mm_malloc(plan->wsize_buf_ref * sizeof(int8_t) + MAX_LINE_LEN, 64);
+        w.mmc.thr[l].seqBufLeftQer  = (uint8_t *)
+            _mm_malloc(plan->wsize_buf_qer * sizeof(int8_t) + MAX_LINE_LEN, 64);
+        w.mmc.thr[l].seqBufRightRef = (uint8_t *)
+            _mm_malloc(plan->wsize_buf_ref * sizeof(int8_t) + MAX_LINE_LEN, 64);
+        w.mmc.thr[l].seqBufRightQer = (uint8_t *)
+            _mm_malloc(plan->wsize_buf_qer * sizeof(int8_t) + MAX_LINE_LEN, 64);
         
-        w.mmc.wsize_buf_ref[l*CACHE_LINE] = wsize * MAX_SEQ_LEN_REF;
-        w.mmc.wsize_buf_qer[l*CACHE_LINE] = wsize * MAX_SEQ_LEN_QER;
+        w.mmc.thr[l].wsize_buf_ref = plan->wsize_buf_ref;
+        w.mmc.thr[l].wsize_buf_qer = plan->wsize_buf_qer;
         
-        assert(w.mmc.seqBufLeftRef[l*CACHE_LINE]  != NULL);
-        assert(w.mmc.seqBufLeftQer[l*CACHE_LINE]  != NULL);
-        assert(w.mmc.seqBufRightRef[l*CACHE_LINE] != NULL);
-        assert(w.mmc.seqBufRightQer[l*CACHE_LINE] != NULL);
+        assert(w.mmc.thr[l].seqBufLeftRef  != NULL);
+        assert(w.mmc.thr[l].seqBufLeftQer  != NULL);
+        assert(w.mmc.thr[l].seqBufRightRef != NULL);
+        assert(w.mmc.thr[l].seqBufRightQer != NULL);
     }
     
     for(int l=0; l<nthreads; l++) {
-        w.mmc.seqPairArrayAux[l]      = (SeqPair *) malloc((wsize + MAX_LINE_LEN)* sizeof(SeqPair));
-        w.mmc.seqPairArrayLeft128[l]  = (SeqPair *) malloc((wsize + MAX_LINE_LEN)* sizeof(SeqPair));
-        w.mmc.seqPairArrayRight128[l] = (SeqPair *) malloc((wsize + MAX_LINE_LEN)* sizeof(SeqPair));
-        w.mmc.wsize[l] = wsize;
-
-        assert(w.mmc.seqPairArrayAux[l] != NULL);
-        assert(w.mmc.seqPairArrayLeft128[l] != NULL);
-        assert(w.mmc.seqPairArrayRight128[l] != NULL);
+        w.mmc.thr[l].seqPairArrayAux      = (SeqPair *) malloc((wsize + MAX_LINE_LEN)* sizeof(SeqPair));
+        w.mmc.thr[l].seqPairArrayLeft128  = (SeqPair *) malloc((wsize + MAX_LINE_LEN)* sizeof(SeqPair));
+        w.mmc.thr[l].seqPairArrayRight128 = (SeqPair *) malloc((wsize + MAX_LINE_LEN)* sizeof(SeqPair));
+        w.mmc.thr[l].wsize = wsize;
+
+        assert(w.mmc.thr[l].seqPairArrayAux != NULL);
+        assert(w.mmc.thr[l].seqPairArrayLeft128 != NULL);
+        assert(w.mmc.thr[l].seqPairArrayRight128 != NULL);
     }   
 
 
-    allocMem = (wsize * MAX_SEQ_LEN_REF * sizeof(int8_t) + MAX_LINE_LEN) * opt->n_threads * 2+
-        (wsize * MAX_SEQ_LEN_QER * sizeof(int8_t) + MAX_LINE_LEN) * opt->n_threads  * 2 +       
-        wsize * sizeof(SeqPair) * opt->n_threads * 3;   
+    allocMem = ((plan->wsize_buf_ref + MAX_LINE_LEN) * 2 +
+                (plan->wsize_buf_qer + MAX_LINE_LEN) * 2 +
+                (wsize + MAX_LINE_LEN) * sizeof(SeqPair) * 3) * nthreads;
+    msz_add(MSZ_BSW, allocMem);
     fprintf(stderr, "2. Memory pre-allocation for BSW: %0.4lf MB\n", allocMem/1e6);
 
     for (int l=0; l<nthreads; l++)
     {
-        w.mmc.wsize_mem[l]     = BATCH_MUL * BATCH_SIZE *               readLen;
-        w.mmc.matchArray[l]    = (SMEM *) _mm_malloc(w.mmc.wsize_mem[l] * sizeof(SMEM), 64);
-        w.mmc.min_intv_ar[l]   = (int32_t *) malloc(w.mmc.wsize_mem[l] * sizeof(int32_t));
-        w.mmc.query_pos_ar[l]  = (int16_t *) malloc(w.mmc.wsize_mem[l] * sizeof(int16_t));
-        w.mmc.enc_qdb[l]       = (uint8_t *) malloc(w.mmc.wsize_mem[l] * sizeof(uint8_t));
-        w.mmc.rid[l]           = (int32_t *) malloc(w.mmc.wsize_mem[l] * sizeof(int32_t));
-        w.mmc.lim[l]           = (int32_t *) _mm_malloc((BATCH_SIZE + 32) * sizeof(int32_t), 64); // candidate not for reallocation, deferred for next round of changes.
-    }
-
-    allocMem = nthreads * BATCH_MUL * BATCH_SIZE * readLen * sizeof(SMEM) +
-        nthreads * BATCH_MUL * BATCH_SIZE * readLen *sizeof(int32_t) +
-        nthreads * BATCH_MUL * BATCH_SIZE * readLen *sizeof(int16_t) +
-        nthreads * BATCH_MUL * BATCH_SIZE * readLen *sizeof(int32_t) +
-        nthreads * (BATCH_SIZE + 32) * sizeof(int32_t);
+        w.mmc.thr[l].wsize_mem     = plan->wsize_mem;
+        w.mmc.thr[l].matchArray    = (SMEM *) _mm_malloc(w.mmc.thr[l].wsize_mem * sizeof(SMEM), 64);
+        w.mmc.thr[l].min_intv_ar   = (int32_t *) malloc(w.mmc.thr[l].wsize_mem * sizeof(int32_t));
+        w.mmc.thr[l].query_pos_ar  = (int16_t *) malloc(w.mmc.thr[l].wsize_mem * sizeof(int16_t));
+        w.mmc.thr[l].enc_qdb       = (uint8_t *) malloc(w.mmc.thr[l].wsize_mem * sizeof(uint8_t));
+        w.mmc.thr[l].rid           = (int32_t *) malloc(w.mmc.thr[l].wsize_mem * sizeof(int32_t));
+        w.mmc.thr[l].lim           = (int32_t *) _mm_malloc((mem_tune.batch + 32) * sizeof(int32_t), 64); // candidate not for reallocation, deferred for next round of changes.
+    }
+
+    allocMem = nthreads * plan->wsize_mem *
+        (sizeof(SMEM) + 2 * sizeof(int32_t) + sizeof(int16_t) + sizeof(uint8_t)) +
+        nthreads * (mem_tune.batch + 32) * sizeof(int32_t);
+    msz_add(MSZ_SMEM, allocMem);
     fprintf(stderr, "3. Memory pre-allocation for BWT: %0.4lf MB\n", allocMem/1e6);
     fprintf(stderr, "------------------------------------------\n");
 }
 
+/* Size the per-read chain buffers and, on the first chunk, the kernel
+   buffers for a chunk of n reads. */
+void memoryFit(ktp_aux_t *aux, worker_t &w, const bseq1_t *seqs, int n, int band)
+{
+    if (w.mmc.thr == NULL)
+    {
+        /* First chunk: size the buffers from its reads */
+        mem_plan_t plan;
+        int64_t n_bp = 0;
+        for (int i = 0; i < n; ++i) n_bp += seqs[i].l_seq;
+        msz_plan(&plan, n, n_bp, band);
+        memoryAlloc(aux, w, &plan, w.nthreads);
+    }
+    else if (w.nreads < n)
+    {
+        fprintf(stderr, "[0000] Reallocating initial memory allocations!!\n");
+        int64_t old = msz_chain_bytes(w.nreads, w.seeds_per_read);
+        free(w.regs); free(w.chain_ar); free(w.seedBuf);
+        w.nreads = n + n / 8;
+        w.regs = (mem_alnreg_v *) calloc(w.nreads, sizeof(mem_alnreg_v));
+        w.chain_ar = (mem_chain_v*) malloc (w.nreads * sizeof(mem_chain_v));
+        w.seedBuf = (mem_seed_t *) calloc(sizeof(mem_seed_t), (int64_t) w.nreads * w.seeds_per_read);
+        assert(w.regs != NULL); assert(w.chain_ar != NULL); assert(w.seedBuf != NULL);
+        msz_add(MSZ_CHAIN, msz_chain_bytes(w.nreads, w.seeds_per_read) - old);
+        tprof[N_REALLOC][0]++;
+        tr_instant(TR_SELF, TR_REALLOC_CHAIN, w.nreads, 0);
+    }
+}
+
+/* After the first chunk, fit every thread's kernel buffers to the largest
+   batch seen, with a quarter of headroom. Threads that have not met such a
+   batch yet are grown now rather than each reallocating later, and what the
+   read-length estimate over-provisioned is given back. */
+void memoryRefit(worker_t &w, int32_t nthreads)
+{
+    int64_t pairs = 0, buf_ref = 0, buf_qer = 0, smem = 0, seeds = 0;
+    for (int l = 0; l < nthreads; l++) {
+        mem_thread_cache *c = &w.mmc.thr[l];
+        if (c->hw_pairs > pairs) pairs = c->hw_pairs;
+        if (c->hw_buf_ref > buf_ref) buf_ref = c->hw_buf_ref;
+        if (c->hw_buf_qer > buf_qer) buf_qer = c->hw_buf_qer;
+        if (c->hw_mem > smem) smem = c->hw_mem;
+        if (c->hw_seeds > seeds) seeds = c->hw_seeds;
+    }
+    if (smem == 0) return;  // no batch was mapped
+
+    pairs += pairs / 4 + mem_tune.batch;
+    buf_ref += buf_ref / 4 + mem_tune.batch * MAX_SEQ_LEN_REF;
+    buf_qer += buf_qer / 4 + mem_tune.batch * MAX_SEQ_LEN_QER;
+    smem += smem / 4 + 1;
+    seeds += seeds / 4 + 1;
+
+#define REFIT(cap, need) ((cap) < (need) || (cap) > 2 * (need))
+    for (int l = 0; l < nthreads; l++) {
+        mem_thread_cache *c = &w.mmc.thr[l];
+        if (REFIT(c->wsize, pairs)) mem_resize_pairs(&w.mmc, l, pairs);
+        if (REFIT(c->wsize_buf_ref, buf_ref) || REFIT(c->wsize_buf_qer, buf_qer))
+            mem_resize_seqbuf(&w.mmc, l, buf_ref, buf_qer);
+        if (REFIT(c->wsize_mem, smem)) mem_resize_smem(&w.mmc, l, smem);
+    }
+    if (REFIT(w.seeds_per_read, seeds)) {
+        free(w.seedBuf);
+        w.seedBuf = (mem_seed_t *) calloc(sizeof(mem_seed_t), (int64_t) w.nreads * seeds);
+        assert(w.seedBuf != NULL);
+        msz_add(MSZ_CHAIN, msz_chain_bytes(w.nreads, seeds) -
+                msz_chain_bytes(w.nreads, w.seeds_per_read));
+        w.seeds_per_read = seeds;
+        w.seedBufSize = mem_tune.batch * seeds;
+    }
+#undef REFIT
+
+    fprintf(stderr, "* Buffers fitted to the first chunk: %d seeds/read; per thread "
+            "%ld BSW pairs, %ld SMEMs (%0.2lf MB)\n", w.seeds_per_read, (long) pairs,
+            (long) smem, (msz_cur(MSZ_BSW) + msz_cur(MSZ_SMEM)) / 1e6 / nthreads);
+}
+
+/* Time of the compute threads in the kt_for phases; the rest of the phases is idle */
+static uint64_t worker_busy(int nthreads)
+{
+    uint64_t t = 0;
+    for (int i = 0; i < nthreads; i++)
+        t += TPROF(WORKER_BWT, i) + TPROF(WORKER_ALN, i) + TPROF(WORKER_SAM, i);
+    return t;
+}
+
 ktp_data_t *kt_pipeline(void *shared, int step, void *data, mem_opt_t *opt, worker_t &w)
 {
     ktp_aux_t *aux = (ktp_aux_t*) shared;
@@ -192,19 +282,37 @@ ktp_data_t *kt_pipeline(void *shared, int step, void *data, mem_opt_t *opt, work
     {
         ktp_data_t *ret = (ktp_data_t *) calloc(1, sizeof(ktp_data_t));
         assert(ret != NULL);
+        pc_sample_t pcs;
+        pc_begin(&pcs);
         uint64_t tim = __rdtsc();
 
-        /* Read "reads" from input file (fread) */
+        /* Read "reads" from input file (fread); a shard passes over the chunks of the others */
         int64_t sz = 0;
-        ret->seqs = bseq_read_orig(aux->task_size,
-                                   &ret->n_seqs,
-                                   aux->ks, aux->ks2,
-                                   &sz);
+        for (;;) {
+            ret->size = aux->chunk_ctl? cs_next(aux->chunk_ctl) : aux->task_size;
+            ret->seqs = bseq_read_orig(ret->size,
+                                       &ret->n_seqs,
+                                       aux->ks, aux->ks2,
+                                       &sz);
+            if (ret->seqs && aux->chunk_ctl) cs_record(aux->chunk_ctl, ret->size);
+            ret->chunk = aux->n_chunks++;
+            aux->n_read += ret->n_seqs;
+            if (ret->seqs == 0 || aux->shard_n == 0 || ret->chunk % aux->shard_n == aux->shard_i)
+                break;
+            for (int i = 0; i < ret->n_seqs; ++i) {
+                free(ret->seqs[i].name); free(ret->seqs[i].comment);
+                free(ret->seqs[i].seq); free(ret->seqs[i].qual);
+            }
+            free(ret->seqs);
+        }
 
-        tprof[READ_IO][0] += __rdtsc() - tim;
+        ret->t_read = __rdtsc();
+        ret->n_end = aux->n_read;
+        tprof[READ_IO][0] += ret->t_read - tim;
+        pc_end(&pcs, PC_READ_IO, 0);
         
         fprintf(stderr, "[0000] read_chunk: %ld, work_chunk_size: %ld, nseq: %d\n",
-                aux->task_size, sz, ret->n_seqs);   
+                ret->size, sz, ret->n_seqs);   
 
         if (ret->seqs == 0) {
             free(ret);
@@ -218,7 +326,15 @@ ktp_data_t *kt_pipeline(void *shared, int step, void *data, mem_opt_t *opt, work
         }
         {
             int64_t size = 0;
-            for (int i = 0; i < ret->n_seqs; ++i) size += ret->seqs[i].l_seq;
+            for (int i = 0; i < ret->n_seqs; ++i) {
+                bseq1_t *s = &ret->seqs[i];
+                size += s->l_seq;
+                ret->bytes += sizeof(bseq1_t) + s->l_seq + 1 + strlen(s->name) + 1;
+                if (s->qual) ret->bytes += s->l_seq + 1;
+                if (s->comment) ret->bytes += strlen(s->comment) + 1;
+            }
+            msz_add(MSZ_READS, ret->bytes);
+            ret->bp = size;
 
             fprintf(stderr, "\t[0000][ M::%s] read %d sequences (%ld bp)...\n",
                     __func__, ret->n_seqs, (long)size);
@@ -229,19 +345,12 @@ ktp_data_t *kt_pipeline(void *shared, int step, void *data, mem_opt_t *opt, work
     else if (step == 1)  /* Step 2: Main processing-engine */
     {
         static int task = 0;
-        if (w.nreads < ret->n_seqs)
-        {
-            fprintf(stderr, "[0000] Reallocating initial memory allocations!!\n");
-            free(w.regs); free(w.chain_ar); free(w.seedBuf);
-            w.nreads = ret->n_seqs;
-            w.regs = (mem_alnreg_v *) calloc(w.nreads, sizeof(mem_alnreg_v));
-            w.chain_ar = (mem_chain_v*) malloc (w.nreads * sizeof(mem_chain_v));
-            w.seedBuf = (mem_seed_t *) calloc(sizeof(mem_seed_t), w.nreads * AVG_SEEDS_PER_READ);
-            assert(w.regs != NULL); assert(w.chain_ar != NULL); assert(w.seedBuf != NULL);
-        }       
+        int64_t n_start = ret->n_end - ret->n_seqs;  // reads before this chunk, in all shards
+        memoryFit(aux, w, ret->seqs, ret->n_seqs, opt->w);
                                 
         fprintf(stderr, "[0000] Calling mem_process_seqs.., task: %d\n", task++);
 
+        uint64_t busy = aux->chunk_ctl? worker_busy(w.nthreads) : 0;
         uint64_t tim = __rdtsc();
         if (opt->flag & MEM_F_SMARTPE)
         {
@@ -258,7 +367,7 @@ ktp_data_t *kt_pipeline(void *shared, int step, void *data, mem_opt_t *opt, work
                 tmp_opt.flag &= ~MEM_F_PE;
                 /* single-end sequences, in the mixture */
                 mem_process_seqs(&tmp_opt,
-                                 aux->n_processed,
+                                 n_start,
                                  n_sep[0],
                                  sep[0],
                                  0,
@@ -271,7 +380,7 @@ ktp_data_t *kt_pipeline(void *shared, int step, void *data, mem_opt_t *opt, work
                 tmp_opt.flag |= MEM_F_PE;
                 /* paired-end sequences, in the mixture */
                 mem_process_seqs(&tmp_opt,
-                                 aux->n_processed + n_sep[0],
+                                 n_start + n_sep[0],
                                  n_sep[1],
                                  sep[1],
                                  aux->pes0,
@@ -285,20 +394,40 @@ ktp_data_t *kt_pipeline(void *shared, int step, void *data, mem_opt_t *opt, work
         else {
             /* pure (single/paired-end), reads processing */
             mem_process_seqs(opt,
-                             aux->n_processed,
+                             n_start,
                              ret->n_seqs,
                              ret->seqs,
                              aux->pes0,
                              w);
         }               
-        tprof[MEM_PROCESS2][0] += __rdtsc() - tim;
+        tim = __rdtsc() - tim;
+        tprof[MEM_PROCESS2][0] += tim;
+        if (aux->chunk_ctl) {
+            busy = worker_busy(w.nthreads) - busy;
+            cs_update(aux->chunk_ctl, ret->size, ret->bp, tim,
+                      tim > 0? 1.0 - (double) busy / ((double) tim * w.nthreads) : 0);
+        }
+
+        int64_t sam_bytes = 0;
+        for (int i = 0; i < ret->n_seqs; ++i)
+            if (ret->seqs[i].sam) {
+                int64_t l = strlen(ret->seqs[i].sam);
+                sam_bytes += l + 1;
+                ret->sam_bytes += l;
+            }
+        ret->bytes += sam_bytes;
+        msz_add(MSZ_READS, sam_bytes);
+
+        if (task == 1) memoryRefit(w, w.nthreads);
+        aux->n_processed += ret->n_seqs;
                 
         return ret;
     }           
     /* Step 3: Write output */
     else if (step == 2)
     {
-        aux->n_processed += ret->n_seqs;
+        pc_sample_t pcs;
+        pc_begin(&pcs);
         uint64_t tim = __rdtsc();
 
         for (int i = 0; i < ret->n_seqs; ++i)
@@ -312,8 +441,21 @@ ktp_data_t *kt_pipeline(void *shared, int step, void *data, mem_opt_t *opt, work
             free(ret->seqs[i].sam);
         }
         free(ret->seqs);
+        msz_add(MSZ_READS, -ret->bytes);
+        if (aux->shard_fp)
+            fprintf(aux->shard_fp, "%ld\t%ld\n", (long) ret->chunk, (long) ret->sam_bytes);
+        if (aux->ckpt) {
+            // a checkpoint never points past output that is on disk
+            aux->ckpt->reads = ret->n_end;
+            if ((aux->ckpt->out_bytes = ckpt_sync(aux->fp)) < 0 ||
+                ckpt_write(aux->ckpt_fn, aux->ckpt) != 0)
+                fprintf(stderr, "[W::%s] can't write the checkpoint %s\n", __func__, aux->ckpt_fn);
+        }
+        else if (aux->low_latency) fflush(aux->fp);
+        batch_lat_add(__rdtsc() - ret->t_read);
         free(ret);
         tprof[SAM_IO][0] += __rdtsc() - tim;
+        pc_end(&pcs, PC_SAM_IO, 0);
 
         return 0;
     } // step 2
@@ -325,9 +467,11 @@ static void *ktp_worker(void *data)
 {   
     ktp_worker_t *w = (ktp_worker_t*) data;
     ktp_t *p = w->pl;
+    tr_set_pipe(w - p->workers);
     
     while (w->step < p->n_steps) {
         // test whether we can kick off the job with this worker
+        uint64_t tr = tr_now();
         int pthread_ret = pthread_mutex_lock(&p->mutex);
         assert(pthread_ret == 0);
         for (;;) {
@@ -344,9 +488,12 @@ static void *ktp_worker(void *data)
         }
         pthread_ret = pthread_mutex_unlock(&p->mutex);
         assert(pthread_ret == 0);
+        tr_span(TR_SELF, TR_WAIT, tr, w->step, 0);
 
         // working on w->step
+        tr = tr_now();
         w->data = kt_pipeline(p->shared, w->step, w->step? w->data : 0, w->opt, *(w->w)); // for the first step, input is NULL
+        tr_span(TR_SELF, TR_STEP_READ + w->step, tr, w->index, 0);
 
         // update step and let other workers know
         pthread_ret = pthread_mutex_lock(&p->mutex);
@@ -362,113 +509,225 @@ static void *ktp_worker(void *data)
     pthread_exit(0);
 }
 
-static int process(void *shared, gzFile gfp, gzFile gfp2, int pipe_threads)
+#if NUMA_ENABLED
+/* Per-node sets of the cpus this process may run on; returns the number of
+   nodes that have at least one such cpu. node_cpus has numa_max_node()+1 slots. */
+static int numa_task_cpus(cpu_set_t *node_cpus)
+{
+    cpu_set_t task;
+    CPU_ZERO(&task);
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &task) != 0) return 0;
+
+    int n_nodes = 0;
+    for (int nd = 0; nd <= numa_max_node(); nd++) CPU_ZERO(&node_cpus[nd]);
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (!CPU_ISSET(c, &task)) continue;
+        int nd = numa_node_of_cpu(c);
+        if (nd < 0) continue;
+        if (CPU_COUNT(&node_cpus[nd]) == 0) n_nodes++;
+        CPU_SET(c, &node_cpus[nd]);
+    }
+    return n_nodes;
+}
+
+/* First node with usable cpus; the loaded index is placed there in replicate mode. */
+static int numa_first_node()
+{
+    int max_node = numa_max_node();
+    cpu_set_t *node_cpus = (cpu_set_t *) malloc((max_node + 1) * sizeof(cpu_set_t));
+    assert(node_cpus != NULL);
+    numa_task_cpus(node_cpus);
+    int nd = 0;
+    while (nd < max_node && CPU_COUNT(&node_cpus[nd]) == 0) nd++;
+    free(node_cpus);
+    return nd;
+}
+
+/* Give every node with usable cpus its own copy of the FM-index, SA samples
+   and reference string. Pinned threads (--affinity) use the node of their
+   cpu; otherwise the threads are spread over the nodes in proportion to
+   their cpu counts. The loaded index serves the first node. */
+static void numa_replicate(ktp_aux_t *aux, worker_t *w, int nthreads)
+{
+    int max_node = numa_max_node();
+    w->n_nodes = 0;
+    if (max_node >= LIM_C) {
+        fprintf(stderr, "[W::%s] %d NUMA nodes exceed the profiling table; index not replicated\n",
+                __func__, max_node + 1);
+        return;
+    }
+    cpu_set_t *node_cpus = (cpu_set_t *) malloc((max_node + 1) * sizeof(cpu_set_t));
+    assert(node_cpus != NULL);
+    int n_nodes = numa_task_cpus(node_cpus);
+    if (n_nodes < 2) {
+        fprintf(stderr, "* Single NUMA node available, index not replicated\n");
+        free(node_cpus);
+        return;
+    }
+
+    int n_cpus = 0;
+    for (int nd = 0; nd <= max_node; nd++) n_cpus += CPU_COUNT(&node_cpus[nd]);
+
+    w->tid_node = (int *) malloc(nthreads * sizeof(int));
+    assert(w->tid_node != NULL);
+    for (int i = 0; i < nthreads; i++) {
+        int nd = 0;
+        if (w->thread_cpu) nd = numa_node_of_cpu(w->thread_cpu[i]);
+        else {
+            int64_t pos = (int64_t) i * n_cpus / nthreads;
+            while (pos >= CPU_COUNT(&node_cpus[nd])) pos -= CPU_COUNT(&node_cpus[nd++]);
+        }
+        w->tid_node[i] = nd;
+        tprof[NUMA_THREADS][nd]++;
+    }
+
+    uint64_t tim = __rdtsc();
+    int first = w->tid_node[0];
+    w->node_fmi = (FMI_search **) calloc(max_node + 1, sizeof(FMI_search *));
+    w->node_ref = (uint8_t **) calloc(max_node + 1, sizeof(uint8_t *));
+    assert(w->node_fmi != NULL && w->node_ref != NULL);
+    for (int nd = 0; nd <= max_node; nd++) {
+        if (tprof[NUMA_THREADS][nd] == 0) continue;
+        if (nd == first) {
+            w->node_fmi[nd] = aux->fmi;
+            w->node_ref[nd] = aux->ref_string;
+            continue;
+        }
+        w->node_fmi[nd] = new FMI_search(aux->fmi, nd);
+        w->node_ref[nd] = (uint8_t *) numa_alloc_onnode(aux->ref_len, nd);
+        if (w->node_ref[nd] == NULL) {
+            fprintf(stderr, "Error: can't allocate the reference on NUMA node %d\n", nd);
+            exit(EXIT_FAILURE);
+        }
+        memcpy(w->node_ref[nd], aux->ref_string, aux->ref_len);
+        msz_add(MSZ_INDEX, w->node_fmi[nd]->index_bytes() + aux->ref_len);
+    }
+    w->node_cpus = node_cpus;
+    w->n_nodes = n_nodes;
+
+    fprintf(stderr, "* Index replicated on %d NUMA nodes in %0.2lf sec\n",
+            n_nodes, (__rdtsc() - tim) * 1.0 / proc_freq);
+    for (int nd = 0; nd <= max_node; nd++)
+        if (tprof[NUMA_THREADS][nd] > 0)
+            fprintf(stderr, "\tnode %d: %ld threads on %d cpus\n",
+                    nd, (long) tprof[NUMA_THREADS][nd], CPU_COUNT(&node_cpus[nd]));
+}
+
+static void numa_release(ktp_aux_t *aux, worker_t *w)
+{
+    if (w->n_nodes == 0) return;
+    for (int nd = 0; nd <= numa_max_node(); nd++) {
+        if (w->node_fmi[nd] == NULL || w->node_fmi[nd] == aux->fmi) continue;
+        msz_add(MSZ_INDEX, -(w->node_fmi[nd]->index_bytes() + aux->ref_len));
+        delete w->node_fmi[nd];
+        numa_free(w->node_ref[nd], aux->ref_len);
+    }
+    free(w->node_fmi);
+    free(w->node_ref);
+    free(w->node_cpus);
+    free(w->tid_node);
+    w->n_nodes = 0;
+}
+#endif
+
+/* Compute threads, their placement and buffers; kept for all inputs of a run */
+static void worker_setup(ktp_aux_t *aux, worker_t &w)
 {
-    ktp_aux_t   *aux = (ktp_aux_t*) shared;
-    worker_t     w;
     mem_opt_t   *opt = aux->opt;
     int32_t nthreads = opt->n_threads; // global variable for profiling!
     w.nthreads = opt->n_threads;
     
-#if NUMA_ENABLED
-    int  deno = 1;
-    int tc = numa_num_task_cpus();
-    int tn = numa_num_task_nodes();
-    int tcc = numa_num_configured_cpus();
-    fprintf(stderr, "num_cpus: %d, num_numas: %d, configured cpus: %d\n", tc, tn, tcc);
-    int ht = HTStatus();
-    if (ht) deno = 2;
-    
-    if (nthreads < tcc/tn/deno) {
-        fprintf(stderr, "Enabling single numa domain...\n\n");
-        // numa_set_preferred(0);
-        // bitmask mask(0);
-        struct bitmask *mask = numa_bitmask_alloc(numa_num_possible_nodes());
-        numa_bitmask_clearall(mask);
-        numa_bitmask_setbit(mask, 0);
-        numa_bind(mask);
-        numa_bitmask_free(mask);
+    w.thread_cpu = NULL;
+    if (aux->affinity != AFF_NONE) {
+        cpu_topo_t topo;
+        if (cpu_topo_detect(&topo) == 0) {
+            fprintf(stderr, "* CPU topology: %d sockets, %d L3 domains, %d cores, %d cpus (%d-way SMT)\n",
+                    topo.n_sockets, topo.n_llc, topo.n_cores, topo.n_cpus, topo.max_smt);
+            if (nthreads > topo.n_cpus)
+                fprintf(stderr, "[W::%s] %d threads on %d cpus; cpus are shared\n",
+                        __func__, nthreads, topo.n_cpus);
+            if (aux->cosched && topo.max_smt < 2)
+                fprintf(stderr, "[W::%s] no SMT siblings among the cpus; the thread pairs of "
+                        "--smt-cosched share an L3 domain instead\n", __func__);
+            w.thread_cpu = aff_place(&topo, aux->affinity, nthreads);
+            fprintf(stderr, "* Thread affinity: %s\n", aff_policy_name(aux->affinity));
+            if (bwa_verbose >= 4)
+                for (int i = 0; i < nthreads; i++)
+                    fprintf(stderr, "\tthread %d -> cpu %d\n", i, w.thread_cpu[i]);
+            cpu_topo_destroy(&topo);
+        }
+        else fprintf(stderr, "[W::%s] can't read the CPU topology; threads are not pinned\n", __func__);
     }
-#endif
-#if AFF && (__linux__)
-    { // Affinity/HT stuff
-        unsigned int cpuid[4];
-        asm volatile
-            ("cpuid" : "=a" (cpuid[0]), "=b" (cpuid[1]), "=c" (cpuid[2]), "=d" (cpuid[3])
-             : "0" (0xB), "2" (1));
-        int num_logical_cpus = cpuid[1] & 0xFFFF;
-
-        asm volatile
-            ("cpuid" : "=a" (cpuid[0]), "=b" (cpuid[1]), "=c" (cpuid[2]), "=d" (cpuid[3])
-             : "0" (0xB), "2" (0));
-        int num_ht = cpuid[1] & 0xFFFF;
-        int num_total_logical_cpus = get_nprocs_conf();
-        int num_sockets = num_total_logical_cpus / num_logical_cpus;
-        fprintf(stderr, "#sockets: %d, #cores/socket: %d, #logical_cpus: %d, #ht/core: %d\n",
-                num_sockets, num_logical_cpus/num_ht, num_total_logical_cpus, num_ht);
-        
-        for (int i=0; i<num_total_logical_cpus; i++) affy[i] = i;
-        int slookup[256] = {-1};
 
-        if (num_ht == 2 && num_sockets == 2)  // generalize it for n sockets
-        {
-            for (int i=0; i<num_total_logical_cpus; i++) {
-                std::ostringstream ss;
-                ss << i;
-                std::string str = "/sys/devices/system/cpu/cpu"+ ss.str();
-                str = str +"/topology/thread_siblings_list";
-                // std::cout << str << std::endl;
-                // std::string str = "cpu.txt";
-                FILE *fp = fopen(str.c_str(), "r");
-                if (fp == NULL) {
-                    fprintf("Error: Cant open the file..\n");
-                    break;
-                }
-                else {
-                    int a, b, v;
-                    char ch[10] = {'\0'};
-                    fgets(ch, 10, fp);
-                    v = sscanf(ch, "%u,%u",&a,&b);
-                    if (v == 1) v = sscanf(ch, "%u-%u",&a,&b);
-                    if (v == 1) {
-                        fprintf(stderr, "Mis-match between HT and threads_sibling_list...%s\n", ch);
-                        fprintf(stderr, "Continuing with default affinity settings..\n");
-                        break;
-                    }
-                    slookup[a] = 1;
-                    slookup[b] = 2;
-                    fclose(fp);
-                }
-            }
-            int a = 0, b = num_total_logical_cpus / num_ht;
-            for (int i=0; i<num_total_logical_cpus; i++) {
-                if (slookup[i] == -1) {
-                    fprintf(stderr, "Unseen cpu topology..\n");
-                    break;
-                }
-                if (slookup[i] == 1) affy[a++] = i;
-                else affy[b++] = i;
-            }
+#if NUMA_ENABLED
+    w.n_nodes = 0;
+    if (aux->numa_mode == NUMA_MODE_AUTO) {
+        int  deno = 1;
+        int tc = numa_num_task_cpus();
+        int tn = numa_num_task_nodes();
+        int tcc = numa_num_configured_cpus();
+        fprintf(stderr, "num_cpus: %d, num_numas: %d, configured cpus: %d\n", tc, tn, tcc);
+        int ht = HTStatus();
+        if (ht) deno = 2;
+        
+        if (nthreads < tcc/tn/deno) {
+            fprintf(stderr, "Enabling single numa domain...\n\n");
+            // numa_set_preferred(0);
+            // bitmask mask(0);
+            struct bitmask *mask = numa_bitmask_alloc(numa_num_possible_nodes());
+            numa_bitmask_clearall(mask);
+            numa_bitmask_setbit(mask, 0);
+            numa_bind(mask);
+            numa_bitmask_free(mask);
         }
     }
+    else if (aux->numa_mode == NUMA_MODE_REPLICATE)
+        numa_replicate(aux, &w, nthreads);
 #endif
     
-    int32_t nreads = aux->actual_chunk_size/ READ_LEN + 10;
-    
-    /* All memory allocation */
-    memoryAlloc(aux, w, nreads, nthreads);
-    fprintf(stderr, "* Threads used (compute): %d\n", nthreads);
+    /* Buffers are allocated with the first chunk, see memoryAlloc() */
+    w.mmc.thr = NULL;
+    w.regs = NULL; w.chain_ar = NULL; w.seedBuf = NULL;
+    w.nreads = 0;
+    w.alnv = NULL;
+    w.pool = NULL;
+    w.dedup = aux->dedup? mem_dedup_init(aux->dedup_cache) : NULL;
+    w.cosched = aux->cosched;
+    if (aux->low_latency) {
+        // no allocation or thread start on the path of the first batch
+        mem_plan_t plan;
+        msz_plan(&plan, aux->task_size / READ_LEN + 1, aux->task_size, opt->w);
+        memoryAlloc(aux, w, &plan, nthreads);
+        w.pool = kt_pool_init(&w);
+    }
+    fprintf(stderr, "* Threads used (compute): %d%s\n", nthreads,
+            w.cosched? ", seeding and extension overlapped on thread pairs" : "");
+    w.ref_string = aux->ref_string;
+    w.fmi = aux->fmi;
+}
+
+static void worker_release(ktp_aux_t *aux, worker_t &w)
+{
+#if NUMA_ENABLED
+    numa_release(aux, &w);
+#endif
+    kt_pool_destroy(w.pool);
+    mem_dedup_destroy(w.dedup);
+    free(w.thread_cpu);
+    memoryFree(w, w.nthreads);
+}
+
+/* Maps the reads of aux->ks (and aux->ks2) to aux->fp */
+static int process(void *shared, worker_t &w, int pipe_threads)
+{
+    ktp_aux_t   *aux = (ktp_aux_t*) shared;
+    mem_opt_t   *opt = aux->opt;
     
     /* pipeline using pthreads */
     ktp_t aux_;
     int p_nt = pipe_threads; // 2;
     int n_steps = 3;
     
-    w.ref_string = aux->ref_string;
-    w.fmi = aux->fmi;
-    w.nreads  = nreads;
-    // w.memSize = nreads;
-    
     aux_.n_workers = p_nt;
     aux_.n_steps = n_steps;
     aux_.shared = aux;
@@ -510,35 +769,212 @@ static int process(void *shared, gzFile gfp, gzFile gfp2, int pipe_threads)
     /***** pipeline ends ******/
     
     fprintf(stderr, "[0000] Computation ends..\n");
-    
-    /* Dealloc memory allcoated in the header section */    
+    return 0;
+}
+
+/* Skips the first n reads (ends of pairs counted) of the input of a resumed run */
+static int64_t skip_reads(kseq_t *ks, kseq_t *ks2, int64_t n)
+{
+    int64_t i;
+    for (i = 0; i < n; i += ks2? 2 : 1)
+        if (kseq_read(ks) < 0 || (ks2 && kseq_read(ks2) < 0)) break;
+    return i;
+}
+
+/* One line of a --manifest file */
+typedef struct {
+    char *r1, *r2;   // r2: NULL for single-end or interleaved reads
+    char *rg;        // read group line; NULL: the one of -R, if any
+    char *out;
+} manifest_ent_t;
+
+static void manifest_free(manifest_ent_t *e, int n)
+{
+    for (int i = 0; i < n; i++) {
+        free(e[i].r1); free(e[i].r2);
+        free(e[i].rg); free(e[i].out);
+    }
+    free(e);
+}
+
+/* Reads the tab-separated R1, R2, read group and output columns of fn; "-"
+   or an empty field leaves R2 or the read group out. Returns the number of
+   entries, or -1 on an error. */
+static int manifest_read(const char *fn, manifest_ent_t **ents)
+{
+    FILE *fp = fopen(fn, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "[E::%s] can't open the manifest %s\n", __func__, fn);
+        return -1;
+    }
+    manifest_ent_t *e = NULL;
+    int n = 0, m = 0, lineno = 0, ret = 0;
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, fp)) >= 0) {
+        lineno++;
+        while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) line[--len] = 0;
+        if (len == 0 || line[0] == '#') continue;
+
+        char *col[4], *q = line;
+        int nc;
+        for (nc = 0; nc < 4 && q; nc++) {
+            col[nc] = q;
+            if ((q = strchr(q, '\t')) != NULL) *q++ = 0;
+        }
+        if (nc < 4 || q != NULL || col[0][0] == 0 || col[3][0] == 0) {
+            fprintf(stderr, "[E::%s] %s, line %d: expected R1, R2, read group and output "
+                    "separated by tabs\n", __func__, fn, lineno);
+            ret = -1;
+            break;
+        }
+        if (n == m) {
+            m = m? m << 1 : 16;
+            e = (manifest_ent_t *) realloc(e, m * sizeof(manifest_ent_t));
+            assert(e != NULL);
+        }
+        e[n].r1 = strdup(col[0]);
+        e[n].r2 = col[1][0] && strcmp(col[1], "-") != 0? strdup(col[1]) : NULL;
+        e[n].rg = col[2][0] && strcmp(col[2], "-") != 0? strdup(col[2]) : NULL;
+        e[n].out = strdup(col[3]);
+        n++;
+    }
+    free(line);
+    fclose(fp);
+    if (ret == 0 && n == 0) {
+        fprintf(stderr, "[E::%s] no entries in the manifest %s\n", __func__, fn);
+        ret = -1;
+    }
+    if (ret < 0) {
+        manifest_free(e, n);
+        return -1;
+    }
+    *ents = e;
+    return n;
+}
+
+/* Maps one manifest entry to its own output with the loaded index and the
+   threads and buffers of w; hdr_line holds the -H lines */
+static int manifest_map(ktp_aux_t *aux, worker_t &w, const manifest_ent_t *e,
+                        const char *rg, const char *hdr_line, int flag0, int pipe_threads)
+{
+    mem_opt_t *opt = aux->opt;
+    char *hdr = hdr_line? strdup(hdr_line) : NULL, *rg_line = NULL;
+    void *ko = 0, *ko2 = 0;
+    gzFile fp = 0, fp2 = 0;
+    int fd, fd2, ret = -1;
+
+    opt->flag = flag0;
+    opt->rg_id = NULL;
+    aux->ks = aux->ks2 = 0;
+    aux->fp = NULL;
+    aux->n_processed = aux->n_read = 0;
+    if (rg) {
+        if ((rg_line = bwa_set_rg(rg)) == 0) goto end;
+        hdr = bwa_insert_header(rg_line, hdr);
+        opt->rg_id = bwa_rg_id;
+    }
+    if ((ko = kopen(e->r1, &fd)) == 0) {
+        fprintf(stderr, "[E::%s] fail to open file `%s'.\n", __func__, e->r1);
+        goto end;
+    }
+    fp = gzdopen(fd, "r");
+    aux->ks = kseq_init(fp);
+    if (e->r2) {
+        if (opt->flag & MEM_F_PE)
+            fprintf(stderr, "[W::%s] when '-p' is in use, the second query file is ignored.\n",
+                    __func__);
+        else {
+            if ((ko2 = kopen(e->r2, &fd2)) == 0) {
+                fprintf(stderr, "[E::%s] failed to open file `%s'.\n", __func__, e->r2);
+                goto end;
+            }
+            fp2 = gzdopen(fd2, "r");
+            aux->ks2 = kseq_init(fp2);
+            opt->flag |= MEM_F_PE;
+        }
+    }
+    if ((aux->fp = fopen(e->out, "w")) == NULL) {
+        fprintf(stderr, "[E::%s] can't open %s for writing\n", __func__, e->out);
+        goto end;
+    }
+
+    bwa_print_sam_hdr(aux->fmi->idx->bns, hdr, aux->fp);
+    process(aux, w, pipe_threads);
+    ret = 0;
+
+end:
+    if (aux->fp && fclose(aux->fp) != 0) {
+        fprintf(stderr, "[E::%s] error writing %s\n", __func__, e->out);
+        ret = -1;
+    }
+    if (aux->ks) kseq_destroy(aux->ks);
+    if (fp) { err_gzclose(fp); kclose(ko); }
+    if (aux->ks2) kseq_destroy(aux->ks2);
+    if (fp2) { err_gzclose(fp2); kclose(ko2); }
+    aux->ks = aux->ks2 = 0;
+    aux->fp = NULL;
+    free(rg_line);
+    free(hdr);
+    return ret;
+}
+
+/* mem --manifest: the entries one after another, each on all compute threads */
+static int manifest_run(ktp_aux_t *aux, worker_t &w, const manifest_ent_t *e, int n,
+                        const char *rg_arg, const char *hdr_line, int pipe_threads)
+{
+    int flag0 = aux->opt->flag, n_fail = 0;
+    FILE *fp0 = aux->fp;
+    for (int i = 0; i < n; i++) {
+        double rtime = realtime();
+        fprintf(stderr, "[M::%s] entry %d of %d: %s%s%s -> %s\n", __func__, i + 1, n,
+                e[i].r1, e[i].r2? " " : "", e[i].r2? e[i].r2 : "", e[i].out);
+        if (manifest_map(aux, w, &e[i], e[i].rg? e[i].rg : rg_arg, hdr_line, flag0,
+                         pipe_threads) != 0) {
+            fprintf(stderr, "[E::%s] entry %d (%s) failed\n", __func__, i + 1, e[i].out);
+            n_fail++;
+            continue;
+        }
+        fprintf(stderr, "[M::%s] entry %d of %d: %ld reads in %.3f real sec\n", __func__,
+                i + 1, n, (long) aux->n_processed, realtime() - rtime);
+    }
+    aux->opt->flag = flag0;
+    aux->fp = fp0;
+    if (n_fail > 0)
+        fprintf(stderr, "[E::%s] %d of %d manifest entries failed\n", __func__, n_fail, n);
+    return n_fail;
+}
+
+void memoryFree(worker_t &w, int32_t nthreads)
+{
     free(w.chain_ar);
     free(w.regs);
     free(w.seedBuf);
+    if (w.mmc.thr == NULL) return;  // no reads
     
     for(int l=0; l<nthreads; l++) {
-        _mm_free(w.mmc.seqBufLeftRef[l*CACHE_LINE]);
-        _mm_free(w.mmc.seqBufRightRef[l*CACHE_LINE]);
-        _mm_free(w.mmc.seqBufLeftQer[l*CACHE_LINE]);
-        _mm_free(w.mmc.seqBufRightQer[l*CACHE_LINE]);
+        _mm_free(w.mmc.thr[l].seqBufLeftRef);
+        _mm_free(w.mmc.thr[l].seqBufRightRef);
+        _mm_free(w.mmc.thr[l].seqBufLeftQer);
+        _mm_free(w.mmc.thr[l].seqBufRightQer);
     }
 
     for(int l=0; l<nthreads; l++) {
-        free(w.mmc.seqPairArrayAux[l]);
-        free(w.mmc.seqPairArrayLeft128[l]);
-        free(w.mmc.seqPairArrayRight128[l]);
+        free(w.mmc.thr[l].seqPairArrayAux);
+        free(w.mmc.thr[l].seqPairArrayLeft128);
+        free(w.mmc.thr[l].seqPairArrayRight128);
     }
 
     for(int l=0; l<nthreads; l++) {
-        _mm_free(w.mmc.matchArray[l]);
-        free(w.mmc.min_intv_ar[l]);
-        free(w.mmc.query_pos_ar[l]);
-        free(w.mmc.enc_qdb[l]);
-        free(w.mmc.rid[l]);
-        _mm_free(w.mmc.lim[l]);
+        _mm_free(w.mmc.thr[l].matchArray);
+        free(w.mmc.thr[l].min_intv_ar);
+        free(w.mmc.thr[l].query_pos_ar);
+        free(w.mmc.thr[l].enc_qdb);
+        free(w.mmc.thr[l].rid);
+        _mm_free(w.mmc.thr[l].lim);
     }
-
-    return 0;
+    _mm_free(w.mmc.thr);
 }
 
 static void update_a(mem_opt_t *opt, const mem_opt_t *opt0)
@@ -557,13 +993,60 @@ static void update_a(mem_opt_t *opt, const mem_opt_t *opt0)
     }
 }
 
+/* Long-only options of "mem"; values above the char range */
+#define OPT_NUMA     0x100
+#define OPT_AFFINITY 0x101
+#define OPT_MAX_MEM  0x102
+#define OPT_METRICS_JSON 0x103
+#define OPT_HW_COUNTERS  0x104
+#define OPT_TRACE        0x105
+#define OPT_LOW_LATENCY  0x106
+#define OPT_DEDUP        0x107
+#define OPT_DEDUP_CACHE  0x108
+#define OPT_MANIFEST     0x109
+#define OPT_CHECKPOINT   0x10a
+#define OPT_RESUME       0x10b
+#define OPT_SHARD        0x10c
+#define OPT_ADAPTIVE_CHUNK 0x10d
+#define OPT_CHUNK_LOG      0x10e
+#define OPT_CHUNK_REPLAY   0x10f
+#define OPT_SMT_COSCHED    0x110
+#define OPT_TUNE_PROFILE   0x111
+
+static const struct option mem_long_opts[] = {
+    { "numa", required_argument, 0, OPT_NUMA },
+    { "affinity", required_argument, 0, OPT_AFFINITY },
+    { "max-mem", required_argument, 0, OPT_MAX_MEM },
+    { "metrics-json", required_argument, 0, OPT_METRICS_JSON },
+    { "hw-counters", no_argument, 0, OPT_HW_COUNTERS },
+    { "trace", required_argument, 0, OPT_TRACE },
+    { "low-latency", no_argument, 0, OPT_LOW_LATENCY },
+    { "dedup", no_argument, 0, OPT_DEDUP },
+    { "dedup-cache", required_argument, 0, OPT_DEDUP_CACHE },
+    { "manifest", required_argument, 0, OPT_MANIFEST },
+    { "checkpoint", required_argument, 0, OPT_CHECKPOINT },
+    { "resume", no_argument, 0, OPT_RESUME },
+    { "shard", required_argument, 0, OPT_SHARD },
+    { "adaptive-chunk", no_argument, 0, OPT_ADAPTIVE_CHUNK },
+    { "chunk-log", required_argument, 0, OPT_CHUNK_LOG },
+    { "chunk-replay", required_argument, 0, OPT_CHUNK_REPLAY },
+    { "smt-cosched", no_argument, 0, OPT_SMT_COSCHED },
+    { "tune-profile", required_argument, 0, OPT_TUNE_PROFILE },
+    { 0, 0, 0, 0 }
+};
+
 static void usage(const mem_opt_t *opt)
 {
     fprintf(stderr, "Usage: bwa-mem2 mem [options] <idxbase> <in1.fq> [in2.fq]\n");
+    fprintf(stderr, "       bwa-mem2 mem [options] --manifest FILE <idxbase>\n");
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "  Algorithm options:\n");
     fprintf(stderr, "    -o STR        Output SAM file name\n");
     fprintf(stderr, "    -t INT        number of threads [%d]\n", opt->n_threads);
+    fprintf(stderr, "    --numa STR    index placement on NUMA nodes: auto, off, interleave or replicate [auto]\n");
+    fprintf(stderr, "    --affinity STR\n");
+    fprintf(stderr, "                  pin compute threads: none, compact, scatter, core (one per core first) or\n");
+    fprintf(stderr, "                  smt (pairs of threads on the SMT siblings of a core) [none; smt with --smt-cosched]\n");
     fprintf(stderr, "    -k INT        minimum seed length [%d]\n", opt->min_seed_len);
     fprintf(stderr, "    -w INT        band width for banded alignment [%d]\n", opt->w);
     fprintf(stderr, "    -d INT        off-diagonal X-dropoff [%d]\n", opt->zdrop);
@@ -595,6 +1078,42 @@ static void usage(const mem_opt_t *opt)
     fprintf(stderr, "   -5            for split alignment, take the alignment with the smallest coordinate as primary\n");
     fprintf(stderr, "   -q            don't modify mapQ of supplementary alignments\n");
     fprintf(stderr, "   -K INT        process INT input bases in each batch regardless of nThreads (for reproducibility) []\n");    
+    fprintf(stderr, "   --max-mem FLOAT\n");
+    fprintf(stderr, "                 memory budget in GB; the batch size is reduced to fit the estimate [no limit]\n");
+    fprintf(stderr, "   --metrics-json FILE\n");
+    fprintf(stderr, "                 write per-phase and per-thread times and work counters to FILE as JSON [null]\n");
+    fprintf(stderr, "   --hw-counters count cycles, instructions, LLC, dTLB and branch misses per phase\n");
+    fprintf(stderr, "   --trace FILE  write a timeline of pipeline steps, batches and reallocations to FILE\n");
+    fprintf(stderr, "                 (Chrome trace-event JSON, for Perfetto) [null]\n");
+    fprintf(stderr, "   --low-latency small batches (-K default %d) on warm threads with buffers sized up\n", LOW_LATENCY_CHUNK);
+    fprintf(stderr, "                 front, split finely across threads; output flushed per batch\n");
+    fprintf(stderr, "   --dedup       align each distinct read (pair) of a batch once and copy the result to\n");
+    fprintf(stderr, "                 its exact duplicates\n");
+    fprintf(stderr, "   --dedup-cache INT\n");
+    fprintf(stderr, "                 with --dedup, also keep INT distinct reads (pairs) across batches [0]\n");
+    fprintf(stderr, "   --manifest FILE\n");
+    fprintf(stderr, "                 map several inputs with one index load; FILE has the tab-separated columns\n");
+    fprintf(stderr, "                 in1.fq, in2.fq, read group line (as -R) and output SAM per line; '-' leaves\n");
+    fprintf(stderr, "                 in2.fq or the read group (then -R applies) out\n");
+    fprintf(stderr, "   --checkpoint FILE\n");
+    fprintf(stderr, "                 record the progress in FILE after each batch written to -o [null]\n");
+    fprintf(stderr, "   --resume      continue an interrupted run from its --checkpoint, with the same options\n");
+    fprintf(stderr, "   --shard INT/INT\n");
+    fprintf(stderr, "                 map only batches i, i+N, ... of the input as shard i of N (from 1); the -o\n");
+    fprintf(stderr, "                 outputs of all shards are joined with 'bwa-mem2 merge'. Give the same -K\n");
+    fprintf(stderr, "   --adaptive-chunk\n");
+    fprintf(stderr, "                 tune the batch size (from -K or the default) between batches on the measured\n");
+    fprintf(stderr, "                 throughput and thread idle time, within --max-mem; paired-end output depends\n");
+    fprintf(stderr, "                 on the batch sizes, which --chunk-log records\n");
+    fprintf(stderr, "   --chunk-log FILE\n");
+    fprintf(stderr, "                 write the size of each batch read to FILE [null]\n");
+    fprintf(stderr, "   --chunk-replay FILE\n");
+    fprintf(stderr, "                 read batches of the sizes in a --chunk-log FILE, to reproduce a run [null]\n");
+    fprintf(stderr, "   --smt-cosched overlap seeding (memory-bound) and extension (compute-bound) of successive\n");
+    fprintf(stderr, "                 units of reads on thread pairs, pinned to SMT siblings (--affinity smt)\n");
+    fprintf(stderr, "   --tune-profile FILE\n");
+    fprintf(stderr, "                 batch, prefetch and chunk parameters measured by 'bwa-mem2 tune'; -K\n");
+    fprintf(stderr, "                 overrides its chunk size [null]\n");
     fprintf(stderr, "   -v INT        verbose level: 1=error, 2=warning, 3=message, 4+=debugging [%d]\n", bwa_verbose);
     fprintf(stderr, "   -T INT        minimum score to output [%d]\n", opt->T);
     fprintf(stderr, "   -h INT[,INT]  if there are <INT hits with score >80%% of the max score, output all in XA [%d,%d]\n", opt->max_XA_hits, opt->max_XA_hits_alt);
@@ -614,6 +1133,19 @@ int main_mem(int argc, char *argv[])
 {
     int          i, c, ignore_alt = 0, no_mt_io = 0;
     int          fixed_chunk_size          = -1;
+    double       max_mem                   = 0;
+    const char  *metrics_json              = 0;
+    int          hw_counters               = 0;
+    const char  *trace_fn                  = 0;
+    const char  *manifest_fn               = 0, *rg_arg = 0;
+    const char  *out_fn                    = 0, *ckpt_fn = 0;
+    int          resume                    = 0;
+    int          adaptive_chunk            = 0;
+    int          affinity_set              = 0;
+    const char  *chunk_log                 = 0, *chunk_replay = 0;
+    ckpt_t       ckpt;
+    manifest_ent_t *manifest               = 0;
+    int          n_manifest                = 0;
     char        *p, *rg_line               = 0, *hdr_line = 0;
     const char  *mode                      = 0;
     
@@ -637,7 +1169,8 @@ int main_mem(int argc, char *argv[])
     
     /* Parse input arguments */
     // comment: added option '5' in the list
-    while ((c = getopt(argc, argv, "51qpaMCSPVYjk:c:v:s:r:t:R:A:B:O:E:U:w:L:d:T:Q:D:m:I:N:W:x:G:h:y:K:X:H:o:f:")) >= 0)
+    while ((c = getopt_long(argc, argv, "51qpaMCSPVYjk:c:v:s:r:t:R:A:B:O:E:U:w:L:d:T:Q:D:m:I:N:W:x:G:h:y:K:X:H:o:f:",
+                            mem_long_opts, NULL)) >= 0)
     {
         if (c == 'k') opt->min_seed_len = atoi(optarg), opt0.min_seed_len = 1;
         else if (c == '1') no_mt_io = 1;
@@ -650,16 +1183,7 @@ int main_mem(int argc, char *argv[])
             opt->pen_unpaired = atoi(optarg), opt0.pen_unpaired = 1, assert(opt->pen_unpaired >= INT_MIN && opt->pen_unpaired <= INT_MAX);
         else if (c == 't')
             opt->n_threads = atoi(optarg), opt->n_threads = opt->n_threads > 1? opt->n_threads : 1, assert(opt->n_threads >= INT_MIN && opt->n_threads <= INT_MAX);
-        else if (c == 'o' || c == 'f')
-        {
-            is_o = 1;
-            aux.fp = fopen(optarg, "w");
-            if (aux.fp == NULL) {
-                fprintf(stderr, "Error: can't open %s input file\n", optarg);
-                exit(EXIT_FAILURE);
-            }
-            /*fclose(aux.fp);*/
-        }
+        else if (c == 'o' || c == 'f') out_fn = optarg;   // opened below; --resume appends
         else if (c == 'P') opt->flag |= MEM_F_NOPAIRING;
         else if (c == 'a') opt->flag |= MEM_F_ALL;
         else if (c == 'p') opt->flag |= MEM_F_PE | MEM_F_SMARTPE;
@@ -688,6 +1212,73 @@ int main_mem(int argc, char *argv[])
             opt->max_mem_intv = atol(optarg), opt0.max_mem_intv = 1;
         else if (c == 'C') aux.copy_comment = 1;
         else if (c == 'K') fixed_chunk_size = atoi(optarg);
+        else if (c == OPT_MAX_MEM) max_mem = atof(optarg);
+        else if (c == OPT_METRICS_JSON) metrics_json = optarg;
+        else if (c == OPT_HW_COUNTERS) hw_counters = 1;
+        else if (c == OPT_TRACE) trace_fn = optarg;
+        else if (c == OPT_LOW_LATENCY) aux.low_latency = 1;
+        else if (c == OPT_DEDUP) aux.dedup = 1;
+        else if (c == OPT_MANIFEST) manifest_fn = optarg;
+        else if (c == OPT_CHECKPOINT) ckpt_fn = optarg;
+        else if (c == OPT_RESUME) resume = 1;
+        else if (c == OPT_ADAPTIVE_CHUNK) adaptive_chunk = 1;
+        else if (c == OPT_CHUNK_LOG) chunk_log = optarg;
+        else if (c == OPT_CHUNK_REPLAY) chunk_replay = optarg;
+        else if (c == OPT_SMT_COSCHED) aux.cosched = 1;
+        else if (c == OPT_TUNE_PROFILE) {
+            if (tune_read(optarg, &mem_tune) != 0) {
+                free(opt);
+                if (is_o)
+                    fclose(aux.fp);
+                return 1;
+            }
+            if (mem_tune.chunk > 0) opt->chunk_size = mem_tune.chunk;
+        }
+        else if (c == OPT_SHARD) {
+            if (sscanf(optarg, "%d/%d", &aux.shard_i, &aux.shard_n) != 2 ||
+                aux.shard_n < 1 || aux.shard_i < 1 || aux.shard_i > aux.shard_n) {
+                fprintf(stderr, "[E::%s] --shard takes i/N with 1 <= i <= N\n", __func__);
+                free(opt);
+                return 1;
+            }
+            aux.shard_i--;
+        }
+        else if (c == OPT_DEDUP_CACHE) {
+            aux.dedup = 1;
+            aux.dedup_cache = atol(optarg);
+            if (aux.dedup_cache < 0) {
+                fprintf(stderr, "[E::%s] --dedup-cache must be at least 0\n", __func__);
+                free(opt);
+                if (is_o)
+                    fclose(aux.fp);
+                return 1;
+            }
+        }
+        else if (c == OPT_AFFINITY)
+        {
+            affinity_set = 1;
+            if ((aux.affinity = aff_policy(optarg)) < 0) {
+                fprintf(stderr, "[E::%s] unknown affinity policy '%s'\n", __func__, optarg);
+                free(opt);
+                if (is_o)
+                    fclose(aux.fp);
+                return 1;
+            }
+        }
+        else if (c == OPT_NUMA)
+        {
+            if (strcmp(optarg, "auto") == 0) aux.numa_mode = NUMA_MODE_AUTO;
+            else if (strcmp(optarg, "off") == 0) aux.numa_mode = NUMA_MODE_OFF;
+            else if (strcmp(optarg, "interleave") == 0) aux.numa_mode = NUMA_MODE_INTERLEAVE;
+            else if (strcmp(optarg, "replicate") == 0) aux.numa_mode = NUMA_MODE_REPLICATE;
+            else {
+                fprintf(stderr, "[E::%s] unknown NUMA mode '%s'\n", __func__, optarg);
+                free(opt);
+                if (is_o)
+                    fclose(aux.fp);
+                return 1;
+            }
+        }
         else if (c == 'X') opt->mask_level = atof(optarg);
         else if (c == 'h')
         {
@@ -731,6 +1322,8 @@ int main_mem(int argc, char *argv[])
                     fclose(aux.fp);
                 return 1;
             }
+            opt->rg_id = bwa_rg_id;
+            rg_arg = optarg;
         }
         else if (c == 'H')
         {
@@ -781,18 +1374,104 @@ int main_mem(int argc, char *argv[])
     /* Check output file name */
     if (rg_line)
     {
-        hdr_line = bwa_insert_header(rg_line, hdr_line);
+        // with a manifest, the read group is added per entry
+        if (!manifest_fn) hdr_line = bwa_insert_header(rg_line, hdr_line);
         free(rg_line);
     }
 
     if (opt->n_threads < 1) opt->n_threads = 1;
-    if (optind + 2 != argc && optind + 3 != argc) {
+    if (aux.cosched) {
+        if (opt->n_threads < 2) {
+            fprintf(stderr, "[W::%s] --smt-cosched needs at least 2 threads; not used\n", __func__);
+            aux.cosched = 0;
+        }
+        else if (!affinity_set) aux.affinity = AFF_SMT;
+        else if (aux.affinity != AFF_SMT)
+            fprintf(stderr, "[W::%s] with --affinity %s the thread pairs of --smt-cosched may not "
+                    "share a core\n", __func__, aff_policy_name(aux.affinity));
+    }
+    if (manifest_fn? optind + 1 != argc : optind + 2 != argc && optind + 3 != argc) {
         usage(opt);
         free(opt);
         if (is_o) 
             fclose(aux.fp);
         return 1;
     }
+    memset(&ckpt, 0, sizeof(ckpt_t));
+    if (resume && !ckpt_fn) {
+        fprintf(stderr, "[E::%s] --resume needs the --checkpoint of the run\n", __func__);
+        free(opt);
+        free(hdr_line);
+        return 1;
+    }
+    if (aux.shard_n > 0 && (out_fn == NULL || manifest_fn || ckpt_fn)) {
+        fprintf(stderr, "[E::%s] --shard needs an output file (-o) and no --manifest or --checkpoint\n",
+                __func__);
+        free(opt);
+        free(hdr_line);
+        return 1;
+    }
+    if (ckpt_fn && (out_fn == NULL || manifest_fn)) {
+        fprintf(stderr, "[E::%s] --checkpoint needs an output file (-o) and no --manifest\n", __func__);
+        free(opt);
+        free(hdr_line);
+        return 1;
+    }
+    if ((adaptive_chunk && (chunk_replay || aux.shard_n > 0 || ckpt_fn)) || (chunk_replay && ckpt_fn)) {
+        // shards and checkpoints rely on batches of one size
+        fprintf(stderr, "[E::%s] --adaptive-chunk can't be combined with --chunk-replay, --shard or "
+                "--checkpoint, nor --chunk-replay with --checkpoint\n", __func__);
+        free(opt);
+        free(hdr_line);
+        return 1;
+    }
+    if (resume) {
+        const char *in2 = optind + 2 < argc? argv[optind + 2] : "-";
+        if (ckpt_read(ckpt_fn, &ckpt) != 0) {
+            free(opt);
+            free(hdr_line);
+            return 1;
+        }
+        if (strcmp(ckpt.in1, argv[optind + 1]) != 0 || strcmp(ckpt.in2, in2) != 0 ||
+            strcmp(ckpt.out, out_fn) != 0) {
+            fprintf(stderr, "[E::%s] the checkpoint %s is of another run (%s %s -> %s)\n",
+                    __func__, ckpt_fn, ckpt.in1, ckpt.in2, ckpt.out);
+            ckpt_free(&ckpt);
+            free(opt);
+            free(hdr_line);
+            return 1;
+        }
+    }
+    if (out_fn) {
+        aux.fp = fopen(out_fn, resume? "r+" : "w");
+        if (aux.fp == NULL) {
+            fprintf(stderr, "Error: can't open %s input file\n", out_fn);
+            exit(EXIT_FAILURE);
+        }
+        is_o = 1;
+    }
+    if (metrics_json) {     // written at the end; fail before the run, not after it
+        FILE *fp = fopen(metrics_json, "w");
+        if (fp == NULL) {
+            fprintf(stderr, "[E::%s] can't open %s for writing\n", __func__, metrics_json);
+            free(opt);
+            free(hdr_line);
+            if (is_o)
+                fclose(aux.fp);
+            return 1;
+        }
+        fclose(fp);
+    }
+    if (manifest_fn) {
+        if (is_o) fprintf(stderr, "[W::%s] -o is ignored with --manifest\n", __func__);
+        if ((n_manifest = manifest_read(manifest_fn, &manifest)) < 0) {
+            free(opt);
+            free(hdr_line);
+            if (is_o)
+                fclose(aux.fp);
+            return 1;
+        }
+    }
 
     /* Further input parsing */
     if (mode)
@@ -842,6 +1521,21 @@ int main_mem(int argc, char *argv[])
     /* Matrix for SWA */
     bwa_fill_scmat(opt->a, opt->b, opt->mat);
     
+#if NUMA_ENABLED
+    if (aux.numa_mode != NUMA_MODE_OFF && numa_available() < 0) {
+        fprintf(stderr, "[W::%s] NUMA is not available on this system; ignoring --numa\n", __func__);
+        aux.numa_mode = NUMA_MODE_OFF;
+    }
+    /* Place the index and reference before they are first touched */
+    if (aux.numa_mode == NUMA_MODE_INTERLEAVE)
+        numa_set_interleave_mask(numa_all_nodes_ptr);
+    else if (aux.numa_mode == NUMA_MODE_REPLICATE)
+        numa_set_preferred(numa_first_node());
+#else
+    if (aux.numa_mode == NUMA_MODE_INTERLEAVE || aux.numa_mode == NUMA_MODE_REPLICATE)
+        fprintf(stderr, "[W::%s] built without NUMA support (make numa=1); ignoring --numa\n", __func__);
+#endif
+
     /* Load bwt2/FMI index */
     uint64_t tim = __rdtsc();
     
@@ -872,6 +1566,7 @@ int main_mem(int argc, char *argv[])
     rlen = ftell(fr);
     ref_string = (uint8_t*) _mm_malloc(rlen, 64);
     aux.ref_string = ref_string;
+    aux.ref_len = rlen;
     rewind(fr);
     
     /* Reading ref. sequence */
@@ -881,6 +1576,12 @@ int main_mem(int argc, char *argv[])
     tprof[REF_IO][0] += timer - tim;
     
     fclose(fr);
+#if NUMA_ENABLED
+    if (aux.numa_mode == NUMA_MODE_INTERLEAVE || aux.numa_mode == NUMA_MODE_REPLICATE)
+        numa_set_localalloc();
+#endif
+    msz_add(MSZ_INDEX, aux.fmi->index_bytes() + rlen +
+            (aux.fmi->idx->pac? aux.fmi->idx->bns->l_pac / 4 + 1 : 0));
     fprintf(stderr, "* Reference genome size: %ld bp\n", rlen);
     fprintf(stderr, "* Done reading reference genome !!\n\n");
     
@@ -888,67 +1589,159 @@ int main_mem(int argc, char *argv[])
         for (i = 0; i < aux.fmi->idx->bns->n_seqs; ++i)
             aux.fmi->idx->bns->anns[i].is_alt = 0;
 
-    /* READS file operations */
-    ko = kopen(argv[optind + 1], &fd);
-	if (ko == 0) {
-		fprintf(stderr, "[E::%s] fail to open file `%s'.\n", __func__, argv[optind + 1]);
-        free(opt);
-        if (is_o) 
-            fclose(aux.fp);
-        delete aux.fmi;
-        // kclose(ko);
-        return 1;
-    }
-    // fp = gzopen(argv[optind + 1], "r");
-    fp = gzdopen(fd, "r");
-    aux.ks = kseq_init(fp);
-    
-    // PAIRED_END
-    /* Handling Paired-end reads */
-    aux.ks2 = 0;
-    if (optind + 2 < argc) {
-        if (opt->flag & MEM_F_PE) {
-            fprintf(stderr, "[W::%s] when '-p' is in use, the second query file is ignored.\n",
-                    __func__);
+    /* READS file operations; per entry with a manifest */
+    if (!manifest) {
+        ko = kopen(argv[optind + 1], &fd);
+		if (ko == 0) {
+			fprintf(stderr, "[E::%s] fail to open file `%s'.\n", __func__, argv[optind + 1]);
+            free(opt);
+            if (is_o) 
+                fclose(aux.fp);
+            delete aux.fmi;
+            // kclose(ko);
+            return 1;
         }
-        else
-        {
-            ko2 = kopen(argv[optind + 2], &fd2);
-            if (ko2 == 0) {
-                fprintf(stderr, "[E::%s] failed to open file `%s'.\n", __func__, argv[optind + 2]);
-                free(opt);
-                free(ko);
-                err_gzclose(fp);
-                kseq_destroy(aux.ks);
-                if (is_o) 
-                    fclose(aux.fp);             
-                delete aux.fmi;
-                kclose(ko);
-                // kclose(ko2);
-                return 1;
-            }            
-            // fp2 = gzopen(argv[optind + 2], "r");
-            fp2 = gzdopen(fd2, "r");
-            aux.ks2 = kseq_init(fp2);
-            opt->flag |= MEM_F_PE;
-            assert(aux.ks2 != 0);
+        // fp = gzopen(argv[optind + 1], "r");
+        fp = gzdopen(fd, "r");
+        aux.ks = kseq_init(fp);
+    
+        // PAIRED_END
+        /* Handling Paired-end reads */
+        aux.ks2 = 0;
+        if (optind + 2 < argc) {
+            if (opt->flag & MEM_F_PE) {
+                fprintf(stderr, "[W::%s] when '-p' is in use, the second query file is ignored.\n",
+                        __func__);
+            }
+            else
+            {
+                ko2 = kopen(argv[optind + 2], &fd2);
+                if (ko2 == 0) {
+                    fprintf(stderr, "[E::%s] failed to open file `%s'.\n", __func__, argv[optind + 2]);
+                    free(opt);
+                    free(ko);
+                    err_gzclose(fp);
+                    kseq_destroy(aux.ks);
+                    if (is_o) 
+                        fclose(aux.fp);             
+                    delete aux.fmi;
+                    kclose(ko);
+                    // kclose(ko2);
+                    return 1;
+                }            
+                // fp2 = gzopen(argv[optind + 2], "r");
+                fp2 = gzdopen(fd2, "r");
+                aux.ks2 = kseq_init(fp2);
+                opt->flag |= MEM_F_PE;
+                assert(aux.ks2 != 0);
+            }
         }
-    }
 
-    bwa_print_sam_hdr(aux.fmi->idx->bns, hdr_line, aux.fp);
+        if (!resume) bwa_print_sam_hdr(aux.fmi->idx->bns, hdr_line, aux.fp);
+    }
 
     if (fixed_chunk_size > 0)
         aux.task_size = fixed_chunk_size;
+    else if (aux.low_latency)
+        aux.task_size = LOW_LATENCY_CHUNK;
     else {
         //aux.task_size = 10000000 * opt->n_threads; //aux.actual_chunk_size;
         aux.task_size = opt->chunk_size * opt->n_threads; //aux.actual_chunk_size;
     }
+    // largest --adaptive-chunk batch
+    int64_t chunk_max = CS_MAX_MUL * (int64_t) opt->chunk_size * opt->n_threads;
+    if (chunk_max < aux.task_size) chunk_max = aux.task_size;
+    if (max_mem > 0) {
+        int64_t task_size = msz_fit_chunk((int64_t) (max_mem * 1e9), opt->n_threads,
+                                          opt->w, aux.task_size);
+        if (task_size < aux.task_size) {
+            fprintf(stderr, "* Batch size reduced from %ld to %ld bp to fit --max-mem %g GB%s\n",
+                    (long) aux.task_size, (long) task_size, max_mem,
+                    fixed_chunk_size > 0? " (overrides -K)" : "");
+            aux.task_size = chunk_max = task_size;
+        }
+        else if (adaptive_chunk)
+            chunk_max = msz_fit_chunk((int64_t) (max_mem * 1e9), opt->n_threads, opt->w, chunk_max);
+    }
     tprof[MISC][1] = opt->chunk_size = aux.actual_chunk_size = aux.task_size;
 
+    if (adaptive_chunk || chunk_log || chunk_replay) {
+        int64_t chunk_min = (int64_t) opt->n_threads * mem_tune.batch * READ_LEN;
+        if (chunk_min > aux.task_size) chunk_min = aux.task_size;
+        aux.chunk_ctl = cs_init(aux.task_size, chunk_min, chunk_max, adaptive_chunk);
+        if (chunk_replay && cs_replay(aux.chunk_ctl, chunk_replay) != 0) {
+            fprintf(stderr, "[E::%s] can't read the batch sizes of %s\n", __func__, chunk_replay);
+            exit(EXIT_FAILURE);
+        }
+        if (chunk_log && cs_log(aux.chunk_ctl, chunk_log) != 0) {
+            fprintf(stderr, "[E::%s] can't open %s for the batch sizes\n", __func__, chunk_log);
+            exit(EXIT_FAILURE);
+        }
+        if (adaptive_chunk)
+            fprintf(stderr, "* Adaptive batch size from %ld bp, between %ld and %ld bp\n",
+                    (long) aux.task_size, (long) chunk_min, (long) chunk_max);
+    }
+
+    if (resume) {
+        // the same chunks as the interrupted run, so that the insert sizes are too
+        if (ckpt.chunk != aux.task_size) {
+            fprintf(stderr, "[E::%s] the batch size is %ld bp, that of the checkpoint %ld bp; "
+                    "resume with -K %ld\n", __func__, (long) aux.task_size, (long) ckpt.chunk,
+                    (long) ckpt.chunk);
+            exit(EXIT_FAILURE);
+        }
+        if (fseeko(aux.fp, 0, SEEK_END) != 0 || ftello(aux.fp) < ckpt.out_bytes ||
+            ftruncate(fileno(aux.fp), ckpt.out_bytes) != 0 ||
+            fseeko(aux.fp, ckpt.out_bytes, SEEK_SET) != 0) {
+            fprintf(stderr, "[E::%s] %s is shorter than its checkpoint or can't be truncated\n",
+                    __func__, out_fn);
+            exit(EXIT_FAILURE);
+        }
+        if (skip_reads(aux.ks, aux.ks2, ckpt.reads) != ckpt.reads) {
+            fprintf(stderr, "[E::%s] the input has fewer than the %ld reads of the checkpoint\n",
+                    __func__, (long) ckpt.reads);
+            exit(EXIT_FAILURE);
+        }
+        aux.n_processed = aux.n_read = ckpt.reads;
+        fprintf(stderr, "* Resuming after %ld reads, %ld bytes of output\n",
+                (long) ckpt.reads, (long) ckpt.out_bytes);
+    }
+    else if (ckpt_fn) {
+        ckpt.in1 = strdup(argv[optind + 1]);
+        ckpt.in2 = strdup(optind + 2 < argc? argv[optind + 2] : "-");
+        ckpt.out = strdup(out_fn);
+        ckpt.chunk = aux.task_size;
+        // a checkpoint before the first chunk replaces that of an earlier run
+        if ((ckpt.out_bytes = ckpt_sync(aux.fp)) < 0 || ckpt_write(ckpt_fn, &ckpt) != 0)
+            fprintf(stderr, "[W::%s] can't write the checkpoint %s\n", __func__, ckpt_fn);
+    }
+    if (ckpt_fn) aux.ckpt = &ckpt, aux.ckpt_fn = ckpt_fn;
+    if (aux.shard_n > 0) {
+        std::string fn = std::string(out_fn) + SHARD_SUFFIX;
+        if ((aux.shard_fp = fopen(fn.c_str(), "w")) == NULL) {
+            fprintf(stderr, "Error: can't open %s output file\n", fn.c_str());
+            exit(EXIT_FAILURE);
+        }
+        fprintf(aux.shard_fp, SHARD_MAGIC "\t%d/%d\t%ld\n", aux.shard_i + 1, aux.shard_n,
+                (long) aux.task_size);
+        fprintf(stderr, "* Shard %d of %d: batches %d, %d, %d, ... (from 0) of %ld bp\n",
+                aux.shard_i + 1, aux.shard_n, aux.shard_i, aux.shard_i + aux.shard_n,
+                aux.shard_i + 2 * aux.shard_n, (long) aux.task_size);
+    }
+
     tim = __rdtsc();
 
     /* Relay process function */
-    process(&aux, fp, fp2, no_mt_io? 1:2);
+    thprof_alloc(opt->n_threads);
+    if (hw_counters) pc_init(opt->n_threads);
+    if (trace_fn) tr_init(opt->n_threads);
+    worker_t w;
+    worker_setup(&aux, w);
+    int n_fail = 0;
+    if (manifest)
+        n_fail = manifest_run(&aux, w, manifest, n_manifest, rg_arg, hdr_line, no_mt_io? 1:2);
+    else process(&aux, w, no_mt_io? 1:2);
+    worker_release(&aux, w);
     
     tprof[PROCESS][0] += __rdtsc() - tim;
 
@@ -957,14 +1750,30 @@ int main_mem(int argc, char *argv[])
     _mm_free(ref_string);
     free(hdr_line);
     free(opt);
-    kseq_destroy(aux.ks);   
-    err_gzclose(fp); kclose(ko);
+    if (aux.ks) {
+        kseq_destroy(aux.ks);   
+        err_gzclose(fp); kclose(ko);
+    }
 
     // PAIRED_END
     if (aux.ks2) {
         kseq_destroy(aux.ks2);
         err_gzclose(fp2); kclose(ko2);
     }
+    manifest_free(manifest, n_manifest);
+    ckpt_free(&ckpt);
+    if (aux.chunk_ctl) {
+        int64_t n_change, lo, hi;
+        cs_stats(aux.chunk_ctl, &n_change, &lo, &hi);
+        if (adaptive_chunk || chunk_replay)
+            fprintf(stderr, "* Batch sizes between %ld and %ld bp, %ld changes\n",
+                    (long) lo, (long) hi, (long) n_change);
+        cs_destroy(aux.chunk_ctl);
+    }
+    if (aux.shard_fp && fclose(aux.shard_fp) != 0) {
+        fprintf(stderr, "[E::%s] can't write the chunk list of %s\n", __func__, out_fn);
+        n_fail++;
+    }
     
     if (is_o) {
         fclose(aux.fp);
@@ -976,7 +1785,14 @@ int main_mem(int argc, char *argv[])
     /* Display runtime profiling stats */
     tprof[MEM][0] = __rdtsc() - tprof[MEM][0];
     display_stats(nt);
+    msz_report();
+    int ret = n_fail > 0;
+    if (metrics_json && write_metrics_json(metrics_json, nt) != 0) ret = 1;
+    if (trace_fn && tr_dump(trace_fn) != 0) ret = 1;
+    thprof_free();
+    pc_free();
+    tr_free();
     
-    return 0;
+    return ret;
 }
 
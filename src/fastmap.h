@@ -49,9 +49,27 @@ Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@i
 #include "bntseq.h"
 #include "kseq.h"
 #include "profiling.h"
+#include "memsize.h"
+#include "perfctr.h"
+#include "trace.h"
+#include "checkpoint.h"
 
 KSEQ_DECLARE(gzFile)
 
+/* Index placement on NUMA machines (--numa) */
+#define NUMA_MODE_AUTO       0  /* bind to node 0 when the threads fit on one socket */
+#define NUMA_MODE_OFF        1
+#define NUMA_MODE_INTERLEAVE 2  /* interleave index pages across all nodes */
+#define NUMA_MODE_REPLICATE  3  /* one index copy per node, threads pinned per node */
+
+/* Default -K of --low-latency: about 1,000 reads of 150 bp */
+#define LOW_LATENCY_CHUNK 150000
+
+/* List of the batches of a --shard output, OUT.chunks: a line with the
+   magic, "i/N" and the batch size, then "index<TAB>SAM bytes" per batch */
+#define SHARD_SUFFIX ".chunks"
+#define SHARD_MAGIC  "#bwa-mem2-shard"
+
 typedef struct {
 	kseq_t *ks, *ks2;
 	mem_opt_t *opt;
@@ -64,18 +82,50 @@ typedef struct {
 	int64_t actual_chunk_size;
 	FILE *fp;
 	uint8_t *ref_string;
+	int64_t ref_len;
 	FMI_search *fmi;	
+	int numa_mode;
+	int affinity;
+	int cosched;		// --smt-cosched
+	int low_latency;	// --low-latency
+	int dedup;		// --dedup
+	int64_t dedup_cache;	// --dedup-cache: reads or pairs kept across chunks
+	int64_t n_read;		// reads read so far, both ends of pairs counted
+	ckpt_t *ckpt;		// --checkpoint: progress written after each chunk; NULL if off
+	const char *ckpt_fn;
+	int shard_i, shard_n;	// --shard: chunks with index % shard_n == shard_i; shard_n 0 if off
+	int64_t n_chunks;	// chunks read so far, of all shards
+	FILE *shard_fp;		// chunk index and SAM bytes of each chunk written, for merge
+	struct chunk_ctl_t *chunk_ctl;	// --adaptive-chunk, --chunk-log, --chunk-replay; NULL: task_size
 } ktp_aux_t;
 
 typedef struct {
 	ktp_aux_t *aux;
 	int n_seqs;
 	bseq1_t *seqs;
+	int64_t bytes;		// reads and SAM text, for the memory accounting
+	uint64_t t_read;	// when the batch was read, for its latency
+	int64_t n_end;		// aux->n_read after this batch
+	int64_t chunk;		// index of the batch in the input
+	int64_t sam_bytes;
+	int64_t size, bp;	// bases asked for and read
 } ktp_data_t;
 
     
 void *kopen(const char *fn, int *_fd);
 int kclose(void *a);
 int main_mem(int argc, char *argv[]);
+int main_bench(int argc, char *argv[]);
+int main_serve(int argc, char *argv[]);
+int main_client(int argc, char *argv[]);
+int main_merge(int argc, char *argv[]);
+int main_tune(int argc, char *argv[]);
+
+/* Kernel buffers of a worker, shared by mem and bench */
+void memoryAlloc(ktp_aux_t *aux, worker_t &w, const mem_plan_t *plan, int32_t nthreads);
+/* Allocates for the first chunk of n reads; grows the per-read arrays for a larger one */
+void memoryFit(ktp_aux_t *aux, worker_t &w, const bseq1_t *seqs, int n, int band);
+void memoryRefit(worker_t &w, int32_t nthreads);
+void memoryFree(worker_t &w, int32_t nthreads);
 
 #endif
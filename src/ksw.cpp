@@ -397,7 +397,7 @@ kswr_t ksw_align2_orig_bak(int qlen, uint8_t *query, int tlen, uint8_t *target,
 	size = q->size;
 	// uint64_t tim = __rdtsc();
 	r = func(q, tlen, target, o_del, e_del, o_ins, e_ins, xtra);
-	// tprof[ALIGN1][tid] += __rdtsc() - tim;
+	// TPROF(ALIGN1, tid) += __rdtsc() - tim;
 
 	if (qry == 0) free(q);
 	if ((xtra & KSW_XSTART) == 0 || ((xtra & KSW_XSUBO) && r.score < (xtra & 0xffff))) return r;
@@ -406,7 +406,7 @@ kswr_t ksw_align2_orig_bak(int qlen, uint8_t *query, int tlen, uint8_t *target,
 	q = ksw_qinit(size, r.qe + 1, query, m, mat);
 	// tim = __rdtsc();
 	rr = func(q, tlen, target, o_del, e_del, o_ins, e_ins, KSW_XSTOP | r.score);
-	// tprof[ALIGN1][tid] += __rdtsc() - tim;
+	// TPROF(ALIGN1, tid) += __rdtsc() - tim;
 	
 	revseq(r.qe + 1, query); revseq(r.te + 1, target);
 	free(q);
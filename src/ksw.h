@@ -144,4 +144,27 @@ extern "C" {
 }
 #endif
 
+/**
+ * Gapless comparison of two sequences
+ *
+ * Compares 16 residues at a time and is used to scan ungapped alignments
+ * for mismatches without running the DP.
+ *
+ * @return        index of the first position in [0,len) where $a and $b
+ *                differ; len if the two sequences are identical
+ */
+static inline int ksw_first_diff(int len, const uint8_t *a, const uint8_t *b)
+{
+	int i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+		__m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+		int d = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xffff;
+		if (d) return i + __builtin_ctz(d);
+	}
+	for (; i < len; ++i)
+		if (a[i] != b[i]) break;
+	return i;
+}
+
 #endif
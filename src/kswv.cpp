@@ -80,7 +80,8 @@ extern uint64_t prof[10][112];
         __m512i gapE512 = _mm512_subs_epu8(h11, oe_ins512);             \
         e11 = _mm512_subs_epu8(e11, e_ins512);                          \
         e11 = _mm512_max_epu8(gapE512, e11);                            \
-        __m512i gapD512 = _mm512_subs_epu8(h11, oe_del512);             \
+        __m512i gapD512 = S::fixed? gapE512 : /* same ins/del penalties */ \
+            _mm512_subs_epu8(h11, oe_del512);                           \
         f21 = _mm512_subs_epu8(f11, e_del512);                          \
         f21 = _mm512_max_epu8(gapD512, f21);                            \
     }
@@ -103,7 +104,8 @@ extern uint64_t prof[10][112];
         __m512i gapE512 = _mm512_sub_epi16(h11, oe_ins512);             \
         e11 = _mm512_sub_epi16(e11, e_ins512);                          \
         e11 = _mm512_max_epi16(gapE512, e11);                           \
-        __m512i gapD512 = _mm512_sub_epi16(h11, oe_del512);             \
+        __m512i gapD512 = S::fixed? gapE512 : /* same ins/del penalties */ \
+            _mm512_sub_epi16(h11, oe_del512);                           \
         f21 = _mm512_sub_epi16(f11, e_del512);                          \
         f21 = _mm512_max_epi16(gapD512, f21);                           \
     }
@@ -169,11 +171,27 @@ void kswv::getScores8(SeqPair *pairArray,
                       uint16_t numThreads,
                       int phase)
 {
-    kswvBatchWrapper8(pairArray, seqBufRef, seqBufQer, aln,
-                      numPairs, numThreads, phase);
+    switch (sw_score_find(w_match, -w_mismatch, o_del, e_del, o_ins, e_ins, -1, -1)) {
+    case SW_SCORE_DEFAULT:
+        kswvBatchWrapper8<sw_score_default>(pairArray, seqBufRef, seqBufQer, aln,
+                                            numPairs, numThreads, phase);
+        break;
+    case SW_SCORE_INTRACTG:
+        kswvBatchWrapper8<sw_score_intractg>(pairArray, seqBufRef, seqBufQer, aln,
+                                             numPairs, numThreads, phase);
+        break;
+    case SW_SCORE_PACBIO:
+        kswvBatchWrapper8<sw_score_pacbio>(pairArray, seqBufRef, seqBufQer, aln,
+                                           numPairs, numThreads, phase);
+        break;
+    default:
+        kswvBatchWrapper8<sw_score_any>(pairArray, seqBufRef, seqBufQer, aln,
+                                        numPairs, numThreads, phase);
+    }
 }
 
 #define PFD_ 2
+template <class S>
 void kswv::kswvBatchWrapper8(SeqPair *pairArray,
                              uint8_t *seqBufRef,
                              uint8_t *seqBufQer,
@@ -317,13 +335,13 @@ void kswv::kswvBatchWrapper8(SeqPair *pairArray,
                 }
             }
 
-            kswv512_u8(mySeq1SoA, mySeq2SoA,
-                       maxLen1, maxLen2,
-                       pairArray + i,
-                       aln, i,
-                       tid,
-                       numPairs,
-                       phase);
+            kswv512_u8<S>(mySeq1SoA, mySeq2SoA,
+                          maxLen1, maxLen2,
+                          pairArray + i,
+                          aln, i,
+                          tid,
+                          numPairs,
+                          phase);
         }
     }
 
@@ -368,6 +386,7 @@ void kswv::kswvBatchWrapper8(SeqPair *pairArray,
     return;
 }
 
+template <class S>
 int kswv::kswv512_u8(uint8_t seq1SoA[],
                      uint8_t seq2SoA[],
                      int16_t nrow,
@@ -383,6 +402,13 @@ int kswv::kswv512_u8(uint8_t seq1SoA[],
     uint8_t minsc[SIMD_WIDTH8] __attribute__((aligned(64))) = {0};
     uint8_t endsc[SIMD_WIDTH8] __attribute__((aligned(64))) = {0};
     uint64_t *b;
+    // a preset's scoring is a compile-time constant
+    const int8_t w_match = S::fixed? (int) S::a : this->w_match;
+    const int8_t w_mismatch = S::fixed? (int) -S::b : this->w_mismatch;
+    const int o_del = S::fixed? (int) S::o : this->o_del;
+    const int e_del = S::fixed? (int) S::e : this->e_del;
+    const int o_ins = S::fixed? (int) S::o : this->o_ins;
+    const int e_ins = S::fixed? (int) S::e : this->e_ins;
 
     __m512i zero512 = _mm512_setzero_si512();
     __m512i one512  = _mm512_set1_epi8(1);
@@ -392,17 +418,17 @@ int kswv::kswv512_u8(uint8_t seq1SoA[],
     int8_t temp[SIMD_WIDTH8] __attribute((aligned(64))) = {0};
 
     uint8_t shift = 127, mdiff = 0, qmax_;
-    mdiff = max_(this->w_match, (int8_t) this->w_mismatch);
+    mdiff = max_(w_match, (int8_t) w_mismatch);
     mdiff = max_(mdiff, (int8_t) this->w_ambig);
-    shift = min_(this->w_match, (int8_t) this->w_mismatch);
+    shift = min_(w_match, (int8_t) w_mismatch);
     shift = min_((int8_t) shift, this->w_ambig);
 
     qmax_ = mdiff;
     shift = 256 - (uint8_t) shift;
     mdiff += shift;
     
-    temp[0] = this->w_match;                                   // states: 1. matches
-    temp[1] = temp[2] = temp[3] =  this->w_mismatch;           // 2. mis-matches
+    temp[0] = w_match;                                         // states: 1. matches
+    temp[1] = temp[2] = temp[3] =  w_mismatch;                 // 2. mis-matches
     temp[4] = temp[5] = temp[6] = temp[7] =  this->w_ambig;    // 3. beyond boundary
     temp[8] = temp[9] = temp[10] = temp[11] = this->w_ambig;   // 4. 0 - sse2 region
     temp[12] = this->w_ambig;                                  // 5. ambig
@@ -442,11 +468,11 @@ int kswv::kswv512_u8(uint8_t seq1SoA[],
     __m512i minsc512 = _mm512_load_si512((__m512i*) minsc);
     __m512i endsc512 = _mm512_load_si512((__m512i*) endsc);
        
-    __m512i mismatch512 = _mm512_set1_epi8(this->w_mismatch + shift);
-    __m512i e_del512    = _mm512_set1_epi8(this->e_del);
-    __m512i oe_del512   = _mm512_set1_epi8(this->o_del + this->e_del);
-    __m512i e_ins512    = _mm512_set1_epi8(this->e_ins);
-    __m512i oe_ins512   = _mm512_set1_epi8(this->o_ins + this->e_ins);
+    __m512i mismatch512 = _mm512_set1_epi8(w_mismatch + shift);
+    __m512i e_del512    = _mm512_set1_epi8(e_del);
+    __m512i oe_del512   = _mm512_set1_epi8(o_del + e_del);
+    __m512i e_ins512    = _mm512_set1_epi8(e_ins);
+    __m512i oe_ins512   = _mm512_set1_epi8(o_ins + e_ins);
     __m512i five512     = _mm512_set1_epi8(DUMMY5); // ambig mapping element
     __m512i gmax512     = zero512; // exit1 = zero512;
     __m512i te512       = _mm512_set1_epi16(-1);  // changed to -1
@@ -542,7 +568,7 @@ int kswv::kswv512_u8(uint8_t seq1SoA[],
             break;
         }       
 
-        uint8_t *S = H1; H1 = H0; H0 = S;
+        uint8_t *Ht = H1; H1 = H0; H0 = Ht;
         i512 = _mm512_add_epi16(i512, one512);
     } // for nrow
 
@@ -718,10 +744,26 @@ void kswv::getScores16(SeqPair *pairArray,
                        uint16_t numThreads,
                        int phase)
 {
-    kswvBatchWrapper16(pairArray, seqBufRef, seqBufQer, aln,
-                       numPairs, numThreads, phase);
+    switch (sw_score_find(w_match, -w_mismatch, o_del, e_del, o_ins, e_ins, -1, -1)) {
+    case SW_SCORE_DEFAULT:
+        kswvBatchWrapper16<sw_score_default>(pairArray, seqBufRef, seqBufQer, aln,
+                                             numPairs, numThreads, phase);
+        break;
+    case SW_SCORE_INTRACTG:
+        kswvBatchWrapper16<sw_score_intractg>(pairArray, seqBufRef, seqBufQer, aln,
+                                              numPairs, numThreads, phase);
+        break;
+    case SW_SCORE_PACBIO:
+        kswvBatchWrapper16<sw_score_pacbio>(pairArray, seqBufRef, seqBufQer, aln,
+                                            numPairs, numThreads, phase);
+        break;
+    default:
+        kswvBatchWrapper16<sw_score_any>(pairArray, seqBufRef, seqBufQer, aln,
+                                         numPairs, numThreads, phase);
+    }
 }
 
+template <class S>
 void kswv::kswvBatchWrapper16(SeqPair *pairArray,
                               uint8_t *seqBufRef,
                               uint8_t *seqBufQer,
@@ -881,13 +923,13 @@ void kswv::kswvBatchWrapper16(SeqPair *pairArray,
                 }
             }
 
-            kswv512_16(mySeq1SoA, mySeq2SoA,
-                       maxLen1, maxLen2,
-                       pairArray + i,
-                       aln, i,
-                       tid,
-                       numPairs,
-                       phase);
+            kswv512_16<S>(mySeq1SoA, mySeq2SoA,
+                          maxLen1, maxLen2,
+                          pairArray + i,
+                          aln, i,
+                          tid,
+                          numPairs,
+                          phase);
         }
     }
 
@@ -930,6 +972,7 @@ void kswv::kswvBatchWrapper16(SeqPair *pairArray,
     return; 
 }
 
+template <class S>
 int kswv::kswv512_16(int16_t seq1SoA[],
                      int16_t seq2SoA[],
                      int16_t nrow,
@@ -945,6 +988,13 @@ int kswv::kswv512_16(int16_t seq1SoA[],
     int16_t minsc[SIMD_WIDTH16] = {0}, endsc[SIMD_WIDTH16] = {0};
     uint64_t *b;
     int limit = nrow;
+    // a preset's scoring is a compile-time constant
+    const int8_t w_match = S::fixed? (int) S::a : this->w_match;
+    const int8_t w_mismatch = S::fixed? (int) -S::b : this->w_mismatch;
+    const int o_del = S::fixed? (int) S::o : this->o_del;
+    const int e_del = S::fixed? (int) S::e : this->e_del;
+    const int o_ins = S::fixed? (int) S::o : this->o_ins;
+    const int e_ins = S::fixed? (int) S::e : this->e_ins;
     
     __m512i zero512 = _mm512_setzero_si512();
     __m512i one512  = _mm512_set1_epi16(1);
@@ -963,8 +1013,8 @@ int kswv::kswv512_16(int16_t seq1SoA[],
     // temp[12] = temp[13] = temp[14] = temp[15] =  this->w_ambig;
     // temp[10] = temp[20] = temp[30] = this->w_mismatch;
     
-    temp[0] = this->w_match;    // matching
-    temp[1]  = temp[2]  = temp[3]  =  this->w_mismatch;  // mis-matching    
+    temp[0] = w_match;    // matching
+    temp[1]  = temp[2]  = temp[3]  =  w_mismatch;  // mis-matching    
     temp[12] = temp[13] = temp[14] = temp[15] =  this->w_ambig;
     temp[16] = temp[17] = temp[18] = temp[19] = this->w_ambig;
     temp[31] = this->w_ambig;
@@ -997,10 +1047,10 @@ int kswv::kswv512_16(int16_t seq1SoA[],
     __m512i minsc512 = _mm512_load_si512((__m512i*) minsc);
     __m512i endsc512 = _mm512_load_si512((__m512i*) endsc);
     
-    __m512i e_del512    = _mm512_set1_epi16(this->e_del);
-    __m512i oe_del512   = _mm512_set1_epi16(this->o_del + this->e_del);
-    __m512i e_ins512    = _mm512_set1_epi16(this->e_ins);
-    __m512i oe_ins512   = _mm512_set1_epi16(this->o_ins + this->e_ins);
+    __m512i e_del512    = _mm512_set1_epi16(e_del);
+    __m512i oe_del512   = _mm512_set1_epi16(o_del + e_del);
+    __m512i e_ins512    = _mm512_set1_epi16(e_ins);
+    __m512i oe_ins512   = _mm512_set1_epi16(o_ins + e_ins);
     __m512i gmax512     = zero512; // exit1 = zero512;
     // __m512i te512       = zero512;  // change to -1
     __m512i te512       = _mm512_set1_epi16(-1);
@@ -1102,7 +1152,7 @@ int kswv::kswv512_16(int16_t seq1SoA[],
             break;
         }
         
-        int16_t *S = H1; H1 = H0; H0 = S;
+        int16_t *Ht = H1; H1 = H0; H0 = Ht;
         i512 = _mm512_add_epi16(i512, one512);
     } // for nrow
     
@@ -34,6 +34,7 @@ Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@i
 #include <stdint.h>
 #include <assert.h>
 #include "macro.h"
+#include "score_traits.h"
 
 #if !MAINY
 #include "ksw.h"
@@ -160,6 +161,7 @@ public:
 	
 private:
 #if __AVX512BW__
+	template <class S>
 	void kswvBatchWrapper8(SeqPair *pairArray,
 						   uint8_t *seqBufRef,
 						   uint8_t *seqBufQer,
@@ -168,6 +170,7 @@ private:
 						   uint16_t numThreads,
 						   int phase);
 
+	template <class S>
 	int kswv512_u8(uint8_t seq1SoA[],
 				   uint8_t seq2SoA[],
 				   int16_t nrow,
@@ -179,6 +182,7 @@ private:
 				   int32_t numPairs,
 				   int phase);
     
+	template <class S>
 	void kswvBatchWrapper16(SeqPair *pairArray,
 							uint8_t *seqBufRef,
 							uint8_t *seqBufQer,
@@ -187,6 +191,7 @@ private:
 							uint16_t numThreads,
 							int phase);
 	
+	template <class S>
 	int kswv512_16(int16_t seq1SoA[],
                    int16_t seq2SoA[],
                    int16_t nrow,
@@ -30,12 +30,9 @@
 *****************************************************************************************/
 
 #include "kthread.h"
+#include "tune.h"
 #include <stdio.h>
 
-#if AFF && (__linux__)
-extern int affy[256];
-#endif
-
 extern uint64_t tprof[LIM_R][LIM_C];
 
 static inline long steal_work(kt_for_t *t)
@@ -46,70 +43,317 @@ static inline long steal_work(kt_for_t *t)
 		if (min > t->w[i].i) min = t->w[i].i, min_i = i;
 	k = __sync_fetch_and_add(&t->w[min_i].i, t->n_threads);
 	// return k >= t->n? -1 : k;
-	return k*BATCH_SIZE >= t->n? -1 : k;
+	return k*t->grain >= t->n? -1 : k;
 }
 
 /******** Current working code *********/
-static void *ktf_worker(void *data)
+static void ktf_run(ktf_worker_t *w)
 {
-	ktf_worker_t *w = (ktf_worker_t*)data;
 	long i;
-	int tid = w->i;
-
-#if AFF && (__linux__)
-	fprintf(stderr, "i: %d, CPU: %d\n", tid , sched_getcpu());
-#endif
+	int g = w->t->grain;
 	
 	for (;;) {
 		i = __sync_fetch_and_add(&w->i, w->t->n_threads);
-		int st = i * BATCH_SIZE;
+		int st = i * g;
 		if (st >= w->t->n) break;
-		int ed = (i + 1) * BATCH_SIZE < w->t->n? (i + 1) * BATCH_SIZE : w->t->n;
-		// w->t->func(w->t->data, st, ed-st, tid);
+		int ed = (i + 1) * g < w->t->n? (i + 1) * g : w->t->n;
         w->t->func(w->t->data, st, ed-st, w - w->t->w);
 	}
 
 	while ((i = steal_work(w->t)) >= 0) {
-		int st = i * BATCH_SIZE;
-		int ed = (i + 1) * BATCH_SIZE < w->t->n? (i + 1) * BATCH_SIZE : w->t->n;
+		int st = i * g;
+		int ed = (i + 1) * g < w->t->n? (i + 1) * g : w->t->n;
 		w->t->func(w->t->data, st, ed-st, w - w->t->w);
 	}
+}
+
+static void *ktf_worker(void *data)
+{
+	ktf_run((ktf_worker_t*)data);
 	pthread_exit(0);
 }
 
+/* Starts compute thread i of w, pinned as the worker asks */
+static void kt_spawn(worker_t *w, int i, pthread_t *tid, void *(*func)(void*), void *arg)
+{
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	if (w->thread_cpu) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(w->thread_cpu[i], &cpus);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpus);
+	}
+#if NUMA_ENABLED
+	else if (w->n_nodes > 0)
+		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &w->node_cpus[w->tid_node[i]]);
+#endif
+	pthread_create(tid, &attr, func, arg);
+	pthread_attr_destroy(&attr);
+}
+
+/******** Warm pool: kt_for without a thread start per phase *********/
+typedef struct {
+	struct kt_pool_t *p;
+	int i;
+} kt_pool_arg_t;
+
+typedef struct kt_pool_t {
+	int n_threads;
+	pthread_t *tid;
+	kt_pool_arg_t *arg;
+	void (*run)(void*, int);	// runs thread i of the running job
+	void *job;			// the running kt_for or kt_for_pair
+	long gen;			// jobs handed out so far
+	int n_left, stop;	// threads still on the job; set to end the threads
+	pthread_mutex_t mutex;
+	pthread_cond_t cv_job, cv_done;
+} kt_pool_t;
+
+static void *kt_pool_worker(void *data)
+{
+	kt_pool_arg_t *a = (kt_pool_arg_t*)data;
+	kt_pool_t *p = a->p;
+	long seen = 0;
+	for (;;) {
+		pthread_mutex_lock(&p->mutex);
+		while (p->gen == seen && !p->stop)
+			pthread_cond_wait(&p->cv_job, &p->mutex);
+		if (p->stop) {
+			pthread_mutex_unlock(&p->mutex);
+			break;
+		}
+		seen = p->gen;
+		void (*run)(void*, int) = p->run;
+		void *job = p->job;
+		pthread_mutex_unlock(&p->mutex);
+
+		run(job, a->i);
+
+		pthread_mutex_lock(&p->mutex);
+		if (--p->n_left == 0) pthread_cond_signal(&p->cv_done);
+		pthread_mutex_unlock(&p->mutex);
+	}
+	return 0;
+}
+
+kt_pool_t *kt_pool_init(worker_t *w)
+{
+	kt_pool_t *p = (kt_pool_t*) calloc(1, sizeof(kt_pool_t));
+	assert(p != NULL);
+	p->n_threads = w->nthreads;
+	p->tid = (pthread_t*) malloc(p->n_threads * sizeof(pthread_t));
+	p->arg = (kt_pool_arg_t*) malloc(p->n_threads * sizeof(kt_pool_arg_t));
+	assert(p->tid != NULL && p->arg != NULL);
+	pthread_mutex_init(&p->mutex, 0);
+	pthread_cond_init(&p->cv_job, 0);
+	pthread_cond_init(&p->cv_done, 0);
+	for (int i = 0; i < p->n_threads; ++i) {
+		p->arg[i].p = p, p->arg[i].i = i;
+		kt_spawn(w, i, &p->tid[i], kt_pool_worker, &p->arg[i]);
+	}
+	return p;
+}
+
+void kt_pool_destroy(kt_pool_t *p)
+{
+	if (p == NULL) return;
+	pthread_mutex_lock(&p->mutex);
+	p->stop = 1;
+	pthread_cond_broadcast(&p->cv_job);
+	pthread_mutex_unlock(&p->mutex);
+	for (int i = 0; i < p->n_threads; ++i) pthread_join(p->tid[i], 0);
+	pthread_mutex_destroy(&p->mutex);
+	pthread_cond_destroy(&p->cv_job);
+	pthread_cond_destroy(&p->cv_done);
+	free(p->tid);
+	free(p->arg);
+	free(p);
+}
+
+/* Hands job to the threads of the pool and waits until all have run it */
+static void kt_pool_run(kt_pool_t *p, void (*run)(void*, int), void *job)
+{
+	pthread_mutex_lock(&p->mutex);
+	p->run = run, p->job = job, p->n_left = p->n_threads, p->gen++;
+	pthread_cond_broadcast(&p->cv_job);
+	while (p->n_left > 0)
+		pthread_cond_wait(&p->cv_done, &p->mutex);
+	p->job = NULL;
+	pthread_mutex_unlock(&p->mutex);
+}
+
+/* Items per work unit; sets w->grain */
+static int kt_grain(worker_t *w, int n)
+{
+	int grain = mem_tune.batch, nt = w->nthreads;
+	if (w->pool && nt > 1) {
+		// small batches: split below mem_tune.batch so that every thread gets work
+		int g = (n + KT_SPLIT * nt - 1) / (KT_SPLIT * nt);
+		g = (g + 1) & ~1;	// whole pairs
+		grain = g < KT_MIN_GRAIN? KT_MIN_GRAIN : g > mem_tune.batch? mem_tune.batch : g;
+	}
+	return w->grain = grain;
+}
+
+static void ktf_pool_run(void *job, int i)
+{
+	ktf_run(&((kt_for_t*)job)->w[i]);
+}
+
 void kt_for(void (*func)(void*, int, int, int), void *data, int n)
 {
 	int i;
 	kt_for_t t;
-	pthread_t *tid;
 	worker_t *w = (worker_t*) data;
 	t.func = func, t.data = data, t.n_threads = w->nthreads, t.n = n;
+	t.grain = kt_grain(w, n);
 	t.w = (ktf_worker_t*) malloc (t.n_threads * sizeof(ktf_worker_t));
     assert(t.w != NULL);
-	tid = (pthread_t*) malloc (t.n_threads * sizeof(pthread_t));
-    assert(tid != NULL);
 	for (i = 0; i < t.n_threads; ++i)
 		t.w[i].t = &t, t.w[i].i = i;
 
-	pthread_attr_t attr;
-    pthread_attr_init(&attr);
-	
-	// printf("getcpu: %d\n", sched_getcpu());
-	for (i = 0; i < t.n_threads; ++i) {
-#if AFF && (__linux__)
-		cpu_set_t cpus;
-		CPU_ZERO(&cpus);
-		// CPU_SET(i, &cpus);
-		CPU_SET(affy[i], &cpus);
-		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpus);	
-		pthread_create(&tid[i], &attr, ktf_worker, &t.w[i]);
-#else
-		pthread_create(&tid[i], NULL, ktf_worker, &t.w[i]);
-#endif
+	if (w->pool)
+		kt_pool_run(w->pool, ktf_pool_run, &t);
+	else {
+		pthread_t *tid = (pthread_t*) malloc (t.n_threads * sizeof(pthread_t));
+		assert(tid != NULL);
+		for (i = 0; i < t.n_threads; ++i)
+			kt_spawn(w, i, &tid[i], ktf_worker, &t.w[i]);
+		for (i = 0; i < t.n_threads; ++i) pthread_join(tid[i], 0);
+		free(tid);
 	}
-	for (i = 0; i < t.n_threads; ++i) pthread_join(tid[i], 0);
-
-    pthread_attr_destroy(&attr);
     free(t.w);
-	free(tid);
+}
+
+/******** Paired phases: f1 and f2 of a unit overlapped on a thread pair *********/
+typedef struct {
+	int *q;			// units done with f1 by the first thread, waiting for f2
+	int head, tail;
+	int done;		// the first thread has no f1 unit left
+	pthread_mutex_t mutex;
+	pthread_cond_t cv;
+} kt_pair_t;
+
+typedef struct kt_for_pair_t {
+	int n_threads, grain;
+	long n, n_units;
+	long next;		// next unit for f1, over all pairs
+	kt_pair_t *pair;
+	void (*f1)(void*, int, int, int), (*f2)(void*, int, int, int);
+	void *data;
+} kt_for_pair_t;
+
+typedef struct {
+	kt_for_pair_t *t;
+	int i;
+} kt_pair_arg_t;
+
+static inline void kt_pair_unit(kt_for_pair_t *t, void (*f)(void*, int, int, int), long u, int tid)
+{
+	int st = u * t->grain;
+	int ed = (u + 1) * t->grain < t->n? (u + 1) * t->grain : t->n;
+	f(t->data, st, ed - st, tid);
+}
+
+/* A unit waiting for f2 in the queue of p, -1 if none; with wait, blocks
+   until one arrives or the first thread is done */
+static long kt_pair_take(kt_pair_t *p, int wait)
+{
+	long u = -1;
+	pthread_mutex_lock(&p->mutex);
+	while (wait && p->head == p->tail && !p->done)
+		pthread_cond_wait(&p->cv, &p->mutex);
+	if (p->head < p->tail) u = p->q[p->head++];
+	pthread_mutex_unlock(&p->mutex);
+	return u;
+}
+
+static void kt_pair_run(void *job, int tid)
+{
+	kt_for_pair_t *t = (kt_for_pair_t*) job;
+	kt_pair_t *p = &t->pair[tid >> 1];
+	long u;
+	if ((tid & 1) == 0) {
+		// f1, each unit then queued for the sibling; f2 while the sibling is behind
+		for (;;) {
+			pthread_mutex_lock(&p->mutex);
+			int behind = p->tail - p->head >= KT_PAIR_AHEAD;
+			pthread_mutex_unlock(&p->mutex);
+			if (behind && (u = kt_pair_take(p, 0)) >= 0) {
+				kt_pair_unit(t, t->f2, u, tid);
+				continue;
+			}
+			if ((u = __sync_fetch_and_add(&t->next, 1)) >= t->n_units) break;
+			kt_pair_unit(t, t->f1, u, tid);
+			pthread_mutex_lock(&p->mutex);
+			p->q[p->tail++] = u;
+			pthread_cond_signal(&p->cv);
+			pthread_mutex_unlock(&p->mutex);
+		}
+		pthread_mutex_lock(&p->mutex);
+		p->done = 1;
+		pthread_cond_signal(&p->cv);
+		pthread_mutex_unlock(&p->mutex);
+		while ((u = kt_pair_take(p, 0)) >= 0)
+			kt_pair_unit(t, t->f2, u, tid);
+	} else {
+		// f2 of the sibling's units; both of a unit of its own while none is queued
+		for (;;) {
+			if ((u = kt_pair_take(p, 0)) < 0) {
+				if ((u = __sync_fetch_and_add(&t->next, 1)) < t->n_units)
+					kt_pair_unit(t, t->f1, u, tid);
+				else if ((u = kt_pair_take(p, 1)) < 0) break;
+			}
+			kt_pair_unit(t, t->f2, u, tid);
+		}
+	}
+}
+
+static void *kt_pair_worker(void *data)
+{
+	kt_pair_arg_t *a = (kt_pair_arg_t*)data;
+	kt_pair_run(a->t, a->i);
+	pthread_exit(0);
+}
+
+void kt_for_pair(void (*f1)(void*, int, int, int), void (*f2)(void*, int, int, int),
+				 void *data, int n)
+{
+	int i;
+	kt_for_pair_t t;
+	worker_t *w = (worker_t*) data;
+	t.f1 = f1, t.f2 = f2, t.data = data, t.n_threads = w->nthreads, t.n = n;
+	t.grain = kt_grain(w, n);
+	t.n_units = (n + t.grain - 1) / t.grain, t.next = 0;
+	int n_pairs = (t.n_threads + 1) >> 1;
+	t.pair = (kt_pair_t*) calloc(n_pairs, sizeof(kt_pair_t));
+	assert(t.pair != NULL);
+	for (i = 0; i < n_pairs; ++i) {
+		t.pair[i].q = (int*) malloc((t.n_units + 1) * sizeof(int));
+		assert(t.pair[i].q != NULL);
+		pthread_mutex_init(&t.pair[i].mutex, 0);
+		pthread_cond_init(&t.pair[i].cv, 0);
+	}
+
+	if (w->pool)
+		kt_pool_run(w->pool, kt_pair_run, &t);
+	else {
+		pthread_t *tid = (pthread_t*) malloc(t.n_threads * sizeof(pthread_t));
+		kt_pair_arg_t *arg = (kt_pair_arg_t*) malloc(t.n_threads * sizeof(kt_pair_arg_t));
+		assert(tid != NULL && arg != NULL);
+		for (i = 0; i < t.n_threads; ++i) {
+			arg[i].t = &t, arg[i].i = i;
+			kt_spawn(w, i, &tid[i], kt_pair_worker, &arg[i]);
+		}
+		for (i = 0; i < t.n_threads; ++i) pthread_join(tid[i], 0);
+		free(tid);
+		free(arg);
+	}
+	for (i = 0; i < n_pairs; ++i) {
+		free(t.pair[i].q);
+		pthread_mutex_destroy(&t.pair[i].mutex);
+		pthread_cond_destroy(&t.pair[i].cv);
+	}
+	free(t.pair);
 }
@@ -78,6 +78,7 @@ typedef struct {
 
 typedef struct kt_for_t {
 	int n_threads;
+	int grain;		// items per work unit
 	long n;
 	ktf_worker_t *w;
 	void (*func)(void*, int, int, int);
@@ -87,4 +88,22 @@ typedef struct kt_for_t {
 
 void kt_pipeline(int n_threads, int (*func)(void*), void *shared_data, int n_steps);
 void kt_for(void (*func)(void*,int,int,int), void *data, int n);
+
+/* Warm pool of the compute threads of a worker (worker_t.pool). kt_for then
+   hands its phases to the waiting threads and splits small batches into
+   units of at least KT_MIN_GRAIN reads, KT_SPLIT per thread. */
+#define KT_MIN_GRAIN 32
+#define KT_SPLIT     4
+struct kt_pool_t *kt_pool_init(worker_t *w);
+void kt_pool_destroy(struct kt_pool_t *p);
+
+/* f1 and then f2 over the same work units, overlapped on thread pairs
+   (2p, 2p+1; worker_t.cosched): the first thread runs f1 and queues each
+   unit for the second, which runs f2 on it. A first thread more than
+   KT_PAIR_AHEAD units ahead runs f2 itself; a second thread with nothing
+   queued runs both on a unit of its own. With the threads of a pair on the
+   SMT siblings of a core, a memory-bound f1 shares the core with a
+   compute-bound f2 instead of its own kind. */
+#define KT_PAIR_AHEAD 2
+void kt_for_pair(void (*f1)(void*,int,int,int), void (*f2)(void*,int,int,int), void *data, int n);
 #endif
@@ -0,0 +1,166 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+#include "fastmap.h"
+#include "libbwamem2.h"
+
+struct bm2_index_t {
+    FMI_search *fmi;
+    uint8_t *ref_string;
+    int64_t ref_len;
+};
+
+struct bm2_aligner_t {
+    mem_opt_t opt;
+    char *rg_id;
+    worker_t w;
+    int64_t n_processed;
+    int n_batches;
+};
+
+bm2_index_t *bm2_idx_load(const char *prefix)
+{
+    char fn[PATH_MAX];
+    snprintf(fn, PATH_MAX, "%s.0123", prefix);
+    FILE *fr = fopen(fn, "r");
+    if (fr == NULL) {
+        fprintf(stderr, "[E::%s] can't open %s\n", __func__, fn);
+        return NULL;
+    }
+    if (proc_freq == 0) proc_freq = tsc_freq();
+
+    bm2_index_t *idx = (bm2_index_t *) calloc(1, sizeof(bm2_index_t));
+    assert(idx != NULL);
+    idx->fmi = new FMI_search(prefix);
+    idx->fmi->load_index();
+
+    fseek(fr, 0, SEEK_END);
+    idx->ref_len = ftell(fr);
+    rewind(fr);
+    idx->ref_string = (uint8_t *) _mm_malloc(idx->ref_len, 64);
+    assert(idx->ref_string != NULL);
+    err_fread_noeof(idx->ref_string, 1, idx->ref_len, fr);
+    fclose(fr);
+    msz_add(MSZ_INDEX, idx->fmi->index_bytes() + idx->ref_len);
+    return idx;
+}
+
+void bm2_idx_destroy(bm2_index_t *idx)
+{
+    if (idx == NULL) return;
+    msz_add(MSZ_INDEX, -(idx->fmi->index_bytes() + idx->ref_len));
+    _mm_free(idx->ref_string);
+    delete idx->fmi;
+    free(idx);
+}
+
+const bntseq_t *bm2_idx_bns(const bm2_index_t *idx)
+{
+    return idx->fmi->idx->bns;
+}
+
+bm2_aligner_t *bm2_aligner_init(const bm2_index_t *idx, const mem_opt_t *opt, int nthreads)
+{
+    if (nthreads < 1) nthreads = 1;
+    bm2_aligner_t *al = (bm2_aligner_t *) calloc(1, sizeof(bm2_aligner_t));
+    assert(al != NULL);
+    al->opt.n_threads = nthreads;
+    bm2_aligner_set_opt(al, opt);
+
+    al->w.nthreads = nthreads;
+    al->w.fmi = idx->fmi;
+    al->w.ref_string = idx->ref_string;
+    al->w.pool = kt_pool_init(&al->w);     // batches of a library caller are often small
+    thprof_reserve(nthreads);
+    return al;
+}
+
+void bm2_aligner_destroy(bm2_aligner_t *al)
+{
+    if (al == NULL) return;
+    kt_pool_destroy(al->w.pool);
+    memoryFree(al->w, al->w.nthreads);
+    free(al->rg_id);
+    free(al);
+}
+
+void bm2_aligner_set_opt(bm2_aligner_t *al, const mem_opt_t *opt)
+{
+    int nthreads = al->opt.n_threads;
+    free(al->rg_id);
+    al->rg_id = NULL;
+    al->opt = *opt;
+    al->opt.n_threads = nthreads;
+    if (opt->rg_id) al->opt.rg_id = al->rg_id = strdup(opt->rg_id);
+}
+
+void bm2_aligner_seek(bm2_aligner_t *al, int64_t n_processed)
+{
+    al->n_processed = n_processed;
+}
+
+int bm2_align(bm2_aligner_t *al, int n, bseq1_t *seqs, const mem_pestat_t *pes0,
+              mem_aln_v *alns)
+{
+    if ((al->opt.flag & MEM_F_PE) && n % 2 != 0) {
+        fprintf(stderr, "[E::%s] odd number of paired-end reads: %d\n", __func__, n);
+        return -1;
+    }
+    if (n == 0) return 0;
+
+    worker_t &w = al->w;
+    memoryFit(NULL, w, seqs, n, al->opt.w);
+    if (alns) memset(alns, 0, n * sizeof(mem_aln_v));
+    w.alnv = alns;
+    mem_process_seqs(&al->opt, al->n_processed, n, seqs, pes0, w);
+    w.alnv = NULL;
+    al->n_processed += n;
+    // the buffers follow the first batch, as after the first chunk of mem
+    if (al->n_batches++ == 0) memoryRefit(w, w.nthreads);
+    return 0;
+}
+
+void bm2_alns_free(int n, mem_aln_v *alns)
+{
+    for (int i = 0; i < n; i++) {
+        for (size_t j = 0; j < alns[i].n; j++) {
+            free(alns[i].a[j].cigar);
+            free(alns[i].a[j].XA);
+        }
+        free(alns[i].a);
+        alns[i].n = alns[i].m = 0;
+        alns[i].a = NULL;
+    }
+}
@@ -0,0 +1,83 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+/*
+ * Embeddable aligner: load an index once, align many batches.
+ *
+ *   bm2_index_t *idx = bm2_idx_load("ref.fa");
+ *   mem_opt_t *opt = mem_opt_init();        // adjust, then hand to the aligner
+ *   bm2_aligner_t *al = bm2_aligner_init(idx, opt, 4);
+ *   bm2_align(al, n, seqs, NULL, alns);     // seqs[i].sam and/or alns[i]
+ *   ...
+ *   bm2_aligner_destroy(al);
+ *   bm2_idx_destroy(idx);
+ *
+ * An aligner owns the kernel buffers of its threads and is used by one
+ * caller at a time; any number of aligners may share an index and run
+ * concurrently. The profiling counters (tprof) and bwa_verbose remain
+ * process-wide.
+ */
+
+#ifndef LIBBWAMEM2_H
+#define LIBBWAMEM2_H
+
+#include "bwamem.h"
+
+typedef struct bm2_index_t bm2_index_t;
+typedef struct bm2_aligner_t bm2_aligner_t;
+
+/* FM-index and 2-bit reference of an index prefix; NULL if the .0123 file can't be read */
+bm2_index_t *bm2_idx_load(const char *prefix);
+void bm2_idx_destroy(bm2_index_t *idx);
+const bntseq_t *bm2_idx_bns(const bm2_index_t *idx);
+
+/* Aligner with a copy of opt (MEM_F_PE selects paired-end) running nthreads threads */
+bm2_aligner_t *bm2_aligner_init(const bm2_index_t *idx, const mem_opt_t *opt, int nthreads);
+void bm2_aligner_destroy(bm2_aligner_t *al);
+/* Replaces the options between batches; the thread count stays */
+void bm2_aligner_set_opt(bm2_aligner_t *al, const mem_opt_t *opt);
+/* Number of reads mapped before the next batch, which seeds the per-read
+   random choices; 0 maps a new read set as a new mem run would */
+void bm2_aligner_seek(bm2_aligner_t *al, int64_t n_processed);
+
+/*
+ * Maps n reads; in paired-end mode n is even and mates are adjacent. The
+ * sequences are converted to 2-bit codes in place; the SAM lines of read i
+ * are left in seqs[i].sam (to be freed by the caller). If alns is not NULL,
+ * alns[i] receives the records of read i as they were written, in SAM
+ * order with the SAM flag, and is released with bm2_alns_free. pes0 fixes
+ * the insert-size distribution; NULL infers it from the batch. Returns 0,
+ * or -1 for an odd number of paired-end reads.
+ */
+int bm2_align(bm2_aligner_t *al, int n, bseq1_t *seqs, const mem_pestat_t *pes0,
+              mem_aln_v *alns);
+void bm2_alns_free(int n, mem_aln_v *alns);
+
+#endif
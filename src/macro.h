@@ -57,8 +57,7 @@ Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@i
 #define CACHE_LINE 16        // 16 INT32
 #define ALIGN_OFF 1
 
-#define MAX_THREADS 256
-#define LIM_R 128
+#define LIM_R 136
 #define LIM_C 128
 
 #define SA_COMPRESSION 1
@@ -170,6 +169,26 @@ Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@i
 #define PE24 110
 #define PE25 111
 #define PE26 112
+#define GAPLESS_EXT 113
+#define GAPLESS_READ 114
+#define ALN_EXT 115
+#define ALN_READ 116
+#define MATESW_WIN 117
+#define MATESW_FLT 118
+#define NUMA_THREADS 119
+#define NUMA_READS 120
+#define NUMA_TIME 121
+#define WORKER_BWT 122      /* per-thread time in worker_bwt (SMEM + SAL + chaining) */
+#define WORKER_ALN 123      /* per-thread time in worker_aln (BSW) */
+#define WORKER_SAM 124      /* per-thread time in worker_sam */
+#define N_READS 125         /* reads seeded per thread */
+#define N_SEEDS 126         /* seeds chained per thread */
+#define N_SW_CELLS 127      /* query x target cells of the SW problems submitted */
+#define N_REALLOC 128       /* kernel buffer reallocations */
+#define SAM_MATESW 129      /* per-thread time in mate rescue, part of WORKER_SAM */
+#define DEDUP_READS 130     /* reads looked up in the duplicate cache */
+#define DEDUP_HITS 131      /* reads given the regions of an identical read */
+#define DEDUP_XHITS 132     /* of DEDUP_HITS, from a read of an earlier chunk */
 
 
 #endif
@@ -30,22 +30,31 @@ Contacts: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@
 
 // ----------------------------------
 #include "main.h"
+#include "tune.h"
+
+#ifdef SIMD_ENTRY
+/* Built as one of the per-ISA images of the dispatching binary (make multi);
+   runsimd.cpp picks the image at startup and calls its entry point. */
+extern "C" int SIMD_ENTRY(int argc, char* argv[]);
+#define main SIMD_ENTRY
+#endif
 
 #ifndef PACKAGE_VERSION
 #define PACKAGE_VERSION "2.2.1"
 #endif
 
 
-// ----------------------------------
-uint64_t proc_freq, tprof[LIM_R][LIM_C], prof[LIM_R];
-// ----------------------------------
-
 int usage()
 {
     fprintf(stderr, "Usage: bwa-mem2 <command> <arguments>\n");
     fprintf(stderr, "Commands:\n");
     fprintf(stderr, "  index         create index\n");
     fprintf(stderr, "  mem           alignment\n");
+    fprintf(stderr, "  bench         kernel throughput on simulated reads\n");
+    fprintf(stderr, "  tune          measure batch, prefetch and chunk parameters for mem\n");
+    fprintf(stderr, "  serve         keep an index loaded and map requests from a socket\n");
+    fprintf(stderr, "  client        send reads to a running serve\n");
+    fprintf(stderr, "  merge         join the outputs of mem --shard\n");
     fprintf(stderr, "  version       print version number\n");
     return 1;
 }
@@ -54,9 +63,7 @@ int main(int argc, char* argv[])
 {
         
     // ---------------------------------    
-    uint64_t tim = __rdtsc();
-    sleep(1);
-    proc_freq = __rdtsc() - tim;
+    proc_freq = tsc_freq();
 
     int ret = -1;
     if (argc < 2) return usage();
@@ -103,6 +110,34 @@ int main(int argc, char* argv[])
         /** Enable this return to avoid printing of the runtime profiling **/
         //return ret;
     }
+    else if (strcmp(argv[1], "bench") == 0)
+    {
+        return main_bench(argc-1, argv+1);
+    }
+    else if (strcmp(argv[1], "tune") == 0)
+    {
+        return main_tune(argc-1, argv+1);
+    }
+    else if (strcmp(argv[1], "serve") == 0)
+    {
+        kstring_t pg = {0,0,0};
+        extern char *bwa_pg;
+        ksprintf(&pg, "@PG\tID:bwa-mem2\tPN:bwa-mem2\tVN:%s\tCL:%s", PACKAGE_VERSION, argv[0]);
+        for (int i = 1; i < argc; ++i) ksprintf(&pg, " %s", argv[i]);
+        ksprintf(&pg, "\n");
+        bwa_pg = pg.s;
+        ret = main_serve(argc-1, argv+1);
+        free(bwa_pg);
+        return ret;
+    }
+    else if (strcmp(argv[1], "client") == 0)
+    {
+        return main_client(argc-1, argv+1);
+    }
+    else if (strcmp(argv[1], "merge") == 0)
+    {
+        return main_merge(argc-1, argv+1);
+    }
     else if (strcmp(argv[1], "version") == 0)
     {
         puts(PACKAGE_VERSION);
@@ -114,11 +149,12 @@ int main(int argc, char* argv[])
 
     if (ret == 0) {
         fprintf(stderr, "\nImportant parameter settings: \n");
-        fprintf(stderr, "\tBATCH_SIZE: %d\n", BATCH_SIZE);
+        fprintf(stderr, "\tBATCH_SIZE: %d\n", mem_tune.batch);
         fprintf(stderr, "\tMAX_SEQ_LEN_REF: %d\n", MAX_SEQ_LEN_REF);
         fprintf(stderr, "\tMAX_SEQ_LEN_QER: %d\n", MAX_SEQ_LEN_QER);
-        fprintf(stderr, "\tMAX_SEQ_LEN8: %d\n", MAX_SEQ_LEN8);
-        fprintf(stderr, "\tSEEDS_PER_READ: %d\n", SEEDS_PER_READ);
+        fprintf(stderr, "\tMAX_SEQ_LEN8: %d\n", mem_tune.len8);
+        fprintf(stderr, "\tSEEDS_PER_READ: %d\n", mem_tune.seeds_per_read);
+        fprintf(stderr, "\tSAL batch: %d\n", mem_tune.sal_batch);
         fprintf(stderr, "\tSIMD_WIDTH8 X: %d\n", SIMD_WIDTH8);
         fprintf(stderr, "\tSIMD_WIDTH16 X: %d\n", SIMD_WIDTH16);
         fprintf(stderr, "\tAVG_SEEDS_PER_READ: %d\n", AVG_SEEDS_PER_READ);
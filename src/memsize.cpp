@@ -0,0 +1,132 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+#include <stdio.h>
+#include <ctype.h>
+#include <sys/resource.h>
+#include "memsize.h"
+#include "bwamem.h"
+#include "tune.h"
+
+static int64_t msz_now[MSZ_N + 1], msz_max[MSZ_N + 1];   // [MSZ_N]: all subsystems
+static const char *msz_names[] = { "index", "reads", "chaining", "smem", "bsw", "total" };
+
+static void msz_update(int i, int64_t bytes)
+{
+    int64_t now = __sync_add_and_fetch(&msz_now[i], bytes);
+    int64_t peak = msz_max[i];
+    while (now > peak && !__sync_bool_compare_and_swap(&msz_max[i], peak, now))
+        peak = msz_max[i];
+}
+
+void msz_add(int sub, int64_t bytes)
+{
+    msz_update(sub, bytes);
+    msz_update(MSZ_N, bytes);
+}
+
+int64_t msz_cur(int sub)
+{
+    return msz_now[sub];
+}
+
+int64_t msz_peak(int sub)
+{
+    return msz_max[sub];
+}
+
+const char *msz_name(int sub)
+{
+    return msz_names[sub];
+}
+
+void msz_report()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+
+    fprintf(stderr, "\nMemory peaks (MB):\n");
+    for (int i = 0; i < MSZ_N; i++)
+        fprintf(stderr, "\t%c%s: %0.2lf\n", toupper(msz_names[i][0]), msz_names[i] + 1,
+                msz_max[i] / 1e6);
+    fprintf(stderr, "\tAll accounted: %0.2lf, process max RSS: %0.2lf\n",
+            msz_max[MSZ_N] / 1e6, ru.ru_maxrss * 1024 / 1e6);
+}
+
+void msz_plan(mem_plan_t *p, int64_t n_reads, int64_t n_bp, int w)
+{
+    int len = n_reads > 0? (int) ((n_bp + n_reads - 1) / n_reads) : READ_LEN;
+    if (len < 32) len = 32;
+
+    p->read_len = len;
+    p->nreads = n_reads + n_reads / 8 + 10;
+    // seeds grow with the read length; AVG_SEEDS_PER_READ is the 151 bp figure
+    p->seeds_per_read = (int) ((int64_t) AVG_SEEDS_PER_READ * len / READ_LEN);
+    if (p->seeds_per_read < 16) p->seeds_per_read = 16;
+    // an extension pair per seed and side, each at most a read plus the band long
+    p->wsize = (int64_t) mem_tune.batch * p->seeds_per_read;
+    p->wsize_buf_qer = p->wsize * len;
+    p->wsize_buf_ref = p->wsize * (len + w);
+    // the SMEM kernel needs N_SMEM_KERNEL entries per base of a batch
+    p->wsize_mem = (int64_t) N_SMEM_KERNEL * mem_tune.batch * len * 5 / 4;
+}
+
+int64_t msz_thread_bytes(const mem_plan_t *p)
+{
+    return (p->wsize + MAX_LINE_LEN) * sizeof(SeqPair) * 3 +
+        (p->wsize_buf_ref + MAX_LINE_LEN) * 2 + (p->wsize_buf_qer + MAX_LINE_LEN) * 2 +
+        p->wsize_mem * (sizeof(SMEM) + 2 * sizeof(int32_t) + sizeof(int16_t) + sizeof(uint8_t)) +
+        (mem_tune.batch + 32) * sizeof(int32_t);
+}
+
+int64_t msz_chain_bytes(int64_t nreads, int seeds_per_read)
+{
+    return nreads * (sizeof(mem_alnreg_v) + sizeof(mem_chain_v) +
+                     seeds_per_read * sizeof(mem_seed_t));
+}
+
+int64_t msz_fit_chunk(int64_t budget, int nthreads, int w, int64_t task_size)
+{
+    mem_plan_t p;
+    msz_plan(&p, task_size / READ_LEN, task_size, w);
+
+    int64_t fixed = msz_cur(MSZ_INDEX) + nthreads * msz_thread_bytes(&p);
+    double per_bp = MSZ_READ_BYTES_PER_BP * MSZ_CHUNKS_IN_FLIGHT +
+        (double) msz_chain_bytes(1, p.seeds_per_read) / READ_LEN;
+    int64_t min_chunk = (int64_t) nthreads * mem_tune.batch * READ_LEN;
+
+    int64_t chunk = budget > fixed? (int64_t) ((budget - fixed) / per_bp) : 0;
+    if (chunk < min_chunk) {
+        fprintf(stderr, "[W::%s] the memory budget of %0.2lf GB is below the estimated "
+                "minimum of %0.2lf GB; using the smallest chunk\n", __func__,
+                budget / 1e9, (fixed + min_chunk * per_bp) / 1e9);
+        chunk = min_chunk;
+    }
+    return chunk < task_size? chunk : task_size;
+}
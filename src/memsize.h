@@ -0,0 +1,82 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+/*
+ * Memory sizing of the mapping pipeline.
+ *
+ * The kernel buffers are sized from the reads of the first chunk (mean
+ * read length, reads per chunk) instead of READ_LEN and SEEDS_PER_READ,
+ * and refitted to the largest batch of that chunk once it is mapped.
+ * With a budget (mem --max-mem) the chunk size is cut until the estimate
+ * fits. Allocations are accounted per subsystem; the peaks are reported
+ * at the end of the run.
+ */
+
+#ifndef _MEMSIZE_H
+#define _MEMSIZE_H
+
+#include <stdint.h>
+
+#define MSZ_INDEX 0     /* FM-index, SA samples, packed and 2-bit reference */
+#define MSZ_READS 1     /* reads and SAM text of the chunks in flight */
+#define MSZ_CHAIN 2     /* per-read regs, chains and the seed buffer */
+#define MSZ_SMEM  3     /* SMEM kernel buffers of all threads */
+#define MSZ_BSW   4     /* banded SW pairs and sequence buffers of all threads */
+#define MSZ_N     5
+
+/* Reads and SAM text held per input base; two chunks are in flight */
+#define MSZ_READ_BYTES_PER_BP 6
+#define MSZ_CHUNKS_IN_FLIGHT  2
+
+typedef struct {
+    int32_t read_len;        // mean read length the plan is based on
+    int32_t nreads;          // reads per chunk (regs, chains)
+    int32_t seeds_per_read;  // seed buffer slots per read
+    int64_t wsize;           // BSW pairs per thread
+    int64_t wsize_buf_ref;   // BSW reference bytes per thread
+    int64_t wsize_buf_qer;   // BSW query bytes per thread
+    int64_t wsize_mem;       // SMEM entries per thread
+} mem_plan_t;
+
+void msz_add(int sub, int64_t bytes);   // bytes < 0 on release
+int64_t msz_cur(int sub);
+int64_t msz_peak(int sub);      // sub == MSZ_N: all subsystems together
+const char *msz_name(int sub);
+void msz_report();
+
+/* Plan for a chunk of n_reads reads and n_bp bases; w is the band width */
+void msz_plan(mem_plan_t *p, int64_t n_reads, int64_t n_bp, int w);
+int64_t msz_thread_bytes(const mem_plan_t *p);
+int64_t msz_chain_bytes(int64_t nreads, int seeds_per_read);
+
+/* Largest chunk (bp) whose estimated footprint, with the index already
+   accounted, fits in budget bytes; never below one batch per thread */
+int64_t msz_fit_chunk(int64_t budget, int nthreads, int w, int64_t task_size);
+
+#endif
@@ -0,0 +1,192 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+
+/*
+ * bwa-mem2 merge: joins the outputs of "mem --shard i/N" into the output of
+ * a single run. Shard i holds batches i-1, i-1+N, ... of the input, and its
+ * OUT.chunks file the SAM bytes of each; the batches are copied back in
+ * input order after the header of the first shard.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include "fastmap.h"
+
+typedef struct {
+    const char *fn;
+    FILE *sam, *chunks;
+} shard_t;
+
+static void usage_merge()
+{
+    fprintf(stderr, "Usage: bwa-mem2 merge [-o out.sam] <shard1.sam> ... <shardN.sam>\n");
+    fprintf(stderr, "Joins the -o outputs of 'mem --shard i/N', in any order, to the output of one run.\n");
+}
+
+/* Opens a shard output and its batch list; returns i - 1, or -1 on an error */
+static int shard_open(shard_t *s, const char *fn, int *n, long *chunk_bp)
+{
+    std::string cfn = std::string(fn) + SHARD_SUFFIX;
+    char magic[64];
+    int i, n1;
+    long bp;
+
+    s->fn = fn;
+    if ((s->sam = fopen(fn, "r")) == NULL || (s->chunks = fopen(cfn.c_str(), "r")) == NULL) {
+        fprintf(stderr, "[E::%s] can't open %s or %s\n", __func__, fn, cfn.c_str());
+        return -1;
+    }
+    if (fscanf(s->chunks, "%63s %d/%d %ld", magic, &i, &n1, &bp) != 4 ||
+        strcmp(magic, SHARD_MAGIC) != 0) {
+        fprintf(stderr, "[E::%s] %s is not the batch list of a shard\n", __func__, cfn.c_str());
+        return -1;
+    }
+    if (*n == 0) *n = n1, *chunk_bp = bp;
+    if (n1 != *n || bp != *chunk_bp) {
+        fprintf(stderr, "[E::%s] %s is shard %d/%d of %ld bp batches; another input is of %d "
+                "shards of %ld bp\n", __func__, fn, i, n1, bp, *n, *chunk_bp);
+        return -1;
+    }
+    return i - 1;
+}
+
+/* Copies the header lines at the start of s->sam to out, or skips them if out is NULL */
+static void shard_header(shard_t *s, FILE *out)
+{
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    int c;
+    while ((c = getc(s->sam)) == '@') {
+        ungetc(c, s->sam);
+        if ((len = getline(&line, &cap, s->sam)) < 0) break;
+        if (out) fwrite(line, 1, len, out);
+    }
+    if (c != EOF) ungetc(c, s->sam);
+    free(line);
+}
+
+static int shard_copy(shard_t *s, FILE *out, long bytes)
+{
+    char buf[1 << 16];
+    while (bytes > 0) {
+        size_t l = bytes < (long) sizeof(buf)? bytes : sizeof(buf);
+        if (fread(buf, 1, l, s->sam) != l) {
+            fprintf(stderr, "[E::%s] %s is shorter than its batch list\n", __func__, s->fn);
+            return -1;
+        }
+        fwrite(buf, 1, l, out);
+        bytes -= l;
+    }
+    return 0;
+}
+
+int main_merge(int argc, char *argv[])
+{
+    int c, n = 0, ret = 1;
+    long chunk_bp = 0;
+    const char *out_fn = NULL;
+    FILE *out = stdout;
+
+    while ((c = getopt(argc, argv, "o:")) >= 0) {
+        if (c == 'o') out_fn = optarg;
+        else {
+            usage_merge();
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage_merge();
+        return 1;
+    }
+
+    int n_in = argc - optind;
+    shard_t *sh = (shard_t *) calloc(n_in, sizeof(shard_t));
+    assert(sh != NULL);
+    for (int k = 0; k < n_in; k++) {
+        shard_t s;
+        memset(&s, 0, sizeof(shard_t));
+        int i = shard_open(&s, argv[optind + k], &n, &chunk_bp);
+        if (i >= 0 && (n != n_in || sh[i].fn != NULL)) {
+            fprintf(stderr, "[E::%s] shards of %d given for %d; each of 1..%d is needed once\n",
+                    __func__, n, n_in, n);
+            i = -1;
+        }
+        if (i < 0) {
+            if (s.sam) fclose(s.sam);
+            if (s.chunks) fclose(s.chunks);
+            goto end;
+        }
+        sh[i] = s;
+    }
+    if (out_fn && (out = fopen(out_fn, "w")) == NULL) {
+        fprintf(stderr, "[E::%s] can't open %s for writing\n", __func__, out_fn);
+        goto end;
+    }
+
+    for (int i = 0; i < n; i++)
+        shard_header(&sh[i], i == 0? out : NULL);
+    for (long k = 0, done = 0; done < n; k++) {
+        shard_t *s = &sh[k % n];
+        long idx, bytes;
+        if (fscanf(s->chunks, "%ld %ld", &idx, &bytes) != 2) {
+            done++;     // all shards end within one round
+            continue;
+        }
+        if (done > 0 || idx != k) {
+            fprintf(stderr, "[E::%s] %s has batch %ld where batch %ld is expected\n",
+                    __func__, s->fn, idx, k);
+            goto end;
+        }
+        if (shard_copy(s, out, bytes) != 0) goto end;
+    }
+    for (int i = 0; i < n; i++)
+        if (getc(sh[i].sam) != EOF) {
+            fprintf(stderr, "[E::%s] %s is longer than its batch list; was the shard "
+                    "interrupted?\n", __func__, sh[i].fn);
+            goto end;
+        }
+    ret = 0;
+    fprintf(stderr, "[M::%s] merged %d shards\n", __func__, n);
+
+end:
+    if (out_fn && out != stdout && fclose(out) != 0) ret = 1;
+    for (int i = 0; i < n_in; i++) {
+        if (sh[i].sam) fclose(sh[i].sam);
+        if (sh[i].chunks) fclose(sh[i].chunks);
+    }
+    free(sh);
+    return ret;
+}
@@ -0,0 +1,265 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perfctr.h"
+
+typedef struct {
+    uint64_t c[PC_NPHASE][PC_NEV];
+} __attribute__((aligned(64))) pc_row_t;
+
+static const char *pc_ev_names[] = { "cycles", "instructions", "LLC-load-misses",
+                                     "dTLB-load-misses", "branch-misses" };
+static const char *pc_phase_names[] = { "worker_bwt", "worker_aln", "worker_sam",
+                                        "read_io", "sam_io" };
+
+static int pc_on = 0;
+static int pc_have[PC_NEV];     // events opened by the probe, in group order
+static pc_row_t *pc_rows = NULL;
+static pthread_key_t pc_key;
+
+/* Group of the calling thread: NULL before the first sample, fds[0] < 0 if
+   it could not be opened */
+static __thread int *pc_fds = NULL;
+
+static void pc_attr(struct perf_event_attr *a, int ev)
+{
+    memset(a, 0, sizeof(*a));
+    a->size = sizeof(*a);
+    a->exclude_kernel = 1;
+    a->exclude_hv = 1;
+    a->read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    switch (ev) {
+    case PC_CYCLES:
+        a->type = PERF_TYPE_HARDWARE, a->config = PERF_COUNT_HW_CPU_CYCLES; break;
+    case PC_INSTR:
+        a->type = PERF_TYPE_HARDWARE, a->config = PERF_COUNT_HW_INSTRUCTIONS; break;
+    case PC_LLC_MISS:
+        a->type = PERF_TYPE_HW_CACHE;
+        a->config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case PC_DTLB_MISS:
+        a->type = PERF_TYPE_HW_CACHE;
+        a->config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    default:
+        a->type = PERF_TYPE_HARDWARE, a->config = PERF_COUNT_HW_BRANCH_MISSES; break;
+    }
+}
+
+static int pc_open(int ev, int group_fd)
+{
+    struct perf_event_attr a;
+    pc_attr(&a, ev);
+    return (int) syscall(__NR_perf_event_open, &a, 0, -1, group_fd, 0);
+}
+
+static void pc_close(void *p)
+{
+    int *fds = (int *) p;
+    for (int i = 0; i < PC_NEV; i++)
+        if (fds[i] >= 0) close(fds[i]);
+    free(fds);
+}
+
+/* Opens the events of pc_have[] as one group; all or nothing per thread */
+static int *pc_open_group()
+{
+    int *fds = (int *) malloc(PC_NEV * sizeof(int));
+    if (fds == NULL) return NULL;
+    for (int i = 0; i < PC_NEV; i++) fds[i] = -1;
+    for (int i = 0; i < PC_NEV; i++) {
+        if (!pc_have[i]) continue;
+        fds[i] = pc_open(i, i == PC_CYCLES? -1 : fds[PC_CYCLES]);
+        if (fds[i] < 0) {
+            for (int k = 0; k < i; k++)
+                if (fds[k] >= 0) close(fds[k]), fds[k] = -1;
+            break;
+        }
+    }
+    return fds;
+}
+
+int pc_init(int nthreads)
+{
+    int fds[PC_NEV];
+    pc_on = 0;
+
+    fds[PC_CYCLES] = pc_open(PC_CYCLES, -1);
+    if (fds[PC_CYCLES] < 0) {
+        fprintf(stderr, "[W::%s] hardware counters unavailable (%s); "
+                "check /proc/sys/kernel/perf_event_paranoid\n", __func__, strerror(errno));
+        return -1;
+    }
+    pc_have[PC_CYCLES] = 1;
+    for (int i = 1; i < PC_NEV; i++) {
+        fds[i] = pc_open(i, fds[PC_CYCLES]);
+        pc_have[i] = fds[i] >= 0;
+        if (!pc_have[i])
+            fprintf(stderr, "[W::%s] %s not supported, not counted\n", __func__, pc_ev_names[i]);
+    }
+    for (int i = 0; i < PC_NEV; i++)
+        if (pc_have[i]) close(fds[i]);
+
+    if (posix_memalign((void **) &pc_rows, 64, nthreads * sizeof(pc_row_t)) != 0) {
+        fprintf(stderr, "[W::%s] can't allocate counters for %d threads\n", __func__, nthreads);
+        return -1;
+    }
+    memset(pc_rows, 0, nthreads * sizeof(pc_row_t));
+    pthread_key_create(&pc_key, pc_close);
+    pc_on = 1;
+    return 0;
+}
+
+void pc_free()
+{
+    if (!pc_on) return;
+    pc_on = 0;
+    free(pc_rows);
+    pc_rows = NULL;
+}
+
+int pc_enabled()
+{
+    return pc_on;
+}
+
+/* Scaled values of the calling thread's group, in event order */
+static int pc_read(uint64_t *v)
+{
+    if (pc_fds == NULL) {
+        pc_fds = pc_open_group();
+        if (pc_fds == NULL) return -1;
+        pthread_setspecific(pc_key, pc_fds);
+    }
+    if (pc_fds[PC_CYCLES] < 0) return -1;
+
+    uint64_t buf[3 + PC_NEV];   // nr, time enabled, time running, values
+    if (read(pc_fds[PC_CYCLES], buf, sizeof(buf)) < (ssize_t) (3 * sizeof(uint64_t)))
+        return -1;
+    // scale up when the group shared the PMU with other events
+    double scale = buf[2] > 0 && buf[2] < buf[1]? (double) buf[1] / buf[2] : 1.0;
+    for (int i = 0, k = 3; i < PC_NEV; i++)
+        v[i] = pc_have[i]? (uint64_t) (buf[k++] * scale) : 0;
+    return 0;
+}
+
+void pc_begin(pc_sample_t *s)
+{
+    s->ok = pc_on && pc_read(s->v) == 0;
+}
+
+void pc_end(pc_sample_t *s, int phase, int tid)
+{
+    uint64_t v[PC_NEV];
+    if (!s->ok || pc_read(v) != 0) return;
+    for (int i = 0; i < PC_NEV; i++)
+        pc_rows[tid].c[phase][i] += v[i] - s->v[i];
+}
+
+static void pc_total(int phase, int nthreads, uint64_t *tot)
+{
+    memset(tot, 0, PC_NEV * sizeof(uint64_t));
+    for (int t = 0; t < nthreads; t++)
+        for (int i = 0; i < PC_NEV; i++)
+            tot[i] += pc_rows[t].c[phase][i];
+}
+
+void pc_report(int nthreads)
+{
+    if (!pc_on) return;
+
+    fprintf(stderr, "\n\tHardware counters (all threads; misses per 1000 instructions):\n");
+    fprintf(stderr, "\t%-12s %14s %14s %6s %11s %10s %10s %10s\n", "phase", "cycles",
+            "instructions", "IPC", "thread IPC", "LLC", "dTLB", "branch");
+    for (int p = 0; p < PC_NPHASE; p++) {
+        uint64_t tot[PC_NEV];
+        pc_total(p, nthreads, tot);
+        if (tot[PC_CYCLES] == 0) continue;
+
+        double lo = 1e9, hi = 0, kinst = tot[PC_INSTR] / 1e3;
+        for (int t = 0; t < nthreads; t++) {
+            const uint64_t *c = pc_rows[t].c[p];
+            if (c[PC_CYCLES] == 0) continue;
+            double ipc = (double) c[PC_INSTR] / c[PC_CYCLES];
+            if (ipc < lo) lo = ipc;
+            if (ipc > hi) hi = ipc;
+        }
+        fprintf(stderr, "\t%-12s %14lu %14lu %6.2lf %5.2lf-%-5.2lf", pc_phase_names[p],
+                tot[PC_CYCLES], tot[PC_INSTR], (double) tot[PC_INSTR] / tot[PC_CYCLES], lo, hi);
+        for (int i = PC_LLC_MISS; i <= PC_BR_MISS; i++) {
+            if (pc_have[i] && kinst > 0) fprintf(stderr, " %10.2lf", tot[i] / kinst);
+            else fprintf(stderr, " %10s", "n/a");
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+static void pc_json_row(FILE *fp, const uint64_t *v)
+{
+    fprintf(fp, "{");
+    for (int i = 0, first = 1; i < PC_NEV; i++) {
+        if (!pc_have[i]) continue;
+        fprintf(fp, "%s\"%s\": %lu", first? "" : ", ", pc_ev_names[i], v[i]);
+        first = 0;
+    }
+    fprintf(fp, "}");
+}
+
+void pc_json(FILE *fp, int nthreads)
+{
+    if (!pc_on) {
+        fprintf(fp, "null");
+        return;
+    }
+    fprintf(fp, "{");
+    for (int p = 0; p < PC_NPHASE; p++) {
+        uint64_t tot[PC_NEV];
+        pc_total(p, nthreads, tot);
+        fprintf(fp, "%s\n    \"%s\": {\"total\": ", p? "," : "", pc_phase_names[p]);
+        pc_json_row(fp, tot);
+        fprintf(fp, ", \"per_thread\": [");
+        for (int t = 0; t < nthreads; t++) {
+            if (t) fprintf(fp, ", ");
+            pc_json_row(fp, pc_rows[t].c[p]);
+        }
+        fprintf(fp, "]}");
+    }
+    fprintf(fp, "\n  }");
+}
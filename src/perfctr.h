@@ -0,0 +1,77 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+/*
+ * Hardware performance counters of the pipeline phases (mem --hw-counters).
+ *
+ * Each thread opens one perf_event group (cycles, instructions, LLC and
+ * dTLB load misses, branch misses) the first time it samples, counting
+ * user space only. A phase reads the group before and after and adds the
+ * difference to the row of its compute thread. Events the kernel or the
+ * VM does not expose are reported as unavailable; without a cycle counter
+ * sampling is off and costs nothing.
+ */
+
+#ifndef _PERFCTR_H
+#define _PERFCTR_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define PC_BWT     0    /* worker_bwt: SMEM, SAL and chaining */
+#define PC_ALN     1    /* worker_aln: banded SW */
+#define PC_SAM     2    /* worker_sam: pairing and SAM formatting */
+#define PC_READ_IO 3    /* reading a chunk of reads */
+#define PC_SAM_IO  4    /* writing the SAM records of a chunk */
+#define PC_NPHASE  5
+
+#define PC_CYCLES     0
+#define PC_INSTR      1
+#define PC_LLC_MISS   2
+#define PC_DTLB_MISS  3
+#define PC_BR_MISS    4
+#define PC_NEV        5
+
+typedef struct {
+    uint64_t v[PC_NEV];
+    int ok;
+} pc_sample_t;
+
+int pc_init(int nthreads);      // 0 if at least the cycle counter works
+void pc_free();
+int pc_enabled();
+
+void pc_begin(pc_sample_t *s);
+void pc_end(pc_sample_t *s, int phase, int tid);
+
+void pc_report(int nthreads);
+void pc_json(FILE *fp, int nthreads);
+
+#endif
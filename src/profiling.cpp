@@ -31,7 +31,148 @@ Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@i
 #include "macro.h"
 #include <stdint.h>
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cpuid.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <immintrin.h>
+#include "utils.h"
 #include "profiling.h"
+#include "memsize.h"
+#include "perfctr.h"
+
+uint64_t proc_freq, tprof[LIM_R][LIM_C], prof[LIM_R];
+thread_prof_t *thprof = NULL;
+static int thprof_n = 0;
+static pthread_mutex_t thprof_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void thprof_alloc(int nthreads)
+{
+    if (posix_memalign((void **) &thprof, 64, nthreads * sizeof(thread_prof_t)) != 0) {
+        fprintf(stderr, "Error: can't allocate profiling counters for %d threads\n", nthreads);
+        exit(EXIT_FAILURE);
+    }
+    memset(thprof, 0, nthreads * sizeof(thread_prof_t));
+    thprof_n = nthreads;
+}
+
+void thprof_reserve(int nthreads)
+{
+    pthread_mutex_lock(&thprof_lock);
+    if (nthreads > thprof_n) {
+        // the old block is not freed: threads of another aligner may still count into it
+        thread_prof_t *old = thprof;
+        int n_old = thprof_n;
+        thprof_alloc(nthreads);
+        if (old) memcpy(thprof, old, n_old * sizeof(thread_prof_t));
+    }
+    pthread_mutex_unlock(&thprof_lock);
+}
+
+void thprof_free()
+{
+    free(thprof);
+    thprof = NULL;
+    thprof_n = 0;
+}
+
+static uint64_t *lat_ticks = NULL;
+static int lat_n = 0, lat_m = 0;
+
+void batch_lat_add(uint64_t ticks)
+{
+    if (lat_n == lat_m) {
+        lat_m = lat_m? lat_m << 1 : 256;
+        lat_ticks = (uint64_t *) realloc(lat_ticks, lat_m * sizeof(uint64_t));
+        assert(lat_ticks != NULL);
+    }
+    lat_ticks[lat_n++] = ticks;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y? -1 : x > y;
+}
+
+int batch_lat_stats(double *p50, double *p99, double *max)
+{
+    *p50 = *p99 = *max = 0;
+    if (lat_n == 0) return 0;
+    uint64_t *s = (uint64_t *) malloc(lat_n * sizeof(uint64_t));
+    assert(s != NULL);
+    memcpy(s, lat_ticks, lat_n * sizeof(uint64_t));
+    qsort(s, lat_n, sizeof(uint64_t), cmp_u64);
+    double ms = proc_freq / 1e3;
+    // nearest rank
+    *p50 = s[(lat_n * 50 + 99) / 100 - 1] / ms;
+    *p99 = s[(lat_n * 99 + 99) / 100 - 1] / ms;
+    *max = s[lat_n - 1] / ms;
+    free(s);
+    return lat_n;
+}
+
+/* Nominal frequency from the brand string, e.g. "... CPU @ 2.10GHz" */
+static uint64_t brand_freq()
+{
+    unsigned int r[12];
+    if (__get_cpuid_max(0x80000000, NULL) < 0x80000004) return 0;
+    for (int i = 0; i < 3; i++)
+        __cpuid(0x80000002 + i, r[4*i], r[4*i+1], r[4*i+2], r[4*i+3]);
+    char brand[49];
+    memcpy(brand, r, 48);
+    brand[48] = 0;
+    const char *at = strrchr(brand, '@');
+    double ghz;
+    if (at == NULL || sscanf(at + 1, "%lfGHz", &ghz) != 1) return 0;
+    return (uint64_t) (ghz * 1e9);
+}
+
+/* TSC ticks per second. With an invariant TSC the rate comes from the
+   kernel (tsc_freq_khz), CPUID leaf 0x15 (crystal clock times ratio),
+   leaf 0x16 (base frequency) or the brand string, in that order; a 50 ms
+   calibration against the monotonic clock is the last resort. */
+uint64_t tsc_freq()
+{
+    unsigned int a, b, c, d;
+    __cpuid(0x80000000, a, b, c, d);
+    int invariant = 0;
+    if (a >= 0x80000007) {
+        __cpuid(0x80000007, a, b, c, d);
+        invariant = (d >> 8) & 1;
+    }
+
+    if (invariant) {
+        FILE *fp = fopen("/sys/devices/system/cpu/cpu0/tsc_freq_khz", "r");
+        if (fp != NULL) {
+            unsigned long khz = 0;
+            int n = fscanf(fp, "%lu", &khz);
+            fclose(fp);
+            if (n == 1 && khz > 0) return (uint64_t) khz * 1000;
+        }
+        int max_leaf = __get_cpuid_max(0, NULL);
+        if (max_leaf >= 0x15) {
+            __cpuid_count(0x15, 0, a, b, c, d);
+            if (a != 0 && b != 0 && c != 0) return (uint64_t) c * b / a;
+        }
+        if (max_leaf >= 0x16) {
+            __cpuid_count(0x16, 0, a, b, c, d);
+            if ((a & 0xffff) != 0) return (uint64_t) (a & 0xffff) * 1000000;
+        }
+        uint64_t f = brand_freq();
+        if (f > 0) return f;
+    }
+
+    struct timespec t0, t1, req = { 0, 50000000 };
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint64_t tim = __rdtsc();
+    nanosleep(&req, NULL);
+    uint64_t ticks = __rdtsc() - tim;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (uint64_t) (ticks / ((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9));
+}
 
 int find_opt(uint64_t *a, int len, uint64_t *max, uint64_t *min, double *avg)
 {
@@ -51,6 +192,85 @@ int find_opt(uint64_t *a, int len, uint64_t *max, uint64_t *min, double *avg)
     return 1;
 }
 
+/* find_opt() over the per-thread counters of one id */
+int find_opt_thr(int id, int len, uint64_t *max, uint64_t *min, double *avg)
+{
+    *max = 0;
+    *min = 1e15;
+    *avg = 0;
+
+    for (int i=0; i<len; i++)
+    {
+        uint64_t a = TPROF(id, i);
+        if (a > *max) *max = a;
+        if (a < *min) *min = a;
+        *avg += a;
+    }
+    *avg /= len;
+
+    return 1;
+}
+
+/* Machine-readable counterpart of display_stats(): run-level phases,
+   per-thread time and work counters, and the memory peaks. Times are in
+   seconds. */
+int write_metrics_json(const char *fn, int nthreads)
+{
+    FILE *fp = fopen(fn, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "[E::%s] can't open %s for writing\n", __func__, fn);
+        return -1;
+    }
+    double f = proc_freq;
+    fprintf(fp, "{\n  \"tsc_hz\": %lu,\n  \"threads\": %d,\n", proc_freq, nthreads);
+    fprintf(fp, "  \"phases\": {\n");
+    fprintf(fp, "    \"main_mem\": %0.6lf,\n", tprof[MEM][0] / f);
+    fprintf(fp, "    \"index_load\": %0.6lf,\n", tprof[FMI][0] / f);
+    fprintf(fp, "    \"reference_load\": %0.6lf,\n", tprof[REF_IO][0] / f);
+    fprintf(fp, "    \"process\": %0.6lf,\n", tprof[PROCESS][0] / f);
+    fprintf(fp, "    \"read_io\": %0.6lf,\n", tprof[READ_IO][0] / f);
+    fprintf(fp, "    \"sam_io\": %0.6lf,\n", tprof[SAM_IO][0] / f);
+    fprintf(fp, "    \"mem_process_seqs\": %0.6lf,\n", tprof[MEM_PROCESS2][0] / f);
+    fprintf(fp, "    \"kernels\": %0.6lf,\n", tprof[WORKER10][0] / f);
+    fprintf(fp, "    \"sam\": %0.6lf\n  },\n", tprof[WORKER20][0] / f);
+
+    uint64_t tot[4] = {0, 0, 0, 0};
+    fprintf(fp, "  \"per_thread\": [\n");
+    for (int i = 0; i < nthreads; i++) {
+        fprintf(fp, "    {\"tid\": %d, \"worker_bwt\": %0.6lf, \"worker_aln\": %0.6lf, "
+                "\"worker_sam\": %0.6lf, \"smem\": %0.6lf, \"sal\": %0.6lf, \"bsw\": %0.6lf, ",
+                i, TPROF(WORKER_BWT, i) / f, TPROF(WORKER_ALN, i) / f, TPROF(WORKER_SAM, i) / f,
+                TPROF(MEM_COLLECT, i) / f, TPROF(MEM_SA_BLOCK, i) / f, TPROF(MEM_ALN2, i) / f);
+        fprintf(fp, "\"reads\": %lu, \"seeds\": %lu, \"sw_cells\": %lu, \"reallocs\": %lu}%s\n",
+                TPROF(N_READS, i), TPROF(N_SEEDS, i), TPROF(N_SW_CELLS, i), TPROF(N_REALLOC, i),
+                i < nthreads - 1? "," : "");
+        tot[0] += TPROF(N_READS, i), tot[1] += TPROF(N_SEEDS, i);
+        tot[2] += TPROF(N_SW_CELLS, i), tot[3] += TPROF(N_REALLOC, i);
+    }
+    fprintf(fp, "  ],\n");
+    fprintf(fp, "  \"totals\": {\"reads\": %lu, \"seeds\": %lu, \"sw_cells\": %lu, "
+            "\"reallocs\": %lu},\n", tot[0], tot[1], tot[2], tot[3] + tprof[N_REALLOC][0]);
+    double p50, p99, pmax;
+    int n_lat = batch_lat_stats(&p50, &p99, &pmax);
+    fprintf(fp, "  \"batch_latency_ms\": {\"batches\": %d, \"p50\": %0.3lf, \"p99\": %0.3lf, "
+            "\"max\": %0.3lf},\n", n_lat, p50, p99, pmax);
+    fprintf(fp, "  \"dedup\": {\"reads\": %lu, \"hits\": %lu, \"cross_batch_hits\": %lu},\n",
+            tprof[DEDUP_READS][0], tprof[DEDUP_HITS][0], tprof[DEDUP_XHITS][0]);
+
+    fprintf(fp, "  \"memory_peak_bytes\": {");
+    for (int i = 0; i <= MSZ_N; i++)
+        fprintf(fp, "\"%s\": %ld%s", msz_name(i), (long) msz_peak(i), i < MSZ_N? ", " : "");
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    fprintf(fp, "},\n  \"max_rss_bytes\": %ld,\n", (long) ru.ru_maxrss * 1024);
+    fprintf(fp, "  \"hw_counters\": ");
+    pc_json(fp, nthreads);
+    fprintf(fp, "\n}\n");
+
+    fclose(fp);
+    return 0;
+}
+
 int display_stats(int nthreads)
 {
     uint64_t max, min;
@@ -87,6 +307,13 @@ int display_stats(int nthreads)
     find_opt(tprof[MEM_PROCESS2], 1, &max, &min, &avg);
     fprintf(stderr, "\tMEM_PROCESS_SEQ() (Total compute time (Kernel + SAM)), avg: %0.2lf, (%0.2lf, %0.2lf)\n",
             avg*1.0/proc_freq, max*1.0/proc_freq, min*1.0/proc_freq);
+    {
+        double p50, p99, pmax;
+        int n_lat = batch_lat_stats(&p50, &p99, &pmax);
+        if (n_lat > 0)
+            fprintf(stderr, "\tBatch latency (ms, read to SAM written): p50 %0.2lf, p99 %0.2lf, "
+                    "max %0.2lf over %d batches\n", p50, p99, pmax, n_lat);
+    }
 
     fprintf(stderr, "\n\t SAM Processing time (sec):\n");
     find_opt(tprof[WORKER20], 1, &max, &min, &avg);
@@ -109,53 +336,88 @@ int display_stats(int nthreads)
     fprintf(stderr, "\t\tWORKER_SAM3 avg: %0.2lf, (%0.2lf, %0.2lf)\n",
             avg*1.0/proc_freq, max*1.0/proc_freq, min*1.0/proc_freq);
 #endif
+
+    uint64_t n_win = 0, n_flt = 0;
+    for (int i=0; i<nthreads; i++) {
+        n_win += TPROF(MATESW_WIN, i);
+        n_flt += TPROF(MATESW_FLT, i);
+    }
+    if (n_win > 0)
+        fprintf(stderr, "\t\tMate-rescue prefilter: %ld of %ld SW windows skipped (%0.2lf%%)\n",
+                n_flt, n_win, n_flt*100.0/n_win);
     
     fprintf(stderr, "\n\tKernels' compute time (sec):\n");
     find_opt(tprof[WORKER10], 1, &max, &min, &avg);
     fprintf(stderr, "\tTotal kernel (smem+sal+bsw) time avg: %0.2lf, (%0.2lf, %0.2lf)\n",
             avg*1.0/proc_freq, max*1.0/proc_freq, min*1.0/proc_freq);
+    if (tprof[DEDUP_READS][0] > 0)
+        fprintf(stderr, "\t\tDuplicate cache: %ld of %ld reads reused (%0.2lf%%), %ld from earlier batches\n",
+                tprof[DEDUP_HITS][0], tprof[DEDUP_READS][0],
+                tprof[DEDUP_HITS][0]*100.0/tprof[DEDUP_READS][0], tprof[DEDUP_XHITS][0]);
+
+    for (int n=0; n<LIM_C; n++) {
+        if (tprof[NUMA_THREADS][n] == 0) continue;
+        fprintf(stderr, "\t\tNUMA node %d: %ld threads, %ld reads, kernel time %0.2lf (%0.2lf per thread)\n",
+                n, tprof[NUMA_THREADS][n], tprof[NUMA_READS][n],
+                tprof[NUMA_TIME][n]*1.0/proc_freq,
+                tprof[NUMA_TIME][n]*1.0/proc_freq/tprof[NUMA_THREADS][n]);
+    }
     
 #if HIDE
-    find_opt(tprof[MEM_ALN_M1], nthreads, &max, &min, &avg);
+    find_opt_thr(MEM_ALN_M1, nthreads, &max, &min, &avg);
     fprintf(stderr, "\t\tMEM_ALN_CHAIN_FLT avg: %0.2lf, (%0.2lf, %0.2lf)\n",
             avg*1.0/proc_freq, max*1.0/proc_freq, min*1.0/proc_freq);
     
-    find_opt(tprof[MEM_ALN_M2], nthreads, &max, &min, &avg);
+    find_opt_thr(MEM_ALN_M2, nthreads, &max, &min, &avg);
     fprintf(stderr, "\t\tMEM_ALN_CHAIN_SEED avg: %0.2lf, (%0.2lf, %0.2lf)\n",
             avg*1.0/proc_freq, max*1.0/proc_freq, min*1.0/proc_freq);
 #endif
     
-    find_opt(tprof[MEM_COLLECT], nthreads, &max, &min, &avg);
+    find_opt_thr(MEM_COLLECT, nthreads, &max, &min, &avg);
     fprintf(stderr, "\t\tSMEM compute avg: %0.2lf, (%0.2lf, %0.2lf)\n",
             avg*1.0/proc_freq, max*1.0/proc_freq, min*1.0/proc_freq);
 
 #if HIDE
-    find_opt(tprof[MEM_CHAIN], nthreads, &max, &min, &avg);
+    find_opt_thr(MEM_CHAIN, nthreads, &max, &min, &avg);
     fprintf(stderr, "\t\tMEM_CHAIN avg: %0.2lf, (%0.2lf, %0.2lf)\n",
             avg*1.0/proc_freq, max*1.0/proc_freq, min*1.0/proc_freq);
 #endif
     
-    find_opt(tprof[MEM_SA_BLOCK], nthreads, &max, &min, &avg);
+    find_opt_thr(MEM_SA_BLOCK, nthreads, &max, &min, &avg);
     fprintf(stderr, "\t\tSAL compute avg: %0.2lf, (%0.2lf, %0.2lf)\n",
             avg*1.0/proc_freq, max*1.0/proc_freq, min*1.0/proc_freq);
     
     #if 1 //HIDE
-    find_opt(tprof[MEM_SA], nthreads, &max, &min, &avg);
+    find_opt_thr(MEM_SA, nthreads, &max, &min, &avg);
     fprintf(stderr, "\t\t\t\tMEM_SA avg: %0.2lf, (%0.2lf, %0.2lf)\n\n",
             avg*1.0/proc_freq, max*1.0/proc_freq, min*1.0/proc_freq);
     #endif
     
     // printf("\n\t BSW compute time (sec):\n");
-    find_opt(tprof[MEM_ALN2], nthreads, &max, &min, &avg);
+    find_opt_thr(MEM_ALN2, nthreads, &max, &min, &avg);
     fprintf(stderr, "\t\tBSW time, avg: %0.2lf, (%0.2lf, %0.2lf)\n",
             avg*1.0/proc_freq, max*1.0/proc_freq, min*1.0/proc_freq);
 
+    uint64_t g_read = 0, n_read = 0, g_ext = 0, n_ext = 0;
+    for (int i=0; i<nthreads; i++) {
+        g_read += TPROF(GAPLESS_READ, i);
+        n_read += TPROF(ALN_READ, i);
+        g_ext  += TPROF(GAPLESS_EXT, i);
+        n_ext  += TPROF(ALN_EXT, i);
+    }
+    if (n_read > 0)
+        fprintf(stderr, "\t\tGapless fast path: %ld of %ld reads (%0.2lf%%), %ld of %ld extensions (%0.2lf%%)\n",
+                g_read, n_read, g_read*100.0/n_read,
+                g_ext, g_ext + n_ext, (g_ext + n_ext)? g_ext*100.0/(g_ext + n_ext) : 0.0);
+
+    pc_report(nthreads);
+
     #if HIDE
     int agg1 = 0, agg2 = 0, agg3 = 0;
     for (int i=0; i<nthreads; i++) {
-        agg1 += tprof[PE11][i];
-        agg2 += tprof[PE12][i];
-        agg3 += tprof[PE13][i];
+        agg1 += TPROF(PE11, i);
+        agg2 += TPROF(PE12, i);
+        agg3 += TPROF(PE13, i);
     }
     if (agg1 != agg3) 
         fprintf(stderr, "There is a discrepancy re-allocs, plz rectify!!\n");
@@ -168,7 +430,7 @@ int display_stats(int nthreads)
 
     double res, max_ = 0, min_=1e10;
     for (int i=0; i<nthreads; i++) {
-        double val = (tprof[ALIGN1][i]*1.0) / tprof[MEM_CHAIN][i];
+        double val = (TPROF(ALIGN1, i)*1.0) / TPROF(MEM_CHAIN, i);
         res += val;
         if (max_ < val) max_ = val;
         if (min_ > val) min_ = val;
@@ -178,8 +440,8 @@ int display_stats(int nthreads)
 
     int64_t tot_inst1 = 0, tot_inst2 = 0;
     for (int i=0; i<nthreads; i++) {
-        tot_inst1 += tprof[SAM1][i];
-        tot_inst2 += tprof[SAM2][i];
+        tot_inst1 += TPROF(SAM1, i);
+        tot_inst2 += TPROF(SAM2, i);
     }
     
     fprintf(stderr, "\ttot_inst1: %ld, tot_inst2: %ld, over %d threads\n",
@@ -209,23 +471,23 @@ int display_stats(int nthreads)
     fprintf(stderr, "%0.2lf\n", avg*1.0/proc_freq);
     find_opt(tprof[WORKER10], 1, &max, &min, &avg);
     fprintf(stderr, "%0.2lf\n", avg*1.0/proc_freq);
-    find_opt(tprof[MEM_COLLECT], nthreads, &max, &min, &avg);
+    find_opt_thr(MEM_COLLECT, nthreads, &max, &min, &avg);
     fprintf(stderr, "%0.2lf\n", avg*1.0/proc_freq);
-    find_opt(tprof[MEM_SA_BLOCK], nthreads, &max, &min, &avg);
+    find_opt_thr(MEM_SA_BLOCK, nthreads, &max, &min, &avg);
     fprintf(stderr, "%0.2lf\n", avg*1.0/proc_freq);
-    find_opt(tprof[MEM_SA], nthreads, &max, &min, &avg);
+    find_opt_thr(MEM_SA, nthreads, &max, &min, &avg);
     fprintf(stderr, "%0.2lf\n", avg*1.0/proc_freq);
     double val = 0;
-    find_opt(tprof[MEM_ALN2_UP], nthreads, &max, &min, &avg);
+    find_opt_thr(MEM_ALN2_UP, nthreads, &max, &min, &avg);
     fprintf(stderr, "%0.2lf\n", avg*1.0/proc_freq);
     val += avg;
-    find_opt(tprof[CLEFT], nthreads, &max, &min, &avg);
+    find_opt_thr(CLEFT, nthreads, &max, &min, &avg);
     fprintf(stderr, "%0.2lf\n", avg*1.0/proc_freq);
     val += avg;
-    find_opt(tprof[CRIGHT], nthreads, &max, &min, &avg);
+    find_opt_thr(CRIGHT, nthreads, &max, &min, &avg);
     fprintf(stderr, "%0.2lf\n", avg*1.0/proc_freq);
     val += avg;
-    find_opt(tprof[MEM_ALN2_DOWN], nthreads, &max, &min, &avg);
+    find_opt_thr(MEM_ALN2_DOWN, nthreads, &max, &min, &avg);
     fprintf(stderr, "%0.2lf\n", avg*1.0/proc_freq);
     val += avg;
     fprintf(stderr, "%0.2lf\n", val*1.0/proc_freq);
@@ -32,4 +32,25 @@ Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@i
 
 int display_stats(int );
 extern uint64_t proc_freq, tprof[LIM_R][LIM_C];
+
+/* Per-thread counters, with the same ids as tprof. Each compute thread
+   owns one cache-line aligned block, so counting never false-shares. */
+typedef struct {
+    uint64_t c[LIM_R];
+} __attribute__((aligned(64))) thread_prof_t;
+
+extern thread_prof_t *thprof;
+#define TPROF(id, tid) (thprof[tid].c[id])
+
+void thprof_alloc(int nthreads);
+/* Grows the counters to at least nthreads threads, keeping the counts */
+void thprof_reserve(int nthreads);
+void thprof_free();
+
+/* Latency of each batch of the pipeline, from read to SAM written */
+void batch_lat_add(uint64_t ticks);
+int batch_lat_stats(double *p50, double *p99, double *max);    // ms; returns the batch count
+
+uint64_t tsc_freq();
+int write_metrics_json(const char *fn, int nthreads);
 #endif
@@ -28,19 +28,7 @@ Contacts: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@
                                 Heng Li <hli@jimmy.harvard.edu> 
 *****************************************************************************************/
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
-#include <sys/stat.h>
-#include <limits.h>
-#include <assert.h>
-#ifdef __cplusplus
-extern "C" {
-#endif
-#include "safe_str_lib.h"
-#ifdef __cplusplus
-}
-#endif
 
 #define SIMD_SSE     0x1
 #define SIMD_SSE2    0x2
@@ -92,112 +80,59 @@ static int x86_simd(void)
 	return flag;
 }
 
-static int exe_path(const char *exe, int max, char buf[], int *base_st)
-{
-	int i, len, last_slash, ret = 0;
-	if (exe == 0 || max == 0) return -1;
-	buf[0] = 0;
-	len = strlen(exe);
-	for (i = len - 1; i >= 0; --i)
-		if (exe[i] == '/') break;
-	last_slash = i;
-	if (base_st) *base_st = last_slash + 1;
-	if (exe[0] == '/') {
-		if (max < last_slash + 2) return -1;
-		strncpy_s(buf, max, exe, last_slash + 1);
-		buf[last_slash + 1] = 0;
-	} else if (last_slash >= 0) { // actually, can't be 0
-		char *p;
-		//int abs_len;
-		p = getcwd(buf, max);
-		if (p == 0) return -1;
-		//abs_len = strlen(buf);
-		//if (max < abs_len + 3 + last_slash) return -1;
-		//buf[abs_len] = '/';
-        strcat_s(buf, max, "/");
-		//strncpy_s(buf + abs_len + 1, max - (abs_len + 1), exe, last_slash + 1);
-        strncat_s(buf, max, exe, last_slash + 1);
-		//buf[abs_len + last_slash + 2] = 0;
-	} else {
-		char *env, *p, *q, *tmp;
-		int env_len, found = 0;
-		struct stat st;
-		env = getenv("PATH");
-        assert(env != NULL);
-		env_len = strlen(env);
-		if ((tmp = (char*)malloc(env_len + len + 2)) == NULL) { fprintf( stderr, "ERROR: out of memory %s", __func__); exit(EXIT_FAILURE);}
-		for (p = q = env;; ++p) {
-			if (*p == ':' || *p == 0) {
-				strncpy_s(tmp, env_len + len + 2, q, p - q);
-				tmp[p - q] = '/';
-				strcpy_s(tmp + (p - q + 1), env_len + len + 2 - (p - q + 1), exe);
-				if (stat(tmp, &st) == 0 && (st.st_mode & S_IXUSR)) {
-					found = 1;
-					break;
-				}
-				if (*p == 0) break;
-				q = p + 1;
-			}
-		}
-		if (!found) {
-			free(tmp);
-			return -2; // shouldn't happen!
-		}
-		ret = exe_path(tmp, max, buf, 0);
-		free(tmp);
-	}
-	return ret;
+/* Per-ISA images linked into this binary by "make multi"; each one is the
+   whole program built with that ISA's flags, its symbols made local but for
+   the entry point (see SIMD_ENTRY in main.cpp). */
+extern "C" {
+	int bwa_main_avx512bw(int argc, char *argv[]);
+	int bwa_main_avx2(int argc, char *argv[]);
+	int bwa_main_avx(int argc, char *argv[]);
+	int bwa_main_sse42(int argc, char *argv[]);
+	int bwa_main_sse2(int argc, char *argv[]);
 }
 
-static void test_and_launch(char *argv[], char *prefix, const char *simd) // we assume prefix is long enough
-{
-	struct stat st;
-    int prefix_len = strlen(prefix);
-	strcat_s(prefix, PATH_MAX, simd);
-    fprintf(stderr, "Looking to launch executable \"%s\", simd = %s\n", prefix, simd);
-    if(stat(prefix, &st) == 0)
-    {
-        if (st.st_mode & S_IXUSR) {
-            fprintf(stderr, "Launching executable \"%s\"\n", prefix);
-            execv(prefix, argv);
-        }
-        else
-        {
-            fprintf(stderr, "(st.st_mode & S_IXUSR) = %d, can not run executable: %s\n", st.st_mode & S_IXUSR, prefix);
-        }
-    }
-    else
-    {
-        fprintf(stderr, "stat(prefix, &st) = %d, can not run executable: %s\n", stat(prefix, &st), prefix);
-    }
-    prefix[prefix_len] = 0;
-}
+static const struct {
+	const char *name;
+	int flag;
+	int (*entry)(int, char **);
+} images[] = { // in order of preference
+	{ "avx512bw", SIMD_AVX512BW, bwa_main_avx512bw },
+	{ "avx2",     SIMD_AVX2,     bwa_main_avx2 },
+	{ "avx",      SIMD_AVX,      bwa_main_avx },
+	{ "sse42",    SIMD_SSE4_2,   bwa_main_sse42 },
+	{ "sse2",     SIMD_SSE2,     bwa_main_sse2 }
+};
 
 int main(int argc, char *argv[])
 {
-	char buf[PATH_MAX], *prefix, *argv0 = argv[0];
-	int ret, base_st, simd;
-	//int prefix_len;
-	ret = exe_path(argv0, PATH_MAX, buf, &base_st);
-	if (ret != 0) {
-		fprintf(stderr, "ERROR: prefix is too long!\n");
-		return 1;
+	const char *req = 0;
+	int i, j, simd, n_images = sizeof(images) / sizeof(images[0]);
+
+	// "--simd <name>" or "--simd=<name>" forces an image, e.g. for benchmarking
+	for (i = j = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--simd") == 0 && i + 1 < argc) req = argv[++i];
+		else if (strncmp(argv[i], "--simd=", 7) == 0) req = argv[i] + 7;
+		else argv[j++] = argv[i];
 	}
-	//printf("%s\n", buf);
-	if ((prefix = (char*)malloc(PATH_MAX)) == NULL) {
-		fprintf(stderr, "ERROR: out of memory.\n");
-		return 1;
-        }
-	strcpy_s(prefix, PATH_MAX, buf);
-	strcat_s(prefix, PATH_MAX, &argv0[base_st]);
-	//prefix_len = strlen(prefix);
+	argc = j; argv[argc] = 0;
+
 	simd = x86_simd();
-	if (simd & SIMD_AVX512BW) test_and_launch(argv, prefix, ".avx512bw");
-	if (simd & SIMD_AVX2) test_and_launch(argv, prefix, ".avx2");
-	if (simd & SIMD_AVX) test_and_launch(argv, prefix, ".avx");
-	if (simd & SIMD_SSE4_2) test_and_launch(argv, prefix, ".sse42");
-	if (simd & SIMD_SSE2) test_and_launch(argv, prefix, ".sse2");
-	free(prefix);
-	fprintf(stderr, "ERROR: fail to find the right executable\n");
+	for (i = 0; i < n_images; ++i) {
+		if (req && strcmp(req, images[i].name) != 0) continue;
+		if (!(simd & images[i].flag)) {
+			if (req) {
+				fprintf(stderr, "ERROR: the CPU does not support %s\n", req);
+				return 2;
+			}
+			continue;
+		}
+		fprintf(stderr, "Running the %s image\n", images[i].name);
+		return images[i].entry(argc, argv);
+	}
+	if (req) {
+		fprintf(stderr, "ERROR: unknown SIMD image '%s'; available:", req);
+		for (i = 0; i < n_images; ++i) fprintf(stderr, " %s", images[i].name);
+		fprintf(stderr, "\n");
+	} else fprintf(stderr, "ERROR: fail to find the right SIMD image\n");
 	return 2;
 }
@@ -0,0 +1,92 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+/*
+ * Scoring traits of the vector SW kernels (banded SW and kswv).
+ *
+ * The kernels are templates over one of these structs as well as over the
+ * vector traits. A preset fixes the match score a, the mismatch penalty b,
+ * the gap open / extension penalties o / e of both gap kinds, and the Z-drop
+ * and end bonus of the banded SW at compile time, so that they fold into
+ * the kernel as constants: the deletion and insertion terms of a cell
+ * share one gap-open computation, and the band setup needs neither the
+ * per-lane divisions by the extension penalties nor a second pass for
+ * deletions. sw_score_any (fixed == 0) is the
+ * generic kernel, which reads the scoring of the object at run time.
+ *
+ * sw_score_find() names the preset of a scoring; the callers switch on it
+ * once per batch. kswv has no Z-drop or end bonus and passes -1 for them,
+ * which matches any preset.
+ */
+
+#ifndef SCORE_TRAITS_H
+#define SCORE_TRAITS_H
+
+template <int A, int B, int O, int E, int Z, int EB>
+struct sw_score {
+    enum { fixed = 1, a = A, b = B, o = O, e = E, zdrop = Z, end_bonus = EB };
+};
+
+struct sw_score_any {
+    enum { fixed = 0, a = 0, b = 0, o = 0, e = 0, zdrop = 0, end_bonus = 0 };
+};
+
+typedef sw_score<1, 4, 6, 1, 100, 5>   sw_score_default;    // mem defaults
+typedef sw_score<1, 9, 16, 1, 100, 5>  sw_score_intractg;   // -x intractg
+typedef sw_score<1, 1, 1, 1, 100, 0>   sw_score_pacbio;     // -x pacbio, pbref and ont2d
+
+#define SW_SCORE_ANY      0
+#define SW_SCORE_DEFAULT  1
+#define SW_SCORE_INTRACTG 2
+#define SW_SCORE_PACBIO   3
+
+template <class S>
+static inline int sw_score_is(int a, int b, int o_del, int e_del, int o_ins, int e_ins,
+                              int zdrop, int end_bonus)
+{
+    return a == S::a && b == S::b && o_del == S::o && o_ins == S::o &&
+        e_del == S::e && e_ins == S::e && (zdrop < 0 || zdrop == S::zdrop) &&
+        (end_bonus < 0 || end_bonus == S::end_bonus);
+}
+
+/* b is the mismatch penalty, a positive number; zdrop or end_bonus < 0: any */
+static inline int sw_score_find(int a, int b, int o_del, int e_del, int o_ins, int e_ins,
+                                int zdrop, int end_bonus)
+{
+    if (sw_score_is<sw_score_default>(a, b, o_del, e_del, o_ins, e_ins, zdrop, end_bonus))
+        return SW_SCORE_DEFAULT;
+    if (sw_score_is<sw_score_intractg>(a, b, o_del, e_del, o_ins, e_ins, zdrop, end_bonus))
+        return SW_SCORE_INTRACTG;
+    if (sw_score_is<sw_score_pacbio>(a, b, o_del, e_del, o_ins, e_ins, zdrop, end_bonus))
+        return SW_SCORE_PACBIO;
+    return SW_SCORE_ANY;
+}
+
+#endif
@@ -0,0 +1,475 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+/*
+ * bwa-mem2 serve: keeps an index loaded and maps the reads of requests
+ * that arrive over a Unix domain socket; bwa-mem2 client sends one.
+ *
+ * A request is the line "BWAMEM2 <nargs>", nargs NUL-terminated mem
+ * options (see usage_serve) and then FASTQ/FASTA, plain or gzipped, up to
+ * the end of the client's stream. The reply is "OK" and the SAM output, or
+ * "ERR <message>". The accepting thread queues at most -q connections and
+ * turns away the rest; one dispatching thread maps the requests in order,
+ * each in batches of -K bases on the compute threads of a single aligner.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <zlib.h>
+#include "fastmap.h"
+#include "libbwamem2.h"
+
+#define SRV_MAGIC    "BWAMEM2"
+#define SRV_MAX_ARGS 64
+#define SRV_MAX_HDR  65536
+
+typedef struct {
+    bm2_index_t *idx;
+    bm2_aligner_t *al;
+    const mem_opt_t *opt;   // options of the server; requests start from these
+    int64_t task_size;      // bases per batch
+
+    // bounded queue of accepted connections
+    int *fd, cap, head, n, done;
+    pthread_mutex_t lock;
+    pthread_cond_t cv;
+} srv_t;
+
+static volatile sig_atomic_t srv_stop = 0;
+
+static void srv_on_signal(int sig)
+{
+    srv_stop = 1;
+}
+
+static int srv_unix_addr(struct sockaddr_un *addr, const char *path)
+{
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "[E::%s] socket path is too long: %s\n", __func__, path);
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+static int srv_write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t k = write(fd, buf, len);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return -1;
+        buf += k, len -= k;
+    }
+    return 0;
+}
+
+/* Reads the request header; argv[0] is "serve", so that getopt can parse it */
+static int srv_read_args(int fd, char *buf, int *argc, char **argv)
+{
+    char line[64];
+    int l = 0, nargs;
+    while (l < (int) sizeof(line) - 1 && read(fd, &line[l], 1) == 1 && line[l] != '\n') l++;
+    line[l] = 0;
+    if (strncmp(line, SRV_MAGIC " ", sizeof(SRV_MAGIC)) != 0) return -1;
+    nargs = atoi(line + sizeof(SRV_MAGIC));
+    if (nargs < 0 || nargs >= SRV_MAX_ARGS) return -1;
+
+    argv[0] = (char *) "serve";
+    l = 0;
+    for (*argc = 1; *argc <= nargs; (*argc)++) {
+        argv[*argc] = &buf[l];
+        do {
+            if (l == SRV_MAX_HDR || read(fd, &buf[l], 1) != 1) return -1;
+        } while (buf[l++] != 0);
+    }
+    argv[*argc] = NULL;
+    return 0;
+}
+
+/* Options of a request on top of the server's; NULL and a message on error */
+static const char *srv_parse_opt(int argc, char **argv, mem_opt_t *opt, char **rg_line,
+                                 int *copy_comment)
+{
+    int c;
+    optind = 0;     // re-initialise getopt for every request
+    opterr = 0;
+    while ((c = getopt(argc, argv, "paMYC5qT:R:")) >= 0) {
+        if (c == 'p') opt->flag |= MEM_F_PE | MEM_F_SMARTPE;
+        else if (c == 'a') opt->flag |= MEM_F_ALL;
+        else if (c == 'M') opt->flag |= MEM_F_NO_MULTI;
+        else if (c == 'Y') opt->flag |= MEM_F_SOFTCLIP;
+        else if (c == '5') opt->flag |= MEM_F_PRIMARY5 | MEM_F_KEEP_SUPP_MAPQ;
+        else if (c == 'q') opt->flag |= MEM_F_KEEP_SUPP_MAPQ;
+        else if (c == 'C') *copy_comment = 1;
+        else if (c == 'T') opt->T = atoi(optarg);
+        else if (c == 'R') {
+            free(*rg_line);
+            if ((*rg_line = bwa_set_rg(optarg)) == 0) return "invalid read group line";
+            opt->rg_id = bwa_rg_id;
+        }
+        else return "unknown option or missing argument";
+    }
+    if (optind != argc) return "unexpected argument";
+    return NULL;
+}
+
+/* Maps a batch as mem does; with -p, names decide what is paired */
+static void srv_align(srv_t *s, const mem_opt_t *opt, int64_t n_processed, int n, bseq1_t *seqs)
+{
+    if (!(opt->flag & MEM_F_SMARTPE)) {
+        bm2_aligner_set_opt(s->al, opt);
+        bm2_aligner_seek(s->al, n_processed);
+        bm2_align(s->al, n, seqs, NULL, NULL);
+        return;
+    }
+    bseq1_t *sep[2];
+    int n_sep[2];
+    mem_opt_t tmp_opt = *opt;
+    bseq_classify(n, seqs, n_sep, sep);
+    for (int k = 0; k < 2; k++) {
+        if (n_sep[k] == 0) continue;
+        if (k == 0) tmp_opt.flag &= ~MEM_F_PE;
+        else tmp_opt.flag |= MEM_F_PE;
+        bm2_aligner_set_opt(s->al, &tmp_opt);
+        bm2_aligner_seek(s->al, n_processed + (k? n_sep[0] : 0));
+        bm2_align(s->al, n_sep[k], sep[k], NULL, NULL);
+        for (int i = 0; i < n_sep[k]; i++)
+            seqs[sep[k][i].id].sam = sep[k][i].sam;
+    }
+    free(sep[0]); free(sep[1]);
+}
+
+static void srv_handle(srv_t *s, int fd)
+{
+    char *buf = (char *) malloc(SRV_MAX_HDR + 1), *argv[SRV_MAX_ARGS + 1], *rg_line = 0;
+    int argc, copy_comment = 0;
+    mem_opt_t opt = *s->opt;
+    const char *err = NULL;
+    double rtime = realtime();
+    assert(buf != NULL);
+
+    if (srv_read_args(fd, buf, &argc, argv) != 0) err = "malformed request";
+    else err = srv_parse_opt(argc, argv, &opt, &rg_line, &copy_comment);
+    if (err) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "ERR %s\n", err);
+        srv_write_all(fd, msg, strlen(msg));
+        fprintf(stderr, "[W::%s] request rejected: %s\n", __func__, err);
+        free(rg_line); free(buf);
+        return;
+    }
+
+    FILE *out = fdopen(dup(fd), "w");
+    gzFile in = gzdopen(dup(fd), "r");
+    kseq_t *ks = kseq_init(in);
+    // the header goes through memory: err_fputs() would end the server on a lost client
+    char *hdr;
+    size_t l_hdr;
+    FILE *mem = open_memstream(&hdr, &l_hdr);
+    bwa_print_sam_hdr(bm2_idx_bns(s->idx), rg_line, mem);
+    fclose(mem);
+    fputs("OK\n", out);
+    fputs(hdr, out);
+    free(hdr);
+
+    int64_t n_processed = 0;
+    for (;;) {
+        int n;
+        int64_t sz = 0;
+        bseq1_t *seqs = bseq_read_orig(s->task_size, &n, ks, NULL, &sz);
+        if (seqs == 0) break;
+        if (!copy_comment)
+            for (int i = 0; i < n; i++) {
+                free(seqs[i].comment);
+                seqs[i].comment = 0;
+            }
+        srv_align(s, &opt, n_processed, n, seqs);
+        n_processed += n;
+        for (int i = 0; i < n; i++) {
+            if (seqs[i].sam) fputs(seqs[i].sam, out);
+            free(seqs[i].name); free(seqs[i].comment);
+            free(seqs[i].seq); free(seqs[i].qual); free(seqs[i].sam);
+        }
+        free(seqs);
+    }
+    fclose(out);
+    kseq_destroy(ks);
+    gzclose(in);
+    fprintf(stderr, "[M::%s] mapped %ld reads of a request in %.3f real sec\n", __func__,
+            (long) n_processed, realtime() - rtime);
+    free(rg_line); free(buf);
+}
+
+static void *srv_dispatch(void *data)
+{
+    srv_t *s = (srv_t *) data;
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        while (s->n == 0 && !s->done)
+            pthread_cond_wait(&s->cv, &s->lock);
+        if (s->n == 0) {     // done and drained
+            pthread_mutex_unlock(&s->lock);
+            break;
+        }
+        int fd = s->fd[s->head];
+        s->head = (s->head + 1) % s->cap, s->n--;
+        pthread_mutex_unlock(&s->lock);
+
+        srv_handle(s, fd);
+        close(fd);
+    }
+    return 0;
+}
+
+static void usage_serve()
+{
+    fprintf(stderr, "Usage: bwa-mem2 serve [options] <idxbase> <socket>\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "   -t INT        number of threads [1]\n");
+    fprintf(stderr, "   -K INT        bases per batch [10000000 x threads]\n");
+    fprintf(stderr, "   -q INT        requests queued before new ones are turned away [16]\n");
+    fprintf(stderr, "Options of a request (bwa-mem2 client): -p (smart pairing of interleaved\n");
+    fprintf(stderr, "reads), -R STR (read group line), -T INT, -a, -M, -Y, -C, -5, -q, as in mem.\n");
+}
+
+int main_serve(int argc, char *argv[])
+{
+    int c, nthreads = 1, qcap = 16;
+    int64_t task_size = 0;
+
+    while ((c = getopt(argc, argv, "t:K:q:")) >= 0) {
+        if (c == 't') nthreads = atoi(optarg);
+        else if (c == 'K') task_size = atol(optarg);
+        else if (c == 'q') qcap = atoi(optarg);
+        else {
+            usage_serve();
+            return 1;
+        }
+    }
+    if (optind + 2 != argc || nthreads < 1 || qcap < 1) {
+        usage_serve();
+        return 1;
+    }
+    const char *path = argv[optind + 1];
+
+    struct sockaddr_un addr;
+    if (srv_unix_addr(&addr, path) != 0) return 1;
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0) {
+        fprintf(stderr, "[E::%s] can't create a socket: %s\n", __func__, strerror(errno));
+        return 1;
+    }
+    // a socket nobody answers on is left over from an earlier server
+    if (connect(lfd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "[E::%s] a server is already listening on %s\n", __func__, path);
+        close(lfd);
+        return 1;
+    }
+    unlink(path);
+    if (bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(lfd, qcap) != 0) {
+        fprintf(stderr, "[E::%s] can't listen on %s: %s\n", __func__, path, strerror(errno));
+        close(lfd);
+        return 1;
+    }
+
+    srv_t s;
+    memset(&s, 0, sizeof(srv_t));
+    mem_opt_t *opt = mem_opt_init();
+    bwa_fill_scmat(opt->a, opt->b, opt->mat);
+    s.opt = opt;
+    s.task_size = task_size > 0? task_size : (int64_t) opt->chunk_size * nthreads;
+    if ((s.idx = bm2_idx_load(argv[optind])) == NULL) {
+        close(lfd);
+        unlink(path);
+        free(opt);
+        return 1;
+    }
+    s.al = bm2_aligner_init(s.idx, opt, nthreads);
+    s.cap = qcap;
+    s.fd = (int *) malloc(qcap * sizeof(int));
+    assert(s.fd != NULL);
+    pthread_mutex_init(&s.lock, 0);
+    pthread_cond_init(&s.cv, 0);
+
+    // only this thread takes SIGINT/SIGTERM, so that they interrupt accept()
+    struct sigaction sa;
+    sigset_t sigs, old;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = srv_on_signal;
+    sigaction(SIGINT, &sa, 0);
+    sigaction(SIGTERM, &sa, 0);
+    signal(SIGPIPE, SIG_IGN);
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigs, &old);
+    pthread_t tid;
+    pthread_create(&tid, 0, srv_dispatch, &s);
+    pthread_sigmask(SIG_SETMASK, &old, 0);
+
+    fprintf(stderr, "[M::%s] serving %s on %s with %d threads\n", __func__, argv[optind], path,
+            nthreads);
+    while (!srv_stop) {
+        int fd = accept(lfd, 0, 0);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            fprintf(stderr, "[E::%s] accept failed: %s\n", __func__, strerror(errno));
+            break;
+        }
+        pthread_mutex_lock(&s.lock);
+        int full = s.n == s.cap;
+        if (!full) {
+            s.fd[(s.head + s.n) % s.cap] = fd, s.n++;
+            pthread_cond_signal(&s.cv);
+        }
+        pthread_mutex_unlock(&s.lock);
+        if (full) {
+            static const char busy[] = "ERR server busy; try again\n";
+            srv_write_all(fd, busy, sizeof(busy) - 1);
+            close(fd);
+        }
+    }
+
+    fprintf(stderr, "[M::%s] shutting down after %d queued requests\n", __func__, s.n);
+    close(lfd);
+    unlink(path);
+    pthread_mutex_lock(&s.lock);
+    s.done = 1;
+    pthread_cond_signal(&s.cv);
+    pthread_mutex_unlock(&s.lock);
+    pthread_join(tid, 0);
+
+    bm2_aligner_destroy(s.al);
+    bm2_idx_destroy(s.idx);
+    pthread_mutex_destroy(&s.lock);
+    pthread_cond_destroy(&s.cv);
+    free(s.fd);
+    free(opt);
+    return 0;
+}
+
+typedef struct {
+    int fd, in;
+} cli_send_t;
+
+static void *cli_send(void *data)
+{
+    cli_send_t *p = (cli_send_t *) data;
+    char buf[65536];
+    ssize_t k;
+    while ((k = read(p->in, buf, sizeof(buf))) > 0 || (k < 0 && errno == EINTR))
+        if (k > 0 && srv_write_all(p->fd, buf, k) != 0) break;
+    shutdown(p->fd, SHUT_WR);
+    return 0;
+}
+
+static void usage_client()
+{
+    fprintf(stderr, "Usage: bwa-mem2 client [-i in.fq] <socket> [mem options]\n");
+    fprintf(stderr, "Sends the reads of in.fq (standard input if absent; FASTQ or FASTA, may be\n");
+    fprintf(stderr, "gzipped) to bwa-mem2 serve and writes the SAM output to standard output.\n");
+    fprintf(stderr, "The options are those of a request in bwa-mem2 serve.\n");
+}
+
+int main_client(int argc, char *argv[])
+{
+    int c, in = 0;
+    const char *fn = NULL;
+
+    while ((c = getopt(argc, argv, "+i:")) >= 0) {
+        if (c == 'i') fn = optarg;
+        else {
+            usage_client();
+            return 1;
+        }
+    }
+    if (optind >= argc || argc - optind - 1 >= SRV_MAX_ARGS) {
+        usage_client();
+        return 1;
+    }
+    if (fn && (in = open(fn, O_RDONLY)) < 0) {
+        fprintf(stderr, "[E::%s] can't open %s: %s\n", __func__, fn, strerror(errno));
+        return 1;
+    }
+
+    struct sockaddr_un addr;
+    if (srv_unix_addr(&addr, argv[optind]) != 0) return 1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "[E::%s] can't connect to %s: %s\n", __func__, argv[optind],
+                strerror(errno));
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    kstring_t hdr = {0, 0, 0};
+    ksprintf(&hdr, "%s %d\n", SRV_MAGIC, argc - optind - 1);
+    for (int i = optind + 1; i < argc; i++)
+        kputsn(argv[i], strlen(argv[i]) + 1, &hdr);   // with the NUL
+    // a busy server may have replied and closed already; its reply says why
+    int sent = srv_write_all(fd, hdr.s, hdr.l) == 0;
+    free(hdr.s);
+
+    // reads go out while the SAM comes back, so neither side blocks the other
+    cli_send_t send = { fd, in };
+    pthread_t tid;
+    if (sent) pthread_create(&tid, 0, cli_send, &send);
+
+    char buf[65536], status[256];
+    int l = 0, ret = 1;
+    ssize_t k;
+    while (l < (int) sizeof(status) - 1 && read(fd, &status[l], 1) == 1 && status[l] != '\n') l++;
+    status[l] = 0;
+    if (strcmp(status, "OK") == 0) {
+        ret = 0;
+        while ((k = read(fd, buf, sizeof(buf))) > 0 || (k < 0 && errno == EINTR))
+            if (k > 0 && srv_write_all(1, buf, k) != 0) {
+                ret = 1;
+                break;
+            }
+    } else fprintf(stderr, "[E::%s] %s\n", __func__, strncmp(status, "ERR ", 4) == 0? status + 4 :
+                   "no reply from the server");
+
+    // on success the server has read all input; otherwise the sender may wait on it
+    if (ret == 0 && sent) pthread_join(tid, 0);
+    close(fd);
+    if (in) close(in);
+    return ret;
+}
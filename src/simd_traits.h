@@ -0,0 +1,321 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+/*
+ * Vector traits for the SIMD kernels.
+ *
+ * Each struct wraps one (register width, lane type) combination behind the
+ * same set of static inline operations so that a kernel can be written once
+ * as a template and instantiated per ISA with fully inlined intrinsics:
+ *
+ *   v, mask     vector type and lane-mask type (a k-register on AVX512,
+ *               a full-lane compare vector elsewhere)
+ *   elem, uelem signed / unsigned lane type
+ *   W           number of lanes
+ *
+ *   eq/gt       signed lane compares returning a mask
+ *   sign        mask of lanes whose top bit is set
+ *   blend(m,a,b) b in the lanes selected by m, a elsewhere
+ *   all/none    whether every / no lane of a mask is set
+ *
+ * vec_i8 and vec_i16 name the widest traits available for the target ISA.
+ */
+
+#ifndef SIMD_TRAITS_H
+#define SIMD_TRAITS_H
+
+#include <stdint.h>
+
+#if (__AVX512BW__ || __AVX2__)
+#include <immintrin.h>
+#elif __SSE4_1__
+#include <smmintrin.h>
+#elif __SSSE3__
+#include <tmmintrin.h>
+#elif __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define SIMD_INLINE static inline __attribute__((always_inline))
+
+#if __AVX512BW__
+struct vec512_i8 {
+    typedef __m512i v;
+    typedef __mmask64 mask;
+    typedef int8_t elem;
+    typedef uint8_t uelem;
+    enum { W = 64 };
+
+    SIMD_INLINE v zero() { return _mm512_setzero_si512(); }
+    SIMD_INLINE v set1(int x) { return _mm512_set1_epi8(x); }
+    SIMD_INLINE v load(const void *p) { return _mm512_load_si512(p); }
+    SIMD_INLINE void store(void *p, v a) { _mm512_store_si512(p, a); }
+    SIMD_INLINE v add(v a, v b) { return _mm512_add_epi8(a, b); }
+    SIMD_INLINE v sub(v a, v b) { return _mm512_sub_epi8(a, b); }
+    SIMD_INLINE v max(v a, v b) { return _mm512_max_epi8(a, b); }
+    SIMD_INLINE v min(v a, v b) { return _mm512_min_epi8(a, b); }
+    SIMD_INLINE v maxu(v a, v b) { return _mm512_max_epu8(a, b); }
+    SIMD_INLINE v minu(v a, v b) { return _mm512_min_epu8(a, b); }
+    SIMD_INLINE v abs(v a) { return _mm512_abs_epi8(a); }
+    SIMD_INLINE v or_(v a, v b) { return _mm512_or_si512(a, b); }
+    SIMD_INLINE v xor_(v a, v b) { return _mm512_xor_si512(a, b); }
+    SIMD_INLINE mask eq(v a, v b) { return _mm512_cmpeq_epi8_mask(a, b); }
+    SIMD_INLINE mask gt(v a, v b) { return _mm512_cmpgt_epi8_mask(a, b); }
+    SIMD_INLINE mask sign(v a) { return _mm512_movepi8_mask(a); }
+    SIMD_INLINE v blend(mask m, v a, v b) { return _mm512_mask_blend_epi8(m, a, b); }
+    SIMD_INLINE mask mor(mask a, mask b) { return a | b; }
+    SIMD_INLINE mask mand(mask a, mask b) { return a & b; }
+    SIMD_INLINE mask ones() { return (mask) -1; }
+    SIMD_INLINE bool all(mask m) { return m == (mask) -1; }
+    SIMD_INLINE bool none(mask m) { return m == 0; }
+};
+
+struct vec512_i16 {
+    typedef __m512i v;
+    typedef __mmask32 mask;
+    typedef int16_t elem;
+    typedef uint16_t uelem;
+    enum { W = 32 };
+
+    SIMD_INLINE v zero() { return _mm512_setzero_si512(); }
+    SIMD_INLINE v set1(int x) { return _mm512_set1_epi16(x); }
+    SIMD_INLINE v load(const void *p) { return _mm512_load_si512(p); }
+    SIMD_INLINE void store(void *p, v a) { _mm512_store_si512(p, a); }
+    SIMD_INLINE v add(v a, v b) { return _mm512_add_epi16(a, b); }
+    SIMD_INLINE v sub(v a, v b) { return _mm512_sub_epi16(a, b); }
+    SIMD_INLINE v max(v a, v b) { return _mm512_max_epi16(a, b); }
+    SIMD_INLINE v min(v a, v b) { return _mm512_min_epi16(a, b); }
+    SIMD_INLINE v maxu(v a, v b) { return _mm512_max_epu16(a, b); }
+    SIMD_INLINE v minu(v a, v b) { return _mm512_min_epu16(a, b); }
+    SIMD_INLINE v abs(v a) { return _mm512_abs_epi16(a); }
+    SIMD_INLINE v or_(v a, v b) { return _mm512_or_si512(a, b); }
+    SIMD_INLINE v xor_(v a, v b) { return _mm512_xor_si512(a, b); }
+    SIMD_INLINE mask eq(v a, v b) { return _mm512_cmpeq_epi16_mask(a, b); }
+    SIMD_INLINE mask gt(v a, v b) { return _mm512_cmpgt_epi16_mask(a, b); }
+    SIMD_INLINE mask sign(v a) { return _mm512_movepi16_mask(a); }
+    SIMD_INLINE v blend(mask m, v a, v b) { return _mm512_mask_blend_epi16(m, a, b); }
+    SIMD_INLINE mask mor(mask a, mask b) { return a | b; }
+    SIMD_INLINE mask mand(mask a, mask b) { return a & b; }
+    SIMD_INLINE mask ones() { return (mask) -1; }
+    SIMD_INLINE bool all(mask m) { return m == (mask) -1; }
+    SIMD_INLINE bool none(mask m) { return m == 0; }
+};
+#endif  // __AVX512BW__
+
+#if __AVX2__
+struct vec256_i8 {
+    typedef __m256i v;
+    typedef __m256i mask;
+    typedef int8_t elem;
+    typedef uint8_t uelem;
+    enum { W = 32 };
+
+    SIMD_INLINE v zero() { return _mm256_setzero_si256(); }
+    SIMD_INLINE v set1(int x) { return _mm256_set1_epi8(x); }
+    SIMD_INLINE v load(const void *p) { return _mm256_load_si256((const __m256i *) p); }
+    SIMD_INLINE void store(void *p, v a) { _mm256_store_si256((__m256i *) p, a); }
+    SIMD_INLINE v add(v a, v b) { return _mm256_add_epi8(a, b); }
+    SIMD_INLINE v sub(v a, v b) { return _mm256_sub_epi8(a, b); }
+    SIMD_INLINE v max(v a, v b) { return _mm256_max_epi8(a, b); }
+    SIMD_INLINE v min(v a, v b) { return _mm256_min_epi8(a, b); }
+    SIMD_INLINE v maxu(v a, v b) { return _mm256_max_epu8(a, b); }
+    SIMD_INLINE v minu(v a, v b) { return _mm256_min_epu8(a, b); }
+    SIMD_INLINE v abs(v a) { return _mm256_abs_epi8(a); }
+    SIMD_INLINE v or_(v a, v b) { return _mm256_or_si256(a, b); }
+    SIMD_INLINE v xor_(v a, v b) { return _mm256_xor_si256(a, b); }
+    SIMD_INLINE mask eq(v a, v b) { return _mm256_cmpeq_epi8(a, b); }
+    SIMD_INLINE mask gt(v a, v b) { return _mm256_cmpgt_epi8(a, b); }
+    SIMD_INLINE mask sign(v a) { return a; }
+    SIMD_INLINE v blend(mask m, v a, v b) { return _mm256_blendv_epi8(a, b, m); }
+    SIMD_INLINE mask mor(mask a, mask b) { return _mm256_or_si256(a, b); }
+    SIMD_INLINE mask mand(mask a, mask b) { return _mm256_and_si256(a, b); }
+    SIMD_INLINE mask ones() { return _mm256_set1_epi8(-1); }
+    SIMD_INLINE bool all(mask m) { return _mm256_movemask_epi8(m) == -1; }
+    SIMD_INLINE bool none(mask m) { return _mm256_movemask_epi8(m) == 0; }
+};
+
+struct vec256_i16 {
+    typedef __m256i v;
+    typedef __m256i mask;
+    typedef int16_t elem;
+    typedef uint16_t uelem;
+    enum { W = 16 };
+
+    SIMD_INLINE v zero() { return _mm256_setzero_si256(); }
+    SIMD_INLINE v set1(int x) { return _mm256_set1_epi16(x); }
+    SIMD_INLINE v load(const void *p) { return _mm256_load_si256((const __m256i *) p); }
+    SIMD_INLINE void store(void *p, v a) { _mm256_store_si256((__m256i *) p, a); }
+    SIMD_INLINE v add(v a, v b) { return _mm256_add_epi16(a, b); }
+    SIMD_INLINE v sub(v a, v b) { return _mm256_sub_epi16(a, b); }
+    SIMD_INLINE v max(v a, v b) { return _mm256_max_epi16(a, b); }
+    SIMD_INLINE v min(v a, v b) { return _mm256_min_epi16(a, b); }
+    SIMD_INLINE v maxu(v a, v b) { return _mm256_max_epu16(a, b); }
+    SIMD_INLINE v minu(v a, v b) { return _mm256_min_epu16(a, b); }
+    SIMD_INLINE v abs(v a) { return _mm256_abs_epi16(a); }
+    SIMD_INLINE v or_(v a, v b) { return _mm256_or_si256(a, b); }
+    SIMD_INLINE v xor_(v a, v b) { return _mm256_xor_si256(a, b); }
+    SIMD_INLINE mask eq(v a, v b) { return _mm256_cmpeq_epi16(a, b); }
+    SIMD_INLINE mask gt(v a, v b) { return _mm256_cmpgt_epi16(a, b); }
+    SIMD_INLINE mask sign(v a) { return _mm256_srai_epi16(a, 15); }
+    SIMD_INLINE v blend(mask m, v a, v b) { return _mm256_blendv_epi8(a, b, m); }
+    SIMD_INLINE mask mor(mask a, mask b) { return _mm256_or_si256(a, b); }
+    SIMD_INLINE mask mand(mask a, mask b) { return _mm256_and_si256(a, b); }
+    SIMD_INLINE mask ones() { return _mm256_set1_epi16(-1); }
+    SIMD_INLINE bool all(mask m) { return _mm256_movemask_epi8(m) == -1; }
+    SIMD_INLINE bool none(mask m) { return _mm256_movemask_epi8(m) == 0; }
+};
+#endif  // __AVX2__
+
+#if __SSE2__
+// SSE2 lacks signed 8-bit max/min, unsigned 16-bit max/min, abs and blendv;
+// they are emulated below and replaced by the native SSSE3/SSE4.1
+// instructions when the target has them.
+struct vec128_i8 {
+    typedef __m128i v;
+    typedef __m128i mask;
+    typedef int8_t elem;
+    typedef uint8_t uelem;
+    enum { W = 16 };
+
+    SIMD_INLINE v zero() { return _mm_setzero_si128(); }
+    SIMD_INLINE v set1(int x) { return _mm_set1_epi8(x); }
+    SIMD_INLINE v load(const void *p) { return _mm_load_si128((const __m128i *) p); }
+    SIMD_INLINE void store(void *p, v a) { _mm_store_si128((__m128i *) p, a); }
+    SIMD_INLINE v add(v a, v b) { return _mm_add_epi8(a, b); }
+    SIMD_INLINE v sub(v a, v b) { return _mm_sub_epi8(a, b); }
+    SIMD_INLINE v blend(mask m, v a, v b) {
+#if __SSE4_1__
+        return _mm_blendv_epi8(a, b, m);
+#else
+        return _mm_or_si128(_mm_andnot_si128(m, a), _mm_and_si128(m, b));
+#endif
+    }
+    SIMD_INLINE v max(v a, v b) {
+#if __SSE4_1__
+        return _mm_max_epi8(a, b);
+#else
+        return blend(_mm_cmpgt_epi8(b, a), a, b);
+#endif
+    }
+    SIMD_INLINE v min(v a, v b) {
+#if __SSE4_1__
+        return _mm_min_epi8(a, b);
+#else
+        return blend(_mm_cmpgt_epi8(a, b), a, b);
+#endif
+    }
+    SIMD_INLINE v maxu(v a, v b) { return _mm_max_epu8(a, b); }
+    SIMD_INLINE v minu(v a, v b) { return _mm_min_epu8(a, b); }
+    SIMD_INLINE v abs(v a) {
+#if __SSSE3__
+        return _mm_abs_epi8(a);
+#else
+        return max(a, _mm_sub_epi8(_mm_setzero_si128(), a));
+#endif
+    }
+    SIMD_INLINE v or_(v a, v b) { return _mm_or_si128(a, b); }
+    SIMD_INLINE v xor_(v a, v b) { return _mm_xor_si128(a, b); }
+    SIMD_INLINE mask eq(v a, v b) { return _mm_cmpeq_epi8(a, b); }
+    SIMD_INLINE mask gt(v a, v b) { return _mm_cmpgt_epi8(a, b); }
+    SIMD_INLINE mask sign(v a) { return _mm_cmpgt_epi8(_mm_setzero_si128(), a); }
+    SIMD_INLINE mask mor(mask a, mask b) { return _mm_or_si128(a, b); }
+    SIMD_INLINE mask mand(mask a, mask b) { return _mm_and_si128(a, b); }
+    SIMD_INLINE mask ones() { return _mm_set1_epi8(-1); }
+    SIMD_INLINE bool all(mask m) { return _mm_movemask_epi8(m) == 0xFFFF; }
+    SIMD_INLINE bool none(mask m) { return _mm_movemask_epi8(m) == 0; }
+};
+
+struct vec128_i16 {
+    typedef __m128i v;
+    typedef __m128i mask;
+    typedef int16_t elem;
+    typedef uint16_t uelem;
+    enum { W = 8 };
+
+    SIMD_INLINE v zero() { return _mm_setzero_si128(); }
+    SIMD_INLINE v set1(int x) { return _mm_set1_epi16(x); }
+    SIMD_INLINE v load(const void *p) { return _mm_load_si128((const __m128i *) p); }
+    SIMD_INLINE void store(void *p, v a) { _mm_store_si128((__m128i *) p, a); }
+    SIMD_INLINE v add(v a, v b) { return _mm_add_epi16(a, b); }
+    SIMD_INLINE v sub(v a, v b) { return _mm_sub_epi16(a, b); }
+    SIMD_INLINE v blend(mask m, v a, v b) {
+#if __SSE4_1__
+        return _mm_blendv_epi8(a, b, m);
+#else
+        return _mm_or_si128(_mm_andnot_si128(m, a), _mm_and_si128(m, b));
+#endif
+    }
+    SIMD_INLINE v max(v a, v b) { return _mm_max_epi16(a, b); }
+    SIMD_INLINE v min(v a, v b) { return _mm_min_epi16(a, b); }
+    SIMD_INLINE v maxu(v a, v b) {
+#if __SSE4_1__
+        return _mm_max_epu16(a, b);
+#else
+        return _mm_add_epi16(a, _mm_subs_epu16(b, a));
+#endif
+    }
+    SIMD_INLINE v minu(v a, v b) {
+#if __SSE4_1__
+        return _mm_min_epu16(a, b);
+#else
+        return _mm_sub_epi16(a, _mm_subs_epu16(a, b));
+#endif
+    }
+    SIMD_INLINE v abs(v a) {
+#if __SSSE3__
+        return _mm_abs_epi16(a);
+#else
+        return _mm_max_epi16(a, _mm_sub_epi16(_mm_setzero_si128(), a));
+#endif
+    }
+    SIMD_INLINE v or_(v a, v b) { return _mm_or_si128(a, b); }
+    SIMD_INLINE v xor_(v a, v b) { return _mm_xor_si128(a, b); }
+    SIMD_INLINE mask eq(v a, v b) { return _mm_cmpeq_epi16(a, b); }
+    SIMD_INLINE mask gt(v a, v b) { return _mm_cmpgt_epi16(a, b); }
+    SIMD_INLINE mask sign(v a) { return _mm_srai_epi16(a, 15); }
+    SIMD_INLINE mask mor(mask a, mask b) { return _mm_or_si128(a, b); }
+    SIMD_INLINE mask mand(mask a, mask b) { return _mm_and_si128(a, b); }
+    SIMD_INLINE mask ones() { return _mm_set1_epi16(-1); }
+    SIMD_INLINE bool all(mask m) { return _mm_movemask_epi8(m) == 0xFFFF; }
+    SIMD_INLINE bool none(mask m) { return _mm_movemask_epi8(m) == 0; }
+};
+#endif  // __SSE2__
+
+#if __AVX512BW__
+typedef vec512_i8  vec_i8;
+typedef vec512_i16 vec_i16;
+#elif __AVX2__
+typedef vec256_i8  vec_i8;
+typedef vec256_i16 vec_i16;
+#elif __SSE2__
+typedef vec128_i8  vec_i8;
+typedef vec128_i16 vec_i16;
+#endif
+
+#endif
@@ -0,0 +1,187 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+#include "macro.h"
+#include "utils.h"
+#include "profiling.h"
+#include "trace.h"
+
+#define TR_N_PIPE 2     /* pipeline workers; process() runs at most two */
+
+typedef struct {
+    uint64_t ts, dur;   // rdtsc; dur == 0 for instant events
+    int64_t a0, a1;
+    int32_t kind;
+} tr_event_t;
+
+typedef struct {
+    tr_event_t *ev;
+    uint64_t n;         // events recorded, including overwritten ones
+} __attribute__((aligned(64))) tr_track_t;
+
+static const struct {
+    const char *name, *cat, *arg0, *arg1;
+} tr_kinds[TR_NKIND] = {
+    { "read",                "pipeline", "chunk", NULL },
+    { "compute",             "pipeline", "chunk", NULL },
+    { "write",               "pipeline", "chunk", NULL },
+    { "wait",                "pipeline", "step", NULL },
+    { "kt_for worker_bwt",   "kt_for", "reads", NULL },
+    { "kt_for worker_aln",   "kt_for", "reads", NULL },
+    { "kt_for worker_sam",   "kt_for", "reads", NULL },
+    { "worker_bwt",          "batch", "seq", "n" },
+    { "worker_aln",          "batch", "seq", "n" },
+    { "worker_sam",          "batch", "seq", "n" },
+    { "realloc seq pairs",   "memory", "pairs", NULL },
+    { "realloc seq buffers", "memory", "ref_bytes", "qer_bytes" },
+    { "realloc SMEM buffers", "memory", "entries", NULL },
+    { "realloc chain buffers", "memory", "reads", NULL },
+    { "kt_for_pair worker_bwt+aln", "kt_for", "reads", NULL },
+};
+
+int tr_on = 0;
+static int tr_nthreads = 0, tr_ntracks = 0;
+static tr_track_t *tr_tracks = NULL;
+static uint64_t tr_t0;
+static __thread int tr_self = -1;
+
+void tr_init(int nthreads)
+{
+    tr_nthreads = nthreads;
+    tr_ntracks = nthreads + TR_N_PIPE + 1;
+    if (posix_memalign((void **) &tr_tracks, 64, tr_ntracks * sizeof(tr_track_t)) != 0) {
+        fprintf(stderr, "Error: can't allocate trace buffers for %d threads\n", nthreads);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < tr_ntracks; i++) {
+        tr_tracks[i].ev = (tr_event_t *) malloc(TR_RING_EVENTS * sizeof(tr_event_t));
+        tr_tracks[i].n = 0;
+        if (tr_tracks[i].ev == NULL) {
+            fprintf(stderr, "Error: can't allocate trace buffers for %d threads\n", nthreads);
+            exit(EXIT_FAILURE);
+        }
+    }
+    tr_t0 = __rdtsc();
+    tr_on = 1;
+}
+
+void tr_free()
+{
+    if (tr_tracks == NULL) return;
+    tr_on = 0;
+    for (int i = 0; i < tr_ntracks; i++) free(tr_tracks[i].ev);
+    free(tr_tracks);
+    tr_tracks = NULL;
+}
+
+void tr_set_pipe(int i)
+{
+    tr_self = tr_nthreads + i;
+}
+
+uint64_t tr_now()
+{
+    return tr_on? __rdtsc() : 0;
+}
+
+static void tr_put(int track, int kind, uint64_t ts, uint64_t dur, int64_t a0, int64_t a1)
+{
+    if (track == TR_SELF) track = tr_self >= 0? tr_self : tr_ntracks - 1;
+    tr_track_t *t = &tr_tracks[track];
+    tr_event_t *e = &t->ev[t->n++ & (TR_RING_EVENTS - 1)];
+    e->ts = ts, e->dur = dur, e->a0 = a0, e->a1 = a1, e->kind = kind;
+}
+
+void tr_span(int track, int kind, uint64_t t0, int64_t a0, int64_t a1)
+{
+    if (!tr_on) return;
+    uint64_t t1 = __rdtsc();
+    tr_put(track, kind, t0, t1 > t0? t1 - t0 : 1, a0, a1);
+}
+
+void tr_instant(int track, int kind, int64_t a0, int64_t a1)
+{
+    if (!tr_on) return;
+    tr_put(track, kind, __rdtsc(), 0, a0, a1);
+}
+
+int tr_dump(const char *fn)
+{
+    FILE *fp = fopen(fn, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "[E::%s] can't open %s for writing\n", __func__, fn);
+        return -1;
+    }
+
+    double us = 1e6 / proc_freq;
+    uint64_t dropped = 0;
+    fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (int i = 0; i < tr_ntracks; i++) {
+        if (i < tr_nthreads)
+            fprintf(fp, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                    "\"args\": {\"name\": \"compute %d\"}},\n", i, i);
+        else if (i < tr_nthreads + TR_N_PIPE)
+            fprintf(fp, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                    "\"args\": {\"name\": \"pipeline %d\"}},\n", i, i - tr_nthreads);
+        else
+            fprintf(fp, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                    "\"args\": {\"name\": \"main\"}},\n", i);
+    }
+    for (int i = 0; i < tr_ntracks; i++) {
+        const tr_track_t *t = &tr_tracks[i];
+        uint64_t first = t->n > TR_RING_EVENTS? t->n - TR_RING_EVENTS : 0;
+        dropped += first;
+        for (uint64_t k = first; k < t->n; k++) {
+            const tr_event_t *e = &t->ev[k & (TR_RING_EVENTS - 1)];
+            const char *arg1 = tr_kinds[e->kind].arg1;
+            fprintf(fp, "{\"name\": \"%s\", \"cat\": \"%s\", \"pid\": 1, \"tid\": %d, \"ts\": %0.3lf, ",
+                    tr_kinds[e->kind].name, tr_kinds[e->kind].cat, i, (e->ts - tr_t0) * us);
+            if (e->dur) fprintf(fp, "\"ph\": \"X\", \"dur\": %0.3lf, ", e->dur * us);
+            else fprintf(fp, "\"ph\": \"i\", \"s\": \"t\", ");
+            fprintf(fp, "\"args\": {\"%s\": %ld", tr_kinds[e->kind].arg0, (long) e->a0);
+            if (arg1) fprintf(fp, ", \"%s\": %ld", arg1, (long) e->a1);
+            fprintf(fp, "}},\n");
+        }
+    }
+    // a closing event keeps the list free of a trailing comma
+    fprintf(fp, "{\"name\": \"end\", \"ph\": \"i\", \"s\": \"g\", \"pid\": 1, \"tid\": %d, "
+            "\"ts\": %0.3lf}\n", tr_ntracks - 1, (__rdtsc() - tr_t0) * us);
+    fprintf(fp, "], \"otherData\": {\"dropped_events\": %lu}}\n", dropped);
+    fclose(fp);
+
+    if (dropped > 0)
+        fprintf(stderr, "[W::%s] %lu early events were overwritten; the trace starts later "
+                "on some threads\n", __func__, dropped);
+    return 0;
+}
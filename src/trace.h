@@ -0,0 +1,81 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+/*
+ * Timeline tracing of the mapping pipeline (mem --trace FILE).
+ *
+ * Every thread records spans into a ring buffer of its track: one track per
+ * compute thread (kt_for tid), one per pipeline worker and one for the main
+ * thread. A track has a single writer at any time, so recording is a store
+ * and an increment; when a ring is full the oldest events are overwritten.
+ * The buffers are written as Chrome trace-event JSON at the end of the run,
+ * which Perfetto and chrome://tracing open directly.
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+
+/* Event kinds; names and argument names are in trace.cpp */
+#define TR_STEP_READ      0     /* pipeline step 0: read a chunk */
+#define TR_STEP_COMPUTE   1     /* pipeline step 1: map a chunk */
+#define TR_STEP_WRITE     2     /* pipeline step 2: write SAM */
+#define TR_WAIT           3     /* pipeline worker waiting for its step */
+#define TR_KT_BWT         4     /* kt_for over all batches, per phase */
+#define TR_KT_ALN         5
+#define TR_KT_SAM         6
+#define TR_BWT            7     /* one kt_for batch */
+#define TR_ALN            8
+#define TR_SAM            9
+#define TR_REALLOC_PAIRS  10
+#define TR_REALLOC_SEQBUF 11
+#define TR_REALLOC_SMEM   12
+#define TR_REALLOC_CHAIN  13
+#define TR_KT_PAIR        14    /* kt_for_pair of worker_bwt and worker_aln */
+#define TR_NKIND          15
+
+#define TR_SELF   -1    /* track of the calling pipeline worker, or main */
+
+#define TR_RING_EVENTS (1 << 15)    /* per track, power of 2 */
+
+extern int tr_on;
+
+void tr_init(int nthreads);
+void tr_free();
+void tr_set_pipe(int i);    // the calling thread is pipeline worker i
+
+uint64_t tr_now();          // 0 when tracing is off
+void tr_span(int track, int kind, uint64_t t0, int64_t a0, int64_t a1);
+void tr_instant(int track, int kind, int64_t a0, int64_t a1);
+
+int tr_dump(const char *fn);
+
+#endif
@@ -0,0 +1,364 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+#include "fastmap.h"
+#include "tune.h"
+
+mem_tune_t mem_tune = { BATCH_SIZE, 20, MAX_SEQ_LEN8, SEEDS_PER_READ, 0 };
+
+/* Candidate values of bwa-mem2 tune; the defaults are among them */
+static const int tune_batch[] = { 128, 256, 512, 1024, 2048 };
+static const int tune_sal[] = { 8, 12, 16, 20, 24, 32, 48, 64 };
+static const int tune_len8[] = { 64, 96, 112, 128 };
+static const int tune_seeds[] = { 64, 125, 250, 500, 1000 };
+static const double tune_chunk[] = { 0.25, 0.5, 1, 2 };   // of the default chunk
+#define TUNE_N(a) ((int) (sizeof(a) / sizeof(a[0])))
+
+const char *tune_isa()
+{
+#if __AVX512BW__
+    return "AVX512BW";
+#elif __AVX2__
+    return "AVX2";
+#elif __AVX__
+    return "AVX";
+#elif __SSE4_1__
+    return "SSE4.1";
+#else
+    return "SSE2";
+#endif
+}
+
+static void tune_cpu(char *buf, int size)
+{
+    char line[256];
+    FILE *fp = fopen("/proc/cpuinfo", "r");
+    snprintf(buf, size, "unknown");
+    if (fp == NULL) return;
+    while (fgets(line, sizeof(line), fp)) {
+        char *p = strchr(line, ':');
+        if (strncmp(line, "model name", 10) != 0 || p == NULL) continue;
+        for (p++; *p == ' '; p++);
+        p[strcspn(p, "\n")] = 0;
+        snprintf(buf, size, "%s", p);
+        break;
+    }
+    fclose(fp);
+}
+
+int tune_read(const char *fn, mem_tune_t *t)
+{
+    char line[256], key[64], cpu[256];
+    long v;
+    mem_tune_t r = *t;
+    FILE *fp = fopen(fn, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "[E::%s] can't open %s\n", __func__, fn);
+        return -1;
+    }
+    if (fgets(line, sizeof(line), fp) == NULL || strncmp(line, TUNE_MAGIC, strlen(TUNE_MAGIC)) != 0) {
+        fprintf(stderr, "[E::%s] %s is not a tuning profile\n", __func__, fn);
+        fclose(fp);
+        return -1;
+    }
+    tune_cpu(cpu, sizeof(cpu));
+    for (int ln = 2; fgets(line, sizeof(line), fp); ln++) {
+        line[strcspn(line, "\n")] = 0;
+        if (strncmp(line, "# isa: ", 7) == 0 && strcmp(line + 7, tune_isa()) != 0)
+            fprintf(stderr, "[W::%s] %s was measured with the %s kernels; these are %s\n",
+                    __func__, fn, line + 7, tune_isa());
+        if (strncmp(line, "# cpu: ", 7) == 0 && strcmp(line + 7, cpu) != 0)
+            fprintf(stderr, "[W::%s] %s was measured on %s; this is %s\n", __func__, fn,
+                    line + 7, cpu);
+        if (line[0] == '#' || line[0] == 0) continue;
+        if (sscanf(line, "%63s %ld", key, &v) != 2) {
+            fprintf(stderr, "[E::%s] %s, line %d: expected a name and a value\n", __func__, fn, ln);
+            fclose(fp);
+            return -1;
+        }
+        int ok = 1;
+        if (strcmp(key, "batch") == 0) ok = v >= KT_MIN_GRAIN && v <= (1 << 16) && v % 2 == 0, r.batch = v;
+        else if (strcmp(key, "sal_batch") == 0) ok = v >= 1 && v <= TUNE_SAL_MAX, r.sal_batch = v;
+        else if (strcmp(key, "len8") == 0) ok = v >= 1 && v <= MAX_SEQ_LEN8, r.len8 = v;
+        else if (strcmp(key, "seeds_per_read") == 0) ok = v >= 1 && v <= 1 << 16, r.seeds_per_read = v;
+        else if (strcmp(key, "chunk") == 0) ok = v >= 0, r.chunk = v;
+        else fprintf(stderr, "[W::%s] %s, line %d: unknown parameter %s ignored\n", __func__, fn, ln, key);
+        if (!ok) {
+            fprintf(stderr, "[E::%s] %s, line %d: %s %ld is out of range\n", __func__, fn, ln, key, v);
+            fclose(fp);
+            return -1;
+        }
+    }
+    fclose(fp);
+    *t = r;
+    return 0;
+}
+
+int tune_write(const char *fn, const mem_tune_t *t, int nthreads)
+{
+    char cpu[256];
+    FILE *fp = fopen(fn, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "[E::%s] can't open %s for writing\n", __func__, fn);
+        return -1;
+    }
+    tune_cpu(cpu, sizeof(cpu));
+    fprintf(fp, "%s\n# cpu: %s\n# isa: %s\n# threads: %d\n", TUNE_MAGIC, cpu, tune_isa(), nthreads);
+    fprintf(fp, "batch\t%d\nsal_batch\t%d\nlen8\t%d\nseeds_per_read\t%d\n", t->batch, t->sal_batch,
+            t->len8, t->seeds_per_read);
+    if (t->chunk > 0) fprintf(fp, "chunk\t%ld\n", (long) t->chunk);
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "[E::%s] error writing %s\n", __func__, fn);
+        return -1;
+    }
+    return 0;
+}
+
+/* Maps the sample in chunks of chunk bases per thread; returns the wall
+   seconds and sets *sum to a checksum of the SAM records */
+static double tune_map(mem_opt_t *opt, worker_t &w, bseq1_t *seqs, int n, int64_t chunk,
+                       uint64_t *sum)
+{
+    int64_t size = chunk * w.nthreads, n_processed = 0;
+    int step = opt->flag & MEM_F_PE? 2 : 1;
+    uint64_t h = 0xcbf29ce484222325ULL, tim = __rdtsc();
+    for (int i = 0; i < n; ) {
+        int k = 0;
+        for (int64_t bp = 0; i + k < n && bp < size; k += step)
+            for (int j = 0; j < step; j++) bp += seqs[i + k + j].l_seq;
+        mem_process_seqs(opt, n_processed, k, seqs + i, NULL, w);
+        n_processed += k;
+        i += k;
+    }
+    double wall = (double) (__rdtsc() - tim) / proc_freq;
+    for (int i = 0; i < n; i++) {
+        for (const char *p = seqs[i].sam; p && *p; p++)
+            h = (h ^ (uint8_t) *p) * 0x100000001b3ULL;
+        free(seqs[i].sam);
+        seqs[i].sam = NULL;
+    }
+    *sum = h;
+    return wall;
+}
+
+/* Fastest of runs mappings with the values of mem_tune */
+static double tune_time(mem_opt_t *opt, worker_t &w, bseq1_t *seqs, int n, int runs, uint64_t *sum)
+{
+    double best = 0;
+    int64_t chunk = mem_tune.chunk > 0? mem_tune.chunk : opt->chunk_size;
+    for (int r = 0; r < runs; r++) {
+        double t = tune_map(opt, w, seqs, n, chunk, sum);
+        if (r == 0 || t < best) best = t;
+    }
+    return best;
+}
+
+/* Tries each value of one parameter in turn and keeps the fastest that maps
+   the sample as the defaults do; *best is the time of the values kept */
+static void tune_sweep(const char *name, int *p, const int *cand, int n_cand, mem_opt_t *opt,
+                       worker_t &w, bseq1_t *seqs, int n, int runs, uint64_t sum0, double *best)
+{
+    int keep = *p;
+    uint64_t sum;
+    *best = tune_time(opt, w, seqs, n, runs, &sum);   // again, as the caches have warmed up
+    for (int k = 0; k < n_cand; k++) {
+        if (cand[k] == keep) continue;
+        *p = cand[k];
+        double t = tune_time(opt, w, seqs, n, runs, &sum);
+        fprintf(stderr, "[M::tune] %s %d: %0.3lf s%s\n", name, cand[k], t,
+                sum != sum0? ", output differs; rejected" : "");
+        if (sum == sum0 && t < *best * (1 - TUNE_GAIN)) *best = t, keep = cand[k];
+    }
+    *p = keep;
+    fprintf(stderr, "[M::tune] %s = %d\n", name, keep);
+}
+
+static void usage_tune()
+{
+    fprintf(stderr, "Usage: bwa-mem2 tune [options] <idxbase> <in1.fq> [in2.fq]\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "   -o FILE       write the profile to FILE (required)\n");
+    fprintf(stderr, "   -t INT        number of threads, as mem will use [1]\n");
+    fprintf(stderr, "   -s INT        bases of the sample read from the start of the input [5000000]\n");
+    fprintf(stderr, "   -r INT        timed runs per value; the fastest counts [2]\n");
+    fprintf(stderr, "Maps the sample with the default mem options once per value of batch, sal_batch,\n");
+    fprintf(stderr, "len8 and seeds_per_read (and chunk for single-end reads, if the sample holds two\n");
+    fprintf(stderr, "default chunks), keeps the fastest whose output is unchanged and writes them for\n");
+    fprintf(stderr, "mem --tune-profile.\n");
+}
+
+int main_tune(int argc, char *argv[])
+{
+    int c, nthreads = 1, runs = 2, n;
+    int64_t sample = 5000000;
+    const char *out = NULL;
+
+    while ((c = getopt(argc, argv, "o:t:s:r:")) >= 0) {
+        if (c == 'o') out = optarg;
+        else if (c == 't') nthreads = atoi(optarg);
+        else if (c == 's') sample = atol(optarg);
+        else if (c == 'r') runs = atoi(optarg);
+        else {
+            usage_tune();
+            return 1;
+        }
+    }
+    if (out == NULL || optind + 2 > argc || optind + 3 < argc || nthreads < 1 || runs < 1 ||
+        sample < 1) {
+        usage_tune();
+        return 1;
+    }
+
+    /* The sample: reads (pairs interleaved) up to sample bases */
+    int fd, fd2;
+    void *ko = kopen(argv[optind + 1], &fd), *ko2 = NULL;
+    if (ko == 0) {
+        fprintf(stderr, "[E::%s] fail to open file `%s'.\n", __func__, argv[optind + 1]);
+        return 1;
+    }
+    gzFile fp = gzdopen(fd, "r"), fp2 = 0;
+    kseq_t *ks = kseq_init(fp), *ks2 = NULL;
+    if (optind + 2 < argc) {
+        if ((ko2 = kopen(argv[optind + 2], &fd2)) == 0) {
+            fprintf(stderr, "[E::%s] failed to open file `%s'.\n", __func__, argv[optind + 2]);
+            kseq_destroy(ks); err_gzclose(fp); kclose(ko);
+            return 1;
+        }
+        fp2 = gzdopen(fd2, "r");
+        ks2 = kseq_init(fp2);
+    }
+    int64_t bp = 0;
+    bseq1_t *seqs = bseq_read_orig(sample, &n, ks, ks2, &bp);
+    kseq_destroy(ks); err_gzclose(fp); kclose(ko);
+    if (ks2) { kseq_destroy(ks2); err_gzclose(fp2); kclose(ko2); }
+    if (seqs == NULL || n == 0) {
+        fprintf(stderr, "[E::%s] no reads in %s\n", __func__, argv[optind + 1]);
+        free(seqs);
+        return 1;
+    }
+    bp = 0;
+    for (int i = 0; i < n; i++) bp += seqs[i].l_seq;
+
+    /* Index and the 2-bit reference, as in mem */
+    FMI_search *fmi = new FMI_search(argv[optind]);
+    fmi->load_index();
+    char fn[PATH_MAX];
+    snprintf(fn, PATH_MAX, "%s.0123", argv[optind]);
+    FILE *fr = fopen(fn, "r");
+    if (fr == NULL) {
+        fprintf(stderr, "Error: can't open %s input file\n", fn);
+        delete fmi;
+        return 1;
+    }
+    fseek(fr, 0, SEEK_END);
+    int64_t rlen = ftell(fr);
+    rewind(fr);
+    uint8_t *ref_string = (uint8_t *) _mm_malloc(rlen, 64);
+    assert(ref_string != NULL);
+    err_fread_noeof(ref_string, 1, rlen, fr);
+    fclose(fr);
+
+    mem_opt_t *opt = mem_opt_init();
+    opt->n_threads = nthreads;
+    if (ks2) opt->flag |= MEM_F_PE;
+    bwa_fill_scmat(opt->a, opt->b, opt->mat);
+
+    worker_t w;
+    memset(&w, 0, sizeof(worker_t));
+    w.nthreads = nthreads;
+    w.fmi = fmi;
+    w.ref_string = ref_string;
+
+    /* Buffers for the largest batch tried; the kernels grow what else they need */
+    mem_plan_t plan;
+    msz_plan(&plan, n, bp, opt->w);
+    mem_tune.batch = tune_batch[TUNE_N(tune_batch) - 1];
+    memoryAlloc(NULL, w, &plan, nthreads);
+    mem_tune.batch = BATCH_SIZE;
+    thprof_alloc(nthreads);
+
+    fprintf(stderr, "[M::%s] %d %s reads, %ld bp; %d threads, %s\n", __func__, n,
+            ks2? "paired" : "single", (long) bp, nthreads, tune_isa());
+    uint64_t sum0, sum;
+    tune_map(opt, w, seqs, n, opt->chunk_size, &sum0);  // warm-up
+    memoryRefit(w, nthreads);
+    double best = tune_time(opt, w, seqs, n, runs, &sum0);
+    fprintf(stderr, "[M::tune] defaults: %0.3lf s\n", best);
+
+    tune_sweep("sal_batch", &mem_tune.sal_batch, tune_sal, TUNE_N(tune_sal), opt, w, seqs, n,
+               runs, sum0, &best);
+    tune_sweep("batch", &mem_tune.batch, tune_batch, TUNE_N(tune_batch), opt, w, seqs, n, runs,
+               sum0, &best);
+    tune_sweep("len8", &mem_tune.len8, tune_len8, TUNE_N(tune_len8), opt, w, seqs, n, runs,
+               sum0, &best);
+    tune_sweep("seeds_per_read", &mem_tune.seeds_per_read, tune_seeds, TUNE_N(tune_seeds), opt, w,
+               seqs, n, runs, sum0, &best);
+
+    /* Insert sizes are inferred per chunk, so chunks change paired-end output */
+    if (ks2)
+        fprintf(stderr, "[M::tune] chunk not tuned: it changes the output of paired-end reads\n");
+    else if (bp < 2 * opt->chunk_size * nthreads)
+        fprintf(stderr, "[M::tune] chunk not tuned: the sample holds less than two chunks; "
+                "use -s %ld or more\n", (long) (2 * opt->chunk_size * nthreads));
+    else {
+        int64_t keep = 0;
+        best = tune_time(opt, w, seqs, n, runs, &sum);
+        for (int k = 0; k < TUNE_N(tune_chunk); k++) {
+            int64_t chunk = (int64_t) (tune_chunk[k] * opt->chunk_size);
+            if (chunk == opt->chunk_size) continue;
+            mem_tune.chunk = chunk;
+            double t = tune_time(opt, w, seqs, n, runs, &sum);
+            fprintf(stderr, "[M::tune] chunk %ld: %0.3lf s%s\n", (long) chunk, t,
+                    sum != sum0? ", output differs; rejected" : "");
+            if (sum == sum0 && t < best * (1 - TUNE_GAIN)) best = t, keep = chunk;
+        }
+        mem_tune.chunk = keep;
+        fprintf(stderr, "[M::tune] chunk = %ld\n", (long) (keep? keep : opt->chunk_size));
+    }
+    fprintf(stderr, "[M::%s] tuned: %0.3lf s\n", __func__, best);
+
+    int ret = tune_write(out, &mem_tune, nthreads) == 0? 0 : 1;
+
+    thprof_free();
+    memoryFree(w, nthreads);
+    for (int i = 0; i < n; i++) {
+        free(seqs[i].name); free(seqs[i].comment); free(seqs[i].seq); free(seqs[i].qual);
+    }
+    free(seqs);
+    free(opt);
+    _mm_free(ref_string);
+    delete fmi;
+    return ret;
+}
@@ -0,0 +1,76 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+/*
+ * Machine-tuned parameters of the mapping kernels (bwa-mem2 tune, mem
+ * --tune-profile).
+ *
+ * The reads per work unit of a thread (BATCH_SIZE), the depth of the SAL
+ * prefetcher, the score and length below which extensions take the 8-bit
+ * BSW kernel (MAX_SEQ_LEN8), the initial seed slots per read of chaining
+ * (SEEDS_PER_READ) and the chunk size are read from mem_tune, which holds
+ * these defaults unless a profile is loaded. The buffers those constants
+ * size at compile time stay sized for their largest value, so a profile can
+ * only lower len8 and sal_batch is capped at TUNE_SAL_MAX.
+ *
+ * bwa-mem2 tune maps a sample of the user's reads against their index with
+ * each candidate value, one parameter at a time, keeps the fastest whose SAM
+ * output equals that of the defaults, and writes the result as a profile:
+ * a magic line, comments naming the CPU, ISA and threads it was measured
+ * on, and "name<TAB>value" lines.
+ */
+
+#ifndef _TUNE_H
+#define _TUNE_H
+
+#include <stdint.h>
+
+#define TUNE_MAGIC    "#bwa-mem2-tune"
+#define TUNE_SAL_MAX  64      /* largest sal_batch; sizes the SAL stack arrays */
+#define TUNE_GAIN     0.02    /* a candidate must be this much faster to be kept */
+
+typedef struct {
+    int batch;            // reads per work unit of a thread; even
+    int sal_batch;        // SA lookups in flight in get_sa_entries_prefetch
+    int len8;             // 8-bit BSW below this score and length; <= MAX_SEQ_LEN8
+    int seeds_per_read;   // initial seed sort slots per read of chaining
+    int64_t chunk;        // bases per thread of a chunk; 0: the default (-K overrides)
+} mem_tune_t;
+
+extern mem_tune_t mem_tune;
+
+/* The compiled ISA, as in the profile */
+const char *tune_isa();
+
+/* Profile fn into t, keeping the values it does not set; return 0 on success */
+int tune_read(const char *fn, mem_tune_t *t);
+int tune_write(const char *fn, const mem_tune_t *t, int nthreads);
+
+#endif
@@ -0,0 +1,482 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM2  (Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2019  Intel Corporation, Heng Li.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
+*****************************************************************************************/
+
+
+/*
+ * Kernel microbenchmarks, built with "make bench" against the objects of
+ * bwa-mem2 itself.
+ *
+ *   kbench record <out.kd> <idxbase> <in1.fq> [in2.fq]
+ *       maps the reads on one thread and dumps the inputs of the BSW and kswv
+ *       kernels and of mem_aln2sam to out.kd (see mem_kdump in bwamem.h)
+ *   kbench bsw <in.kd>            BandedPairWiseSW::getScores8/16
+ *   kbench kswv <in.kd>           kswv::getScores8/16 (AVX512BW builds)
+ *   kbench smem <idxbase> <in.fq> FMI_search::getSMEMsAllPosOneThread
+ *   kbench sal <idxbase> <in.fq>  FMI_search::get_sa_entries_prefetch
+ *   kbench sam <idxbase> <in.kd>  mem_aln2sam
+ *
+ * Every input is replayed -r times and the fastest replay of each batch is
+ * kept. Output is tab-separated: kernel, operations, DP cells (pairs of
+ * sequence positions; 0 for the FM-index and SAM kernels), seconds, TSC
+ * cycles per cell and ns per operation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <immintrin.h>
+#include "bwamem.h"
+#include "kswv.h"
+
+int main_mem(int argc, char *argv[]);
+
+static int runs = 3;
+
+typedef struct {
+    int32_t hdr[KD_PAIR_HDR];
+    SeqPair *pairs;
+    uint8_t *ref, *qer;
+} kd_pairs_t;
+
+typedef struct {
+    const char *name;
+    int64_t ops, cells;
+    uint64_t ticks;
+} kb_stat_t;
+
+static void kb_print_header()
+{
+    printf("kernel\tops\tcells\tsec\tcycles_per_cell\tns_per_op\n");
+}
+
+static void kb_print(const kb_stat_t *s)
+{
+    double sec = (double) s->ticks / proc_freq;
+    printf("%s\t%ld\t%ld\t%0.6lf\t", s->name, (long) s->ops, (long) s->cells, sec);
+    if (s->cells > 0) printf("%0.3lf", (double) s->ticks / s->cells);
+    else printf("-");
+    printf("\t%0.1lf\n", s->ops > 0? sec * 1e9 / s->ops : 0.0);
+}
+
+/* Next pair record of the given kinds; sam records are skipped. Returns 0 at
+   the end of the dump. */
+static int kd_read_pairs(FILE *fp, int kind0, int kind1, kd_pairs_t *r)
+{
+    int32_t tag;
+    while (fread(&tag, sizeof(int32_t), 1, fp) == 1) {
+        if (tag == KD_SAM) {
+            int32_t h[4];
+            err_fread_noeof(h, sizeof(int32_t), 4, fp);
+            fseek(fp, (int64_t) h[2] + h[1] + (h[3]? h[1] : 0), SEEK_CUR);
+            for (int k = 0; k < h[0]; k++) {
+                mem_aln_t a;
+                int32_t l_XA;
+                err_fread_noeof(&a, sizeof(mem_aln_t), 1, fp);
+                fseek(fp, (int64_t) a.n_cigar * sizeof(uint32_t), SEEK_CUR);
+                err_fread_noeof(&l_XA, sizeof(int32_t), 1, fp);
+                if (l_XA > 0) fseek(fp, l_XA, SEEK_CUR);
+            }
+            continue;
+        }
+        r->hdr[0] = tag;
+        err_fread_noeof(r->hdr + 1, sizeof(int32_t), KD_PAIR_HDR - 1, fp);
+        int n = r->hdr[3], l_ref = r->hdr[4], l_qer = r->hdr[5];
+        if (tag != kind0 && tag != kind1) {
+            fseek(fp, (int64_t) n * sizeof(SeqPair) + l_ref + l_qer, SEEK_CUR);
+            continue;
+        }
+        // the kernels pad the pair array to a multiple of the vector width
+        r->pairs = (SeqPair *) _mm_malloc((n + MAX_LINE_LEN) * sizeof(SeqPair), 64);
+        r->ref = (uint8_t *) _mm_malloc(l_ref + MAX_LINE_LEN, 64);
+        r->qer = (uint8_t *) _mm_malloc(l_qer + MAX_LINE_LEN, 64);
+        assert(r->pairs != NULL && r->ref != NULL && r->qer != NULL);
+        err_fread_noeof(r->pairs, sizeof(SeqPair), n, fp);
+        for (int i = n; i < n + MAX_LINE_LEN; i++)     // padding lanes point at real sequences
+            r->pairs[i] = r->pairs[n - 1];
+        err_fread_noeof(r->ref, 1, l_ref, fp);
+        err_fread_noeof(r->qer, 1, l_qer, fp);
+        return 1;
+    }
+    return 0;
+}
+
+static void kd_free_pairs(kd_pairs_t *r)
+{
+    _mm_free(r->pairs);
+    _mm_free(r->ref);
+    _mm_free(r->qer);
+}
+
+static int64_t kd_cells(const kd_pairs_t *r)
+{
+    int64_t cells = 0;
+    for (int i = 0; i < r->hdr[3]; i++)
+        cells += (int64_t) r->pairs[i].len1 * r->pairs[i].len2;
+    return cells;
+}
+
+static FILE *kb_open(const char *fn)
+{
+    FILE *fp = fopen(fn, "rb");
+    if (fp == NULL) fprintf(stderr, "[E::%s] can't open %s\n", __func__, fn);
+    return fp;
+}
+
+static int kb_bsw(const char *fn)
+{
+#if __SSE2__
+    FILE *fp = kb_open(fn);
+    if (fp == NULL) return 1;
+
+    kb_stat_t st[2] = { { "bsw8", 0, 0, 0 }, { "bsw16", 0, 0, 0 } };
+    kd_pairs_t r;
+    int8_t mat[25];
+    while (kd_read_pairs(fp, KD_BSW8, KD_BSW16, &r)) {
+        int32_t *h = r.hdr, n = h[3];
+        bwa_fill_scmat(h[10], h[11], mat);
+        BandedPairWiseSW bsw(h[6], h[7], h[8], h[9], h[12], h[2], mat, h[10], h[11], 1);
+        SeqPair *work = (SeqPair *) _mm_malloc((n + MAX_LINE_LEN) * sizeof(SeqPair), 64);
+        assert(work != NULL);
+        uint64_t best = UINT64_MAX;
+        for (int k = 0; k < runs; k++) {
+            memcpy(work, r.pairs, (n + MAX_LINE_LEN) * sizeof(SeqPair));  // scored in place
+            uint64_t tim = __rdtsc();
+            if (h[0] == KD_BSW8) bsw.getScores8(work, r.ref, r.qer, n, 1, h[1]);
+            else bsw.getScores16(work, r.ref, r.qer, n, 1, h[1]);
+            tim = __rdtsc() - tim;
+            if (tim < best) best = tim;
+        }
+        kb_stat_t *s = &st[h[0] == KD_BSW16];
+        s->ops += n, s->cells += kd_cells(&r), s->ticks += best;
+        _mm_free(work);
+        kd_free_pairs(&r);
+    }
+    fclose(fp);
+    kb_print_header();
+    kb_print(&st[0]);
+    kb_print(&st[1]);
+    return 0;
+#else
+    fprintf(stderr, "[E::%s] the vector BSW kernels need an SSE2 or later build\n", __func__);
+    return 1;
+#endif
+}
+
+static int kb_kswv(const char *fn)
+{
+#if __AVX512BW__
+    FILE *fp = kb_open(fn);
+    if (fp == NULL) return 1;
+
+    kb_stat_t st[2] = { { "kswv8", 0, 0, 0 }, { "kswv16", 0, 0, 0 } };
+    kd_pairs_t r;
+    while (kd_read_pairs(fp, KD_KSWV8, KD_KSWV16, &r)) {
+        int32_t *h = r.hdr, n = h[3];
+        int max_ref = 0, max_qer = 0, max_id = n;
+        for (int i = 0; i < n; i++) {
+            if (r.pairs[i].len1 > max_ref) max_ref = r.pairs[i].len1;
+            if (r.pairs[i].len2 > max_qer) max_qer = r.pairs[i].len2;
+            if (r.pairs[i].regid >= max_id) max_id = r.pairs[i].regid + 1;
+        }
+        kswv ksw(h[6], h[7], h[8], h[9], h[10], -h[11], 1, max_ref, max_qer);
+        SeqPair *work = (SeqPair *) _mm_malloc((n + MAX_LINE_LEN) * sizeof(SeqPair), 64);
+        // results are indexed by regid; padding lanes use their own index
+        kswr_t *aln = (kswr_t *) calloc(max_id + MAX_LINE_LEN, sizeof(kswr_t));
+        assert(work != NULL && aln != NULL);
+        uint64_t best = UINT64_MAX;
+        for (int k = 0; k < runs; k++) {
+            memcpy(work, r.pairs, (n + MAX_LINE_LEN) * sizeof(SeqPair));
+            uint64_t tim = __rdtsc();
+            if (h[0] == KD_KSWV8) ksw.getScores8(work, r.ref, r.qer, aln, n, 1, h[1]);
+            else ksw.getScores16(work, r.ref, r.qer, aln, n, 1, h[1]);
+            tim = __rdtsc() - tim;
+            if (tim < best) best = tim;
+        }
+        kb_stat_t *s = &st[h[0] == KD_KSWV16];
+        s->ops += n, s->cells += kd_cells(&r), s->ticks += best;
+        free(aln);
+        _mm_free(work);
+        kd_free_pairs(&r);
+    }
+    fclose(fp);
+    kb_print_header();
+    kb_print(&st[0]);
+    kb_print(&st[1]);
+    return 0;
+#else
+    fprintf(stderr, "[E::%s] kswv is only built for AVX512BW\n", __func__);
+    return 1;
+#endif
+}
+
+/* Reads in 2-bit encoding, as the pipeline hands them to the kernels */
+static bseq1_t *kb_load_reads(const char *fn, int *n)
+{
+    gzFile fp = gzopen(fn, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "[E::%s] can't open %s\n", __func__, fn);
+        return NULL;
+    }
+    int64_t sz;
+    bseq1_t *seqs = bseq_read_one_fasta_file(INT64_MAX, n, fp, &sz);
+    gzclose(fp);
+    for (int i = 0; i < *n; i++)
+        for (int j = 0; j < seqs[i].l_seq; j++) {
+            char c = seqs[i].seq[j];
+            seqs[i].seq[j] = c < 4? c : nst_nt4_table[(int) c];
+        }
+    return seqs;
+}
+
+static void kb_free_reads(bseq1_t *seqs, int n)
+{
+    for (int i = 0; i < n; i++) {
+        free(seqs[i].name); free(seqs[i].comment); free(seqs[i].seq); free(seqs[i].qual);
+    }
+    free(seqs);
+}
+
+/* SMEM and SAL kernels on batches of BATCH_SIZE reads, as worker_bwt does */
+static int kb_fmi(const char *idx, const char *fn, int sal)
+{
+    int n;
+    bseq1_t *seqs = kb_load_reads(fn, &n);
+    if (seqs == NULL) return 1;
+    if (n == 0) {
+        fprintf(stderr, "[E::%s] no reads in %s\n", __func__, fn);
+        free(seqs);
+        return 1;
+    }
+
+    FMI_search *fmi = new FMI_search(idx);
+    fmi->load_index();
+    mem_opt_t *opt = mem_opt_init();
+
+    int max_len = 0;
+    for (int i = 0; i < n; i++)
+        if (seqs[i].l_seq > max_len) max_len = seqs[i].l_seq;
+    int64_t n_mem = (int64_t) N_SMEM_KERNEL * BATCH_SIZE * (max_len + 1) * 2;
+    SMEM *mem = (SMEM *) _mm_malloc(n_mem * sizeof(SMEM), 64);
+    uint8_t *enc_qdb = (uint8_t *) _mm_malloc((int64_t) BATCH_SIZE * max_len, 64);
+    int32_t *min_intv = (int32_t *) _mm_malloc(n_mem * sizeof(int32_t), 64);
+    int32_t *rid = (int32_t *) _mm_malloc(n_mem * sizeof(int32_t), 64);
+    int16_t *qpos = (int16_t *) _mm_malloc(n_mem * sizeof(int16_t), 64);
+    int32_t *cum_len = (int32_t *) _mm_malloc(BATCH_SIZE * sizeof(int32_t), 64);
+    int64_t *coord = NULL, m_coord = 0;
+    assert(mem != NULL && enc_qdb != NULL && min_intv != NULL && rid != NULL);
+    assert(qpos != NULL && cum_len != NULL);
+
+    kb_stat_t st = { sal? "sal" : "smem", 0, 0, 0 };
+    for (int b = 0; b < n; b += BATCH_SIZE) {
+        int nseq = n - b < BATCH_SIZE? n - b : BATCH_SIZE;
+        bseq1_t *s = seqs + b;
+        uint64_t best = UINT64_MAX;
+        int64_t ops = 0;
+
+        if (!sal) {
+            int off = 0;
+            for (int l = 0; l < nseq; l++) {
+                memcpy(enc_qdb + off, s[l].seq, s[l].l_seq);
+                cum_len[l] = off;
+                off += s[l].l_seq;
+            }
+            for (int k = 0; k < runs; k++) {
+                for (int l = 0; l < nseq; l++) min_intv[l] = 1, rid[l] = l;
+                int64_t num = 0;
+                uint64_t tim = __rdtsc();
+                fmi->getSMEMsAllPosOneThread(enc_qdb, min_intv, rid, nseq, nseq, s, cum_len,
+                                             max_len, opt->min_seed_len, mem, &num);
+                tim = __rdtsc() - tim;
+                if (tim < best) best = tim;
+            }
+            ops = nseq;
+        } else {
+            int64_t num = 0;
+            mem_collect_smem(fmi, opt, s, nseq, mem, min_intv, qpos, enc_qdb, rid, num);
+            if (num * opt->max_occ > m_coord) {
+                m_coord = num * opt->max_occ;
+                _mm_free(coord);
+                coord = (int64_t *) _mm_malloc(m_coord * sizeof(int64_t), 64);
+                assert(coord != NULL);
+            }
+            for (int k = 0; k < runs; k++) {
+                // one call per read, as mem_chain_seeds does
+                int64_t cnt = 0, id = 0;
+                uint64_t tim = __rdtsc();
+                for (int64_t i = 0, j; i < num; i = j) {
+                    for (j = i + 1; j < num && mem[j].rid == mem[i].rid; j++);
+                    fmi->get_sa_entries_prefetch(&mem[i], coord, &cnt, j - i, opt->max_occ, 0, id);
+                }
+                tim = __rdtsc() - tim;
+                if (tim < best) best = tim;
+                ops = cnt;
+            }
+        }
+        st.ops += ops, st.ticks += best;
+    }
+    kb_print_header();
+    kb_print(&st);
+
+    _mm_free(mem); _mm_free(enc_qdb); _mm_free(min_intv); _mm_free(rid);
+    _mm_free(qpos); _mm_free(cum_len); _mm_free(coord);
+    free(opt);
+    delete fmi;
+    kb_free_reads(seqs, n);
+    return 0;
+}
+
+static int kb_sam(const char *idx, const char *fn)
+{
+    FILE *fp = kb_open(fn);
+    if (fp == NULL) return 1;
+    bntseq_t *bns = bns_restore(idx);
+    mem_opt_t *opt = mem_opt_init();
+    kstring_t str = { 0, 0, 0 };
+    kb_stat_t st = { "sam", 0, 0, 0 };
+
+    int32_t tag;
+    while (fread(&tag, sizeof(int32_t), 1, fp) == 1) {
+        if (tag != KD_SAM) {
+            int32_t h[KD_PAIR_HDR - 1];
+            err_fread_noeof(h, sizeof(int32_t), KD_PAIR_HDR - 1, fp);
+            fseek(fp, (int64_t) h[2] * sizeof(SeqPair) + h[3] + h[4], SEEK_CUR);
+            continue;
+        }
+        int32_t h[4];
+        err_fread_noeof(h, sizeof(int32_t), 4, fp);
+        int n = h[0];
+        bseq1_t s;
+        memset(&s, 0, sizeof(bseq1_t));
+        s.l_seq = h[1];
+        s.name = (char *) calloc(h[2] + 1, 1);
+        s.seq = (char *) malloc(s.l_seq);
+        err_fread_noeof(s.name, 1, h[2], fp);
+        err_fread_noeof(s.seq, 1, s.l_seq, fp);
+        if (h[3]) {
+            s.qual = (char *) calloc(s.l_seq + 1, 1);
+            err_fread_noeof(s.qual, 1, s.l_seq, fp);
+        }
+        mem_aln_t *list = (mem_aln_t *) malloc(n * sizeof(mem_aln_t));
+        for (int k = 0; k < n; k++) {
+            int32_t l_XA;
+            err_fread_noeof(&list[k], sizeof(mem_aln_t), 1, fp);
+            list[k].cigar = (uint32_t *) malloc((list[k].n_cigar + 1) * sizeof(uint32_t));
+            err_fread_noeof(list[k].cigar, sizeof(uint32_t), list[k].n_cigar, fp);
+            err_fread_noeof(&l_XA, sizeof(int32_t), 1, fp);
+            list[k].XA = NULL;
+            if (l_XA >= 0) {
+                list[k].XA = (char *) calloc(l_XA + 1, 1);
+                err_fread_noeof(list[k].XA, 1, l_XA, fp);
+            }
+        }
+
+        uint64_t best = UINT64_MAX;
+        for (int r = 0; r < runs; r++) {
+            str.l = 0;
+            uint64_t tim = __rdtsc();
+            for (int k = 0; k < n; k++)
+                mem_aln2sam(opt, bns, &str, &s, n, list, k, 0);
+            tim = __rdtsc() - tim;
+            if (tim < best) best = tim;
+        }
+        st.ops += n, st.ticks += best;
+
+        for (int k = 0; k < n; k++) {
+            free(list[k].cigar);
+            free(list[k].XA);
+        }
+        free(list);
+        free(s.name); free(s.seq); free(s.qual);
+    }
+    kb_print_header();
+    kb_print(&st);
+
+    free(str.s);
+    free(opt);
+    bns_destroy(bns);
+    fclose(fp);
+    return 0;
+}
+
+/* Maps the reads through the regular mem pipeline with the dump open */
+static int kb_record(int argc, char *argv[])
+{
+    mem_kdump = fopen(argv[0], "wb");
+    if (mem_kdump == NULL) {
+        fprintf(stderr, "[E::%s] can't create %s\n", __func__, argv[0]);
+        return 1;
+    }
+    char *av[8] = { (char *) "mem", (char *) "-t1", (char *) "-o", (char *) "/dev/null" };
+    int ac = 4;
+    for (int i = 1; i < argc; i++) av[ac++] = argv[i];
+    optind = 1;
+    tprof[MEM][0] = __rdtsc();
+    int ret = main_mem(ac, av);
+    if (fclose(mem_kdump) != 0) ret = 1;
+    mem_kdump = NULL;
+    return ret;
+}
+
+static int usage()
+{
+    fprintf(stderr, "Usage: kbench [-r INT] <command> <arguments>\n");
+    fprintf(stderr, "Commands:\n");
+    fprintf(stderr, "  record <out.kd> <idxbase> <in1.fq> [in2.fq]   dump kernel inputs of a mapping run\n");
+    fprintf(stderr, "  bsw <in.kd>                    banded SW, getScores8/16\n");
+    fprintf(stderr, "  kswv <in.kd>                   mate-rescue SW, kswv getScores8/16\n");
+    fprintf(stderr, "  smem <idxbase> <in.fq>         getSMEMsAllPosOneThread\n");
+    fprintf(stderr, "  sal <idxbase> <in.fq>          get_sa_entries_prefetch\n");
+    fprintf(stderr, "  sam <idxbase> <in.kd>          mem_aln2sam\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -r INT    replays of each batch; the fastest is kept [%d]\n", runs);
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    int c;
+    while ((c = getopt(argc, argv, "+r:")) >= 0) {
+        if (c == 'r') runs = atoi(optarg);
+        else return usage();
+    }
+    argc -= optind, argv += optind;
+    if (argc < 2 || runs < 1) return usage();
+
+    proc_freq = tsc_freq();
+    const char *cmd = argv[0];
+    if (strcmp(cmd, "record") == 0 && (argc == 4 || argc == 5)) return kb_record(argc - 1, argv + 1);
+    if (strcmp(cmd, "bsw") == 0 && argc == 2) return kb_bsw(argv[1]);
+    if (strcmp(cmd, "kswv") == 0 && argc == 2) return kb_kswv(argv[1]);
+    if (strcmp(cmd, "smem") == 0 && argc == 3) return kb_fmi(argv[1], argv[2], 0);
+    if (strcmp(cmd, "sal") == 0 && argc == 3) return kb_fmi(argv[1], argv[2], 1);
+    if (strcmp(cmd, "sam") == 0 && argc == 3) return kb_sam(argv[1], argv[2]);
+    return usage();
+}
@@ -0,0 +1,195 @@
+#!/bin/bash
+# Throughput regression check of a bwa-mem2 build ("make perf-regress").
+#
+# Maps the pinned datasets of test/perf/datasets with each requested ISA
+# image and records, from the fastest of -r runs: wall time, the phase
+# times of --metrics-json, the kernel CPU times summed over threads, peak
+# RSS and the MD5 of the SAM output (without @PG). The results are compared
+# with the baseline using the tolerances in test/perf/tolerances, or stored
+# as the new baseline with -u ("make perf-baseline").
+
+dir=$(cd "$(dirname "$0")" && pwd)
+baseline=$dir/baseline.tsv
+datasets=$dir/datasets
+tolerances=$dir/tolerances
+work=$dir/work
+isas=native
+runs=3
+update=0
+
+usage() {
+    cat >&2 <<EOF
+Usage: regress.sh [options] <bwa-mem2>
+Options:
+   -b FILE   baseline [$baseline]
+   -u        store the results as the baseline instead of comparing
+   -d FILE   datasets [$datasets]
+   -T FILE   tolerances [$tolerances]
+   -s LIST   comma-separated ISA images of a dispatching build (avx512bw, avx2,
+             avx, sse42, sse2); "native" runs the binary as it is [$isas]
+   -r INT    runs per dataset and ISA; the fastest is kept [$runs]
+   -w DIR    work directory for data and outputs [$work]
+EOF
+    exit 1
+}
+
+while getopts "b:ud:T:s:r:w:" c; do
+    case $c in
+        b) baseline=$OPTARG ;;
+        u) update=1 ;;
+        d) datasets=$OPTARG ;;
+        T) tolerances=$OPTARG ;;
+        s) isas=$OPTARG ;;
+        r) runs=$OPTARG ;;
+        w) work=$OPTARG ;;
+        *) usage ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ $# -eq 1 ] || usage
+bin=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+[ -x "$bin" ] || { echo "[E::regress] $1 is not executable" >&2; exit 1; }
+mkdir -p "$work" || exit 1
+
+# Random genome of two contigs; ~8% of it are copies of 20 repeat units
+# with 2% substitutions. Park-Miller keeps the stream exact in any awk.
+gen_ref() {
+    awk -v n="$1" -v seed="$2" '
+    function rnd() { s = (s * 16807) % 2147483647; return s / 2147483647 }
+    function rseq(len,   r, i) { r = ""; for (i = 0; i < len; i++) r = r b[1 + int(rnd() * 4)]; return r }
+    function mutate(u,   r, i, c) {
+        r = ""
+        for (i = 1; i <= length(u); i++) {
+            c = substr(u, i, 1)
+            if (rnd() < 0.02) c = b[1 + int(rnd() * 4)]
+            r = r c
+        }
+        return r
+    }
+    BEGIN {
+        s = seed; split("A C G T", b, " ")
+        for (u = 0; u < 20; u++) unit[u] = rseq(300 + int(rnd() * 1200))
+        for (c = 1; c <= 2; c++) {
+            print ">chr" c
+            todo = int(n / 2); buf = ""
+            while (todo > 0) {
+                seg = rnd() < 0.01? mutate(unit[int(rnd() * 20)]) : rseq(100)
+                if (length(seg) > todo) seg = substr(seg, 1, todo)
+                todo -= length(seg); buf = buf seg
+                while (length(buf) >= 60) { print substr(buf, 1, 60); buf = substr(buf, 61) }
+            }
+            if (buf != "") print buf
+        }
+    }'
+}
+
+# Prepares reference, index and reads of a dataset; sets ref and reads
+prepare() {
+    local name=$1 gsize=$2 seed=$3 simopts=$4
+    ref=$work/ref_${gsize}_$seed.fa
+    if [ ! -s "$ref.bwt.2bit.64" ]; then
+        gen_ref "$gsize" "$seed" > "$ref" && "$bin" index "$ref" > "$work/index.log" 2>&1 ||
+            { echo "[E::regress] can't build the reference of $name" >&2; return 1; }
+    fi
+    if echo " $simopts " | grep -q " -S "; then
+        reads=$work/$name.fq
+    else
+        reads="$work/${name}_1.fq $work/${name}_2.fq"
+    fi
+    if [ ! -s "${reads%% *}" ]; then
+        "$bin" bench $simopts -s "$seed" -w "$work/$name" "$ref" > "$work/sim.log" 2>&1 ||
+            { echo "[E::regress] can't simulate the reads of $name" >&2; return 1; }
+    fi
+}
+
+# Metrics of one run as "metric<TAB>value" lines
+metrics() {
+    local json=$1 wall=$2 sam=$3
+    printf "wall\t%s\n" "$wall"
+    awk '/"phases": \{/ { p = 1; next }
+         p && /\}/ { p = 0 }
+         p { gsub(/[",:]/, ""); printf "phase.%s\t%s\n", $1, $2 }
+         /"tid":/ {
+             for (i = 1; i <= NF; i++) {
+                 k = $i; gsub(/[",:{]/, "", k); v = $(i + 1); gsub(/[,}]/, "", v)
+                 if (k == "smem" || k == "sal" || k == "bsw" || k == "worker_sam") t[k] += v
+             }
+         }
+         /"max_rss_bytes":/ { v = $2; gsub(/,/, "", v); rss = v }
+         END {
+             printf "kernel.smem\t%f\nkernel.sal\t%f\nkernel.bsw\t%f\nkernel.sam\t%f\n",
+                    t["smem"], t["sal"], t["bsw"], t["worker_sam"]
+             printf "rss\t%s\n", rss
+         }' "$json"
+    printf "checksum\t%s\n" "$(grep -v '^@PG' "$sam" | md5sum | cut -d' ' -f1)"
+}
+
+current=$work/current.tsv
+: > "$current"
+nfail_run=0
+while IFS=$'\t' read -r name gsize seed simopts memopts; do
+    case $name in ''|\#*) continue ;; esac
+    prepare "$name" "$gsize" "$seed" "$simopts" || { nfail_run=$((nfail_run + 1)); continue; }
+    for isa in ${isas//,/ }; do
+        simd=
+        [ "$isa" = native ] || simd="--simd $isa"
+        best=
+        for ((r = 0; r < runs; r++)); do
+            t0=$(date +%s%N)
+            if ! "$bin" $simd mem $memopts --metrics-json "$work/run.json" -o "$work/run.sam" \
+                 "$ref" $reads 2> "$work/run.log"; then
+                echo "[E::regress] $name/$isa: bwa-mem2 failed, see $work/run.log" >&2
+                best=; break
+            fi
+            t1=$(date +%s%N)
+            wall=$(awk -v a="$t0" -v b="$t1" 'BEGIN { printf "%.3f", (b - a) / 1e9 }')
+            if [ -z "$best" ] || awk -v a="$wall" -v b="$best" 'BEGIN { exit !(a < b) }'; then
+                best=$wall
+                metrics "$work/run.json" "$wall" "$work/run.sam" > "$work/best.tsv"
+            fi
+        done
+        if [ -z "$best" ]; then
+            nfail_run=$((nfail_run + 1))
+            continue
+        fi
+        awk -v d="$name" -v i="$isa" -F'\t' '{ printf "%s\t%s\t%s\t%s\n", d, i, $1, $2 }' \
+            "$work/best.tsv" >> "$current"
+        echo "[M::regress] $name/$isa: best wall time $best s of $runs runs" >&2
+    done
+done < "$datasets"
+
+if [ $update -eq 1 ]; then
+    { echo -e "#dataset\tisa\tmetric\tvalue"; cat "$current"; } > "$baseline" || exit 1
+    echo "[M::regress] wrote the baseline of $(cut -f1,2 "$current" | sort -u | wc -l) runs to $baseline" >&2
+    exit $((nfail_run > 0))
+fi
+[ -s "$baseline" ] || { echo "[E::regress] no baseline at $baseline; run with -u first" >&2; exit 1; }
+
+# PASS/FAIL per metric; a missing baseline entry is NEW and does not fail
+awk -F'\t' -v nfail_run=$nfail_run '
+    BEGIN { OFS = "\t"; print "status", "dataset", "isa", "metric", "baseline", "current", "change" }
+    FILENAME == ARGV[1] { if ($1 !~ /^#/ && NF >= 2) { pat[++np] = $1; pct[np] = $2; floor[np] = $3 } next }
+    FILENAME == ARGV[2] { if ($1 !~ /^#/) base[$1 "\t" $2 "\t" $3] = $4; next }
+    function glob2re(g) { gsub(/\./, "\\.", g); gsub(/\*/, ".*", g); gsub(/\?/, ".", g); return "^" g "$" }
+    {
+        key = $1 "\t" $2 "\t" $3
+        if (!(key in base)) { printf "NEW\t%s\t%s\t%s\t-\t%s\n", $1, $2, $3, $4; nnew++; next }
+        b = base[key]
+        if ($3 == "checksum") {
+            st = b == $4? "PASS" : "FAIL"
+            printf "%s\t%s\t%s\t%s\t%s\t%s\n", st, $1, $2, $3, substr(b, 1, 8), substr($4, 1, 8)
+        } else {
+            for (k = 1; k <= np; k++) if ($3 ~ glob2re(pat[k])) break
+            if (k > np || pct[k] == "-") next
+            d = b > 0? ($4 - b) * 100 / b : 0
+            st = ($4 - b > floor[k] && $4 > b * (1 + pct[k] / 100))? "FAIL" : "PASS"
+            printf "%s\t%s\t%s\t%s\t%s\t%s\t%+.1f%%\n", st, $1, $2, $3, b, $4, d
+        }
+        if (st == "FAIL") nfail++; else npass++
+    }
+    END {
+        printf "\n%d passed, %d failed, %d new", npass, nfail, nnew
+        if (nfail_run) printf ", %d runs did not complete", nfail_run
+        printf "\n"
+        exit (nfail + nfail_run) > 0
+    }' "$tolerances" "$baseline" "$current"